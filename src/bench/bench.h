@@ -0,0 +1,30 @@
+#ifndef STOMP_BENCH_H
+#define STOMP_BENCH_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+namespace bench {
+  // Keep value from being optimized away.
+  template <typename T>
+  inline void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+  }
+
+  // Nanoseconds per call of fn, the best of five runs of iterations calls each.
+  template <typename Fn>
+  double measure(size_t iterations, Fn&& fn) {
+    double best {0};
+    for (int run=0; run<5; run++) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i=0; i<iterations; i++) fn();
+      std::chrono::duration<double,std::nano> elapsed {std::chrono::steady_clock::now() - start};
+      double perCall = elapsed.count() / iterations;
+      if (run == 0 || perCall < best) best = perCall;
+    }
+    return best;
+  }
+}
+
+#endif
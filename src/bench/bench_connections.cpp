@@ -0,0 +1,150 @@
+// Thread-per-connection Transport against EpollTransport connections sharing one
+// EventLoop. Each connection connects, round-trips 100 messages through a local broker
+// that echoes every SEND back as a MESSAGE, and disconnects.
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include <sys/uio.h>
+
+#include "stomp/connection10.h"
+#include "stomp/epoll_transport.h"
+
+using namespace stomp;
+
+// A broker on one loop thread: CONNECTED for CONNECT, a MESSAGE for each SEND, and a
+// RECEIPT for DISCONNECT.
+struct Broker {
+  TCPServerSocket server {0, 1024};
+  EventLoop loop {};
+  std::map<int,std::pair<std::unique_ptr<TCPSocket>,std::string>> connections {};
+  Broker() {
+    server.setBlocking(false);
+    loop.add(server.getDescriptor(), EPOLLIN, [this](uint32_t){ this->accept(); });
+    loop.start();
+  }
+  unsigned short getPort() { return server.getLocalPort(); }
+  void accept() {
+    while (true) {
+      TCPSocket* socket {};
+      try {
+        socket = server.accept();
+      } catch (SocketException& e) {
+        return;
+      }
+      socket->setBlocking(false);
+      int descriptor = socket->getDescriptor();
+      connections[descriptor].first.reset(socket);
+      loop.add(descriptor, EPOLLIN, [this, descriptor](uint32_t){ this->read(descriptor); });
+    }
+  }
+  void read(int descriptor) {
+    auto& [socket, pending] = connections[descriptor];
+    char buffer[65536];
+    int count {0};
+    try {
+      count = socket->tryRecv(buffer, sizeof(buffer));
+    } catch (SocketException& e) {
+    }
+    if (count < 0) return;
+    if (count == 0) {
+      loop.remove(descriptor);
+      connections.erase(descriptor);
+      return;
+    }
+    pending.append(buffer, count);
+    std::string reply {};
+    size_t end;
+    while ((end = pending.find('\0')) != std::string::npos) {
+      std::string frame {pending.substr(0, end)};
+      pending.erase(0, pending.find_first_not_of('\n', end + 1));
+      if (frame.rfind(FRAME_CONNECT, 0) == 0) {
+        reply += std::string {"CONNECTED\nversion:1.0\n\n"} + '\0';
+      } else if (frame.rfind(FRAME_SEND, 0) == 0) {
+        reply += "MESSAGE\ndestination:/queue/a\nmessage-id:1\n\n" + frame.substr(frame.find("\n\n") + 2) + '\0';
+      } else if (frame.rfind(FRAME_DISCONNECT, 0) == 0) {
+        size_t id = frame.find("receipt:") + 8;
+        reply += "RECEIPT\nreceipt-id:" + frame.substr(id, frame.find('\n', id) - id) + "\n\n" + '\0';
+      }
+    }
+    for (size_t written=0; written<reply.size(); ) {
+      iovec remaining {reply.data() + written, reply.size() - written};
+      written += socket->trySendv(&remaining, 1);
+    }
+  }
+};
+
+struct Counter : ConnectionListener {
+  std::atomic<bool> connected {false};
+  std::atomic<int> messages {0};
+  virtual void onConnected(FramePtr /*frame*/) { connected = true; }
+  virtual void onMessage(const FrameView& /*view*/) { messages++; }
+};
+
+static int threads() {
+  int count {0};
+  FILE* status = std::fopen("/proc/self/status", "r");
+  char line[256];
+  while (std::fgets(line, sizeof(line), status)) {
+    if (std::strncmp(line, "Threads:", 8) == 0) count = std::atoi(line + 8);
+  }
+  std::fclose(status);
+  return count;
+}
+
+static void waitFor(const std::function<bool()>& done) {
+  while (!done()) std::this_thread::sleep_for(std::chrono::microseconds(100));
+}
+
+// Milliseconds for connections connections to round-trip messages messages each, and the
+// most threads the process had meanwhile.
+template <typename Make>
+static std::pair<double,int> run(Broker& broker, int connections, int messages, Make make) {
+  auto start = std::chrono::steady_clock::now();
+  HostsAndPorts address {std::make_shared<HostAndPort>("127.0.0.1", broker.getPort())};
+  std::vector<Connection10Ptr> clients {};
+  std::vector<std::shared_ptr<Counter>> counters {};
+  for (int i=0; i<connections; i++) {
+    Connection10Ptr client = make(address);
+    auto counter = std::make_shared<Counter>();
+    client->setListener("counter", counter);
+    client->connect();
+    clients.push_back(client);
+    counters.push_back(counter);
+  }
+  for (auto& counter : counters) waitFor([&counter](){ return counter->connected.load(); });
+  int peak = threads();
+  for (int i=0; i<messages; i++) {
+    for (auto& client : clients) client->send("/queue/a", "message " + std::to_string(i));
+  }
+  for (auto& counter : counters) waitFor([&counter, messages](){ return counter->messages >= messages; });
+  for (auto& client : clients) client->disconnect();
+  std::chrono::duration<double,std::milli> elapsed {std::chrono::steady_clock::now() - start};
+  return {elapsed.count(), peak};
+}
+
+int main() {
+  const int messages {100};
+  Broker broker {};
+  auto loop = std::make_shared<EventLoop>();
+  loop->start();
+  std::printf("conns   thread-per-connection        one EventLoop\n");
+  for (int connections : {1, 100, 1000}) {
+    auto [threaded, threadedPeak] = run(broker, connections, messages, [](HostsAndPorts address){
+      return std::make_shared<Connection10>(address);
+    });
+    auto [looped, loopedPeak] = run(broker, connections, messages, [&loop](HostsAndPorts address){
+      return std::make_shared<Connection10>(std::make_shared<EpollTransport>(loop, address));
+    });
+    std::printf("%5d  %9.1f ms %5d threads   %9.1f ms %5d threads\n", connections, threaded, threadedPeak, looped, loopedPeak);
+  }
+  return 0;
+}
@@ -0,0 +1,55 @@
+// Headers against the std::map<std::string,std::string> it replaced: each iteration
+// builds the headers of a frame, copies them, and looks four of them up.
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "stomp/headers.h"
+
+using namespace stomp;
+using MapHeaders = std::map<std::string,std::string>;
+
+using Values = std::vector<std::pair<std::string,std::string>>;
+
+static const Values fiveHeaders {
+  {HEADER_DESTINATION, "/queue/orders"},
+  {HEADER_MESSAGE_ID, "ID:broker-1-123456-1:1:1:1:42"},
+  {HEADER_SUBSCRIPTION, "sub-0"},
+  {HEADER_CONTENT_TYPE, "application/json"},
+  {HEADER_CONTENT_LENGTH, "128"},
+};
+
+static Values tenHeaders() {
+  Values values {fiveHeaders};
+  values.insert(values.end(), {
+    {HEADER_ACK, "ID:broker-1-123456-1:1:1:1:42"},
+    {"priority", "4"},
+    {"persistent", "true"},
+    {"expires", "0"},
+    {"timestamp", "1700000000000"},
+  });
+  return values;
+}
+
+template <typename H>
+static void frame(const Values& values) {
+  H headers {};
+  for (auto& [key, value] : values) headers[key] = value;
+  H copy {headers};
+  bench::keep(copy.find(HEADER_DESTINATION)->second);
+  bench::keep(copy.find(HEADER_MESSAGE_ID)->second);
+  bench::keep(copy.find(HEADER_SUBSCRIPTION)->second);
+  bench::keep(copy.find("receipt") == copy.end());
+}
+
+int main() {
+  const size_t iterations {200000};
+  for (auto& [name, values] : {std::make_pair("5 headers", fiveHeaders), std::make_pair("10 headers", tenHeaders())}) {
+    double map = bench::measure(iterations, [&values = values](){ frame<MapHeaders>(values); });
+    double flat = bench::measure(iterations, [&values = values](){ frame<Headers>(values); });
+    std::printf("%-10s  std::map %6.0f ns/frame   Headers %6.0f ns/frame   %.2fx\n", name, map, flat, map / flat);
+  }
+  return 0;
+}
@@ -0,0 +1,77 @@
+// The block scan kernels against the scan they replaced, one memchr per header line and
+// per colon: each iteration finds the header lines of a MESSAGE frame, splits them at
+// their first colon, and finds the NUL ending the body.
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "bench.h"
+#include "stomp/scan.h"
+
+using namespace stomp;
+
+static std::string messageFrame(size_t size) {
+  std::string frame {"MESSAGE\nsubscription:sub-0\nmessage-id:ID:broker-1-123456-1:1:1:1:42\n"
+                     "destination:/queue/orders.eu\ncontent-type:application/json\n"
+                     "ack:ID:broker-1-ack-42\npriority:4\n\n"};
+  frame.append(size > frame.size() + 1? size - frame.size() - 1: 1, 'x');
+  frame.push_back('\0');
+  return frame;
+}
+
+static void memchrScan(std::string_view frame) {
+  const char* pos = frame.data();
+  const char* end = pos + frame.size();
+  pos = static_cast<const char*>(std::memchr(pos, '\n', end - pos)) + 1;
+  while (pos < end) {
+    const char* eol = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+    if (eol == nullptr) eol = end;
+    size_t len = eol - pos;
+    if (len > 0 && pos[len-1] == '\r') len--;
+    const char* line = pos;
+    pos = eol + 1;
+    if (len == 0) break;
+    bench::keep(std::memchr(line, ':', len));
+  }
+  bench::keep(std::memchr(pos, '\0', end - pos));
+}
+
+static void blockScan(std::string_view frame) {
+  const char* data = frame.data();
+  const char* end = data + frame.size();
+  size_t headers = scan::find(data, end, '\n') - data + 1;
+  size_t body = headers + scan::forEachHeader(frame.substr(headers), [](std::string_view key, std::string_view value){
+    bench::keep(key);
+    bench::keep(value);
+  });
+  bench::keep(scan::find(data + body, end, '\0'));
+}
+
+int main() {
+  std::vector<const scan::Kernel*> kernels {};
+#ifdef STOMP_SCAN_X86
+  if (__builtin_cpu_supports("avx2")) kernels.push_back(&scan::avx2Kernel);
+  kernels.push_back(&scan::sse2Kernel);
+#endif
+  kernels.push_back(&scan::scalarKernel);
+  const scan::Kernel& best = scan::kernel();
+  std::printf("frame    memchr/line");
+  for (auto kernel : kernels) std::printf(" %10s", kernel->name);
+  std::printf("   (MB/s)\n");
+  for (size_t size : {100, 1000, 10000, 100000, 1000000}) {
+    std::string frame {messageFrame(size)};
+    size_t iterations = std::max<size_t>(16, (8 << 20) / frame.size());
+    auto rate = [&frame](double ns){ return frame.size() / ns * 1e3; };
+    std::printf("%7zu B %10.0f", size, rate(bench::measure(iterations, [&frame](){ memchrScan(frame); })));
+    for (auto kernel : kernels) {
+      scan::setKernel(*kernel);
+      std::printf(" %10.0f", rate(bench::measure(iterations, [&frame](){ blockScan(frame); })));
+    }
+    std::printf("\n");
+  }
+  scan::setKernel(best);
+  return 0;
+}
@@ -22,21 +22,31 @@
 extern "C"
 {
 #ifdef WIN32
-  #include <winsock.h>         // For socket(), connect(), send(), and recv()
+  #include <winsock2.h>        // For socket(), connect(), send(), and recv()
+  #include <ws2tcpip.h>        // For getaddrinfo()
   typedef int socklen_t;
   typedef char raw_type;       // Type used for raw data on this platform
 #else
   #include <sys/types.h>       // For data types
   #include <sys/socket.h>      // For socket(), connect(), send(), and recv()
-  #include <netdb.h>           // For gethostbyname()
+  #include <netdb.h>           // For getaddrinfo()
   #include <arpa/inet.h>       // For inet_addr()
   #include <unistd.h>          // For close()
   #include <netinet/in.h>      // For sockaddr_in
+  #include <netinet/tcp.h>     // For TCP_CORK
+  #include <sys/uio.h>         // For iovec
+  #include <limits.h>          // For IOV_MAX
+  #include <fcntl.h>           // For fcntl()
   typedef void raw_type;       // Type used for raw data on this platform
 #endif
 }
 
 #include <errno.h>             // For errno
+#include <cstring>             // For strerror(), memset() and memcpy()
+#include <map>                 // For map
+#include <mutex>               // For mutex
+#include <future>              // For shared_future
+#include <chrono>              // For steady_clock
 
 #ifdef WIN32
 static bool initialized = false;
@@ -58,26 +68,158 @@ const char *SocketException::what() const _NOEXCEPT {
   return userMessage.c_str();
 }
 
-// Function to fill in address structure given an address and port
-static void fillAddr(const std::string &address, unsigned short port,
-                     sockaddr_in &addr) {
-  memset(&addr, 0, sizeof(addr));  // Zero out address structure
-  addr.sin_family = AF_INET;       // Internet address
+// SocketAddress Code
+
+SocketAddress::SocketAddress() : length(0) {
+  memset(storage, 0, sizeof(storage));
+}
+
+SocketAddress::SocketAddress(const sockaddr *addr, unsigned int addrLen) {
+  static_assert(sizeof(storage) >= sizeof(sockaddr_storage), "storage too small");
+  memset(storage, 0, sizeof(storage));
+  length = addrLen < sizeof(storage) ? addrLen : sizeof(storage);
+  memcpy(storage, addr, length);
+}
+
+const sockaddr *SocketAddress::get() const {
+  return (const sockaddr *) storage;
+}
 
-  hostent *host;  // Resolve name
-  if ((host = gethostbyname(address.c_str())) == NULL) {
-    // strerror() will not work for gethostbyname() and hstrerror() 
-    // is supposedly obsolete
-    throw SocketException("Failed to resolve name (gethostbyname())");
+unsigned int SocketAddress::getLength() const {
+  return length;
+}
+
+int SocketAddress::getFamily() const {
+  return length > 0 ? get()->sa_family : AF_UNSPEC;
+}
+
+std::string SocketAddress::getHost() const {
+  char host[NI_MAXHOST];
+  if (getnameinfo(get(), length, host, sizeof(host), NULL, 0, NI_NUMERICHOST) != 0) {
+    return "";
   }
-  addr.sin_addr.s_addr = *((unsigned long *) host->h_addr_list[0]);
+  return host;
+}
+
+// Port of an IPv4 or IPv6 address
+static unsigned short portOf(const sockaddr *addr) {
+  if (addr->sa_family == AF_INET6) {
+    return ntohs(((const sockaddr_in6 *) addr)->sin6_port);
+  }
+  return ntohs(((const sockaddr_in *) addr)->sin_port);
+}
 
-  addr.sin_port = htons(port);     // Assign port in network byte order
+// Resolver Code
+
+namespace {
+  typedef std::shared_future<std::vector<SocketAddress> > Lookup;
+
+  struct CacheEntry {
+    Lookup lookup;
+    std::chrono::steady_clock::time_point expires;
+  };
+
+  std::mutex resolverMutex;
+  std::map<std::string, CacheEntry> resolverCache;
+  std::chrono::seconds resolverTimeToLive(60);
+
+  // Resolve with getaddrinfo(), which (unlike gethostbyname()) is thread-safe
+  std::vector<SocketAddress> lookUp(const std::string &host, unsigned short port,
+                                    int family) {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = family;
+    hints.ai_socktype = SOCK_STREAM;
+    std::string service = std::to_string(port);
+
+    addrinfo *results = NULL;
+    int rtn = getaddrinfo(host.c_str(), service.c_str(), &hints, &results);
+    if (rtn != 0) {
+      throw SocketException("Failed to resolve name (getaddrinfo()): " +
+                            std::string(gai_strerror(rtn)));
+    }
+    std::vector<SocketAddress> addresses;
+    for (addrinfo *result = results; result != NULL; result = result->ai_next) {
+      if (result->ai_family == AF_INET || result->ai_family == AF_INET6) {
+        addresses.push_back(SocketAddress(result->ai_addr, result->ai_addrlen));
+      }
+    }
+    freeaddrinfo(results);
+    if (addresses.empty()) {
+      throw SocketException("Failed to resolve name (getaddrinfo()): no address");
+    }
+    return addresses;
+  }
+}
+
+std::vector<SocketAddress> Resolver::resolve(const std::string &host,
+                                             unsigned short port, int family) {
+  std::string key = host + '/' + std::to_string(port) + '/' + std::to_string(family);
+  std::promise<std::vector<SocketAddress> > resolving;
+  Lookup lookup;
+  {
+    std::lock_guard<std::mutex> lock(resolverMutex);
+    if (resolverTimeToLive.count() == 0) {
+      lookup = Lookup();
+    } else {
+      std::map<std::string, CacheEntry>::iterator found = resolverCache.find(key);
+      if (found != resolverCache.end() &&
+          found->second.expires > std::chrono::steady_clock::now()) {
+        lookup = found->second.lookup;
+      } else {
+        // the first to ask does the lookup, anyone else asking meanwhile waits for it
+        CacheEntry entry;
+        entry.lookup = resolving.get_future().share();
+        entry.expires = std::chrono::steady_clock::now() + resolverTimeToLive;
+        resolverCache[key] = entry;
+      }
+    }
+  }
+  if (lookup.valid()) {
+    return lookup.get();
+  }
+  if (resolverTimeToLive.count() == 0) {
+    return lookUp(host, port, family);
+  }
+  try {
+    std::vector<SocketAddress> addresses = lookUp(host, port, family);
+    resolving.set_value(addresses);
+    return addresses;
+  } catch (...) {
+    // failures are not cached, the next caller tries again
+    resolving.set_exception(std::current_exception());
+    std::lock_guard<std::mutex> lock(resolverMutex);
+    resolverCache.erase(key);
+    throw;
+  }
+}
+
+void Resolver::setTimeToLive(unsigned int seconds) {
+  std::lock_guard<std::mutex> lock(resolverMutex);
+  resolverTimeToLive = std::chrono::seconds(seconds);
+  if (seconds == 0) {
+    resolverCache.clear();
+  }
+}
+
+void Resolver::clearCache() {
+  std::lock_guard<std::mutex> lock(resolverMutex);
+  resolverCache.clear();
+}
+
+// Function to fill in address structure given an address and port
+static void fillAddr(const std::string &address, unsigned short port,
+                     sockaddr_in &addr) {
+  std::vector<SocketAddress> addresses = Resolver::resolve(address, port, AF_INET);
+  memcpy(&addr, addresses[0].get(), sizeof(addr));
 }
 
 // Socket Code
 
-Socket::Socket(int type, int protocol) {
+Socket::Socket(int type, int protocol) : Socket(PF_INET, type, protocol) {
+}
+
+Socket::Socket(int domain, int type, int protocol) {
   #ifdef WIN32
     if (!initialized) {
       WORD wVersionRequested;
@@ -92,7 +234,7 @@ Socket::Socket(int type, int protocol) {
   #endif
 
   // Make a new socket
-  if ((sockDesc = socket(PF_INET, type, protocol)) < 0) {
+  if ((sockDesc = socket(domain, type, protocol)) < 0) {
     throw SocketException("Socket creation failed (socket())", true);
   }
 }
@@ -110,24 +252,42 @@ Socket::~Socket() {
   sockDesc = -1;
 }
 
+void Socket::reopen(int domain) {
+  int type = 0;
+  socklen_t typeLen = sizeof(type);
+  if (getsockopt(sockDesc, SOL_SOCKET, SO_TYPE, (raw_type *) &type, &typeLen) < 0) {
+    throw SocketException("Fetch of socket type failed (getsockopt())", true);
+  }
+  int fresh = socket(domain, type, 0);
+  if (fresh < 0) {
+    throw SocketException("Socket creation failed (socket())", true);
+  }
+  #ifdef WIN32
+    ::closesocket(sockDesc);
+  #else
+    ::close(sockDesc);
+  #endif
+  sockDesc = fresh;
+}
+
 std::string Socket::getLocalAddress() {
-  sockaddr_in addr;
+  sockaddr_storage addr;
   unsigned int addr_len = sizeof(addr);
 
   if (getsockname(sockDesc, (sockaddr *) &addr, (socklen_t *) &addr_len) < 0) {
     throw SocketException("Fetch of local address failed (getsockname())", true);
   }
-  return inet_ntoa(addr.sin_addr);
+  return SocketAddress((sockaddr *) &addr, addr_len).getHost();
 }
 
 unsigned short Socket::getLocalPort() {
-  sockaddr_in addr;
+  sockaddr_storage addr;
   unsigned int addr_len = sizeof(addr);
 
   if (getsockname(sockDesc, (sockaddr *) &addr, (socklen_t *) &addr_len) < 0) {
     throw SocketException("Fetch of local port failed (getsockname())", true);
   }
-  return ntohs(addr.sin_port);
+  return portOf((sockaddr *) &addr);
 }
 
 void Socket::setLocalPort(unsigned short localPort) {
@@ -172,23 +332,99 @@ unsigned short Socket::resolveService(const std::string &service,
     return ntohs(serv->s_port);    /* Found port (network byte order) by name */
 }
 
+int Socket::getDescriptor() {
+  return sockDesc;
+}
+
+void Socket::setBlocking(bool blocking) {
+  #ifdef WIN32
+    u_long nonBlocking = blocking ? 0 : 1;
+    if (ioctlsocket(sockDesc, FIONBIO, &nonBlocking) != 0) {
+      throw SocketException("Set of blocking mode failed (ioctlsocket())", true);
+    }
+  #else
+    int flags = fcntl(sockDesc, F_GETFL, 0);
+    if (flags < 0) {
+      throw SocketException("Fetch of socket flags failed (fcntl())", true);
+    }
+    flags = blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK);
+    if (fcntl(sockDesc, F_SETFL, flags) < 0) {
+      throw SocketException("Set of blocking mode failed (fcntl())", true);
+    }
+  #endif
+}
+
 // CommunicatingSocket Code
 
 CommunicatingSocket::CommunicatingSocket(int type, int protocol)  
     : Socket(type, protocol) {
 }
 
+CommunicatingSocket::CommunicatingSocket(int domain, int type, int protocol)
+    : Socket(domain, type, protocol) {
+}
+
 CommunicatingSocket::CommunicatingSocket(int newConnSD) : Socket(newConnSD) {
 }
 
 void CommunicatingSocket::connect(const std::string &foreignAddress,
     unsigned short foreignPort) {
-  // Get the address of the requested host
-  sockaddr_in destAddr;
-  fillAddr(foreignAddress, foreignPort, destAddr);
+  // Try each address of the requested host in turn
+  std::vector<SocketAddress> addresses = Resolver::resolve(foreignAddress, foreignPort, AF_INET);
+  for (size_t i = 0; i < addresses.size(); i++) {
+    try {
+      // A failed connect() leaves the descriptor unusable, so each further
+      // address gets a new one
+      if (i > 0) {
+        reopen(addresses[i].getFamily());
+      }
+      connect(addresses[i]);
+      return;
+    } catch (SocketException &e) {
+      if (i + 1 == addresses.size()) {
+        throw;
+      }
+    }
+  }
+}
+
+void CommunicatingSocket::connect(const SocketAddress &foreignAddress) {
+  if (::connect(sockDesc, foreignAddress.get(), foreignAddress.getLength()) < 0) {
+    throw SocketException("Connect failed (connect())", true);
+  }
+}
+
+bool CommunicatingSocket::startConnect(const std::string &foreignAddress,
+    unsigned short foreignPort) {
+  return startConnect(Resolver::resolve(foreignAddress, foreignPort, AF_INET)[0]);
+}
 
-  // Try to connect to the given port
-  if (::connect(sockDesc, (sockaddr *) &destAddr, sizeof(destAddr)) < 0) {
+bool CommunicatingSocket::startConnect(const SocketAddress &foreignAddress) {
+  setBlocking(false);
+  if (::connect(sockDesc, foreignAddress.get(), foreignAddress.getLength()) == 0) {
+    return true;
+  }
+  #ifdef WIN32
+    if (WSAGetLastError() == WSAEWOULDBLOCK) {
+      return false;
+    }
+  #else
+    if (errno == EINPROGRESS) {
+      return false;
+    }
+  #endif
+  throw SocketException("Connect failed (connect())", true);
+}
+
+void CommunicatingSocket::finishConnect() {
+  int error = 0;
+  socklen_t errorLen = sizeof(error);
+  if (getsockopt(sockDesc, SOL_SOCKET, SO_ERROR, (raw_type *) &error,
+                 &errorLen) < 0) {
+    throw SocketException("Fetch of connect result failed (getsockopt())", true);
+  }
+  if (error != 0) {
+    errno = error;
     throw SocketException("Connect failed (connect())", true);
   }
 }
@@ -200,6 +436,101 @@ void CommunicatingSocket::send(const void *buffer, int bufferLen)
   }
 }
 
+void CommunicatingSocket::sendv(iovec *buffers, int bufferCount, bool more) {
+#ifdef WIN32
+  for (int i = 0; i < bufferCount; i++) {
+    send(buffers[i].iov_base, (int) buffers[i].iov_len);
+  }
+#else
+  int flags = 0;
+  #ifdef MSG_MORE
+    if (more) flags |= MSG_MORE;
+  #endif
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  while (bufferCount > 0) {
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = bufferCount < IOV_MAX ? bufferCount : IOV_MAX;
+    ssize_t sent = ::sendmsg(sockDesc, &msg, flags);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      throw SocketException("Send failed (sendmsg())", true);
+    }
+    // Skip the buffers that went out whole and advance into a partly sent one
+    while (bufferCount > 0 && (size_t) sent >= buffers->iov_len) {
+      sent -= buffers->iov_len;
+      buffers++;
+      bufferCount--;
+    }
+    if (bufferCount > 0) {
+      buffers->iov_base = (char *) buffers->iov_base + sent;
+      buffers->iov_len -= sent;
+    }
+  }
+#endif
+}
+
+void CommunicatingSocket::setCork(bool cork) {
+#if defined(TCP_CORK) || defined(TCP_NOPUSH)
+  #ifdef TCP_CORK
+    int option = TCP_CORK;
+  #else
+    int option = TCP_NOPUSH;
+  #endif
+  int value = cork ? 1 : 0;
+  if (setsockopt(sockDesc, IPPROTO_TCP, option, (raw_type *) &value,
+                 sizeof(value)) < 0) {
+    throw SocketException("Set of TCP cork failed (setsockopt())", true);
+  }
+#endif
+}
+
+long CommunicatingSocket::trySendv(const iovec *buffers, int bufferCount) {
+#ifdef WIN32
+  long total = 0;
+  for (int i = 0; i < bufferCount; i++) {
+    int rtn = ::send(sockDesc, (raw_type *) buffers[i].iov_base, (int) buffers[i].iov_len, 0);
+    if (rtn < 0) {
+      if (WSAGetLastError() == WSAEWOULDBLOCK) break;
+      throw SocketException("Send failed (send())", true);
+    }
+    total += rtn;
+    if ((size_t) rtn < buffers[i].iov_len) break;
+  }
+  return total;
+#else
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<iovec *>(buffers);
+  msg.msg_iovlen = bufferCount < IOV_MAX ? bufferCount : IOV_MAX;
+  ssize_t sent;
+  do {
+    sent = ::sendmsg(sockDesc, &msg, MSG_DONTWAIT);
+  } while (sent < 0 && errno == EINTR);
+  if (sent < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+    throw SocketException("Send failed (sendmsg())", true);
+  }
+  return sent;
+#endif
+}
+
+int CommunicatingSocket::tryRecv(void *buffer, int bufferLen) {
+  int rtn;
+  do {
+    rtn = ::recv(sockDesc, (raw_type *) buffer, bufferLen, 0);
+  } while (rtn < 0 && errno == EINTR);
+  if (rtn < 0) {
+  #ifdef WIN32
+    if (WSAGetLastError() == WSAEWOULDBLOCK) return -1;
+  #else
+    if (errno == EAGAIN || errno == EWOULDBLOCK) return -1;
+  #endif
+    throw SocketException("Received failed (recv())", true);
+  }
+  return rtn;
+}
+
 int CommunicatingSocket::recv(void *buffer, int bufferLen) 
     {
   int rtn;
@@ -210,25 +541,33 @@ int CommunicatingSocket::recv(void *buffer, int bufferLen)
   return rtn;
 }
 
+void CommunicatingSocket::shutdown() {
+#ifdef WIN32
+  ::shutdown(sockDesc, SD_BOTH);
+#else
+  ::shutdown(sockDesc, SHUT_RDWR);
+#endif
+}
+
 std::string CommunicatingSocket::getForeignAddress()
     {
-  sockaddr_in addr;
+  sockaddr_storage addr;
   unsigned int addr_len = sizeof(addr);
 
   if (getpeername(sockDesc, (sockaddr *) &addr,(socklen_t *) &addr_len) < 0) {
     throw SocketException("Fetch of foreign address failed (getpeername())", true);
   }
-  return inet_ntoa(addr.sin_addr);
+  return SocketAddress((sockaddr *) &addr, addr_len).getHost();
 }
 
 unsigned short CommunicatingSocket::getForeignPort() {
-  sockaddr_in addr;
+  sockaddr_storage addr;
   unsigned int addr_len = sizeof(addr);
 
   if (getpeername(sockDesc, (sockaddr *) &addr, (socklen_t *) &addr_len) < 0) {
     throw SocketException("Fetch of foreign port failed (getpeername())", true);
   }
-  return ntohs(addr.sin_port);
+  return portOf((sockaddr *) &addr);
 }
 
 // TCPSocket Code
@@ -243,6 +582,10 @@ TCPSocket::TCPSocket(const std::string &foreignAddress, unsigned short foreignPo
   connect(foreignAddress, foreignPort);
 }
 
+TCPSocket::TCPSocket(const SocketAddress &foreignAddress)
+    : CommunicatingSocket(foreignAddress.getFamily(), SOCK_STREAM, IPPROTO_TCP) {
+}
+
 TCPSocket::TCPSocket(int newConnSD) : CommunicatingSocket(newConnSD) {
 }
 
@@ -21,8 +21,18 @@
 #define __PRACTICALSOCKET_INCLUDED__
 
 #include <string>            // For string
+#include <vector>            // For vector
 #include <exception>         // For exception class
 
+#ifdef WIN32
+struct iovec {               // Scatter/gather buffer, as in <sys/uio.h>
+  void *iov_base;
+  size_t iov_len;
+};
+#else
+struct iovec;                // From <sys/uio.h>
+#endif
+
 /**
  *   Signals a problem with the execution of a socket call.
  */
@@ -51,6 +61,82 @@ private:
   std::string userMessage;  // Exception message
 };
 
+struct sockaddr;             // From <sys/socket.h>
+
+/**
+ *   An IPv4 or IPv6 socket address (address and port), as resolved by
+ *   Resolver
+ */
+class SocketAddress {
+public:
+  SocketAddress();
+
+  /**
+   *   Copy the given socket address
+   *   @param addr address (sockaddr_in or sockaddr_in6)
+   *   @param addrLen length of addr
+   */
+  SocketAddress(const sockaddr *addr, unsigned int addrLen);
+
+  /**
+   *   @return the address, for bind() or connect()
+   */
+  const sockaddr *get() const;
+
+  /**
+   *   @return the length of the address
+   */
+  unsigned int getLength() const;
+
+  /**
+   *   @return the address family (AF_INET or AF_INET6)
+   */
+  int getFamily() const;
+
+  /**
+   *   @return the numeric address, without the port
+   */
+  std::string getHost() const;
+
+private:
+  alignas(8) unsigned char storage[128];   // Big enough for a sockaddr_storage
+  unsigned int length;
+};
+
+/**
+ *   Thread-safe name resolution (getaddrinfo()) with a cache shared by all
+ *   sockets in the process.  Resolved names are kept for a time-to-live;
+ *   while one thread resolves a name, others asking for it wait for that
+ *   lookup instead of starting their own
+ */
+class Resolver {
+public:
+  /**
+   *   Resolve a host name or numeric address to all its addresses, IPv4 and
+   *   IPv6, in the order getaddrinfo() prefers them
+   *   @param host host name or numeric address
+   *   @param port port to put in the addresses
+   *   @param family AF_INET or AF_INET6 for that family only, or 0 for both
+   *   @return addresses (at least one)
+   *   @exception SocketException thrown if the name cannot be resolved
+   */
+  static std::vector<SocketAddress> resolve(const std::string &host,
+                                            unsigned short port,
+                                            int family = 0);
+
+  /**
+   *   Set how long resolved names are cached for (default 60 seconds);
+   *   0 disables the cache
+   *   @param seconds time-to-live
+   */
+  static void setTimeToLive(unsigned int seconds);
+
+  /**
+   *   Forget all cached names, e.g. when the brokers have moved
+   */
+  static void clearCache();
+};
+
 /**
  *   Base class representing basic communication endpoint
  */
@@ -118,6 +204,20 @@ public:
   static unsigned short resolveService(const std::string &service,
                                        const std::string &protocol = "tcp");
 
+  /**
+   *   Get the underlying socket descriptor, e.g. to register it with an
+   *   event loop.  The descriptor remains owned by this object
+   *   @return socket descriptor
+   */
+  int getDescriptor();
+
+  /**
+   *   Put the socket into blocking (the default) or non-blocking mode
+   *   @param blocking false for non-blocking mode
+   *   @exception SocketException thrown if the mode cannot be changed
+   */
+  void setBlocking(bool blocking);
+
 private:
   // Prevent the user from trying to use value semantics on this object
   Socket(const Socket &sock);
@@ -126,7 +226,17 @@ private:
 protected:
   int sockDesc;              // Socket descriptor
   Socket(int type, int protocol);
+  Socket(int domain, int type, int protocol);
   Socket(int sockDesc);
+
+  /**
+   *   Replace the descriptor with a new one of the same type, e.g. for another
+   *   connection attempt after a failed connect(), which leaves a socket in
+   *   an unspecified state.  Options set on the old descriptor are not kept
+   *   @param domain address family of the new descriptor
+   *   @exception SocketException thrown if unable to create the socket
+   */
+  void reopen(int domain);
 };
 
 /**
@@ -143,6 +253,41 @@ public:
    */
   void connect(const std::string &foreignAddress, unsigned short foreignPort);
 
+  /**
+   *   Establish a socket connection with the given resolved address
+   *   @param foreignAddress foreign address, of the socket's family
+   *   @exception SocketException thrown if unable to establish connection
+   */
+  void connect(const SocketAddress &foreignAddress);
+
+  /**
+   *   Start connecting to the given foreign address and port without
+   *   waiting for the connection to be established.  Puts the socket into
+   *   non-blocking mode; wait for it to become writable, then call
+   *   finishConnect()
+   *   @param foreignAddress foreign address (IP address or name)
+   *   @param foreignPort foreign port
+   *   @return true if the connection was established at once
+   *   @exception SocketException thrown if unable to start connecting
+   */
+  bool startConnect(const std::string &foreignAddress, unsigned short foreignPort);
+
+  /**
+   *   Start connecting to the given resolved address without waiting, as
+   *   startConnect() above
+   *   @param foreignAddress foreign address, of the socket's family
+   *   @return true if the connection was established at once
+   *   @exception SocketException thrown if unable to start connecting
+   */
+  bool startConnect(const SocketAddress &foreignAddress);
+
+  /**
+   *   Complete a connection begun with startConnect(), once the socket is
+   *   writable
+   *   @exception SocketException thrown if the connection failed
+   */
+  void finishConnect();
+
   /**
    *   Write the given buffer to this socket.  Call connect() before
    *   calling send()
@@ -152,6 +297,27 @@ public:
    */
   void send(const void *buffer, int bufferLen);
 
+  /**
+   *   Write the given buffers to this socket, in order, with as few system
+   *   calls as possible (sendmsg()).  Call connect() before calling sendv()
+   *   @param buffers buffers to be written; entries are advanced in place
+   *   if the data goes out in more than one write
+   *   @param bufferCount number of buffers
+   *   @param more hint that more data will follow shortly, so a partial
+   *   segment may be held back (MSG_MORE where supported)
+   *   @exception SocketException thrown if unable to send data
+   */
+  void sendv(iovec *buffers, int bufferCount, bool more = false);
+
+  /**
+   *   Cork or uncork the socket.  While corked, partial segments are held
+   *   back; uncorking sends whatever is pending (TCP_CORK, or TCP_NOPUSH
+   *   on BSD).  Has no effect where neither is supported
+   *   @param cork true to cork, false to uncork
+   *   @exception SocketException thrown if the option cannot be set
+   */
+  void setCork(bool cork);
+
   /**
    *   Read into the given buffer up to bufferLen bytes data from this
    *   socket.  Call connect() before calling recv()
@@ -162,6 +328,34 @@ public:
    */
   int recv(void *buffer, int bufferLen);
 
+  /**
+   *   Write as much of the given buffers as the socket accepts without
+   *   blocking.  For use with non-blocking sockets, or to write to a
+   *   blocking one only what it takes at once (except on Windows)
+   *   @param buffers buffers to be written
+   *   @param bufferCount number of buffers
+   *   @return number of bytes written, 0 if the socket is not writable
+   *   @exception SocketException thrown if unable to send data
+   */
+  long trySendv(const iovec *buffers, int bufferCount);
+
+  /**
+   *   Read whatever data is available without blocking.  For use with
+   *   non-blocking sockets
+   *   @param buffer buffer to receive the data
+   *   @param bufferLen maximum number of bytes to read into buffer
+   *   @return number of bytes read, 0 for EOF, and -1 if no data is available
+   *   @exception SocketException thrown if unable to receive data
+   */
+  int tryRecv(void *buffer, int bufferLen);
+
+  /**
+   *   Shut the connection down in both directions without closing the
+   *   socket, so that a recv() blocked on it in another thread returns 0.
+   *   Errors (e.g. the connection is already gone) are ignored
+   */
+  void shutdown();
+
   /**
    *   Get the foreign address.  Call connect() before calling recv()
    *   @return foreign address
@@ -178,6 +372,7 @@ public:
 
 protected:
   CommunicatingSocket(int type, int protocol);
+  CommunicatingSocket(int domain, int type, int protocol);
   CommunicatingSocket(int newConnSD);
 };
 
@@ -201,6 +396,14 @@ public:
    */
   TCPSocket(const std::string &foreignAddress, unsigned short foreignPort);
 
+  /**
+   *   Construct a TCP socket with no connection, of the address family of
+   *   the given address (so it can be connected to it, IPv4 or IPv6)
+   *   @param foreignAddress resolved address to connect to later
+   *   @exception SocketException thrown if unable to create TCP socket
+   */
+  explicit TCPSocket(const SocketAddress &foreignAddress);
+
 private:
   // Access for TCPServerSocket::accept() connection creation
   friend class TCPServerSocket;
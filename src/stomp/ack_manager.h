@@ -0,0 +1,367 @@
+#ifndef STOMP_ACK_MANAGER_H
+#define STOMP_ACK_MANAGER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "listener.h"
+#include "base_transport.h"
+#include "frame_pool.h"
+#include "subscription_table.h"
+#include "timer_wheel.h"
+#include "hand_off_thread.h"
+#include "flow_control.h"
+
+// acknowledged messages that make the manager flush
+#define STOMP_ACK_MAX_BATCH 64
+// milliseconds an acknowledgement may wait to be flushed
+#define STOMP_ACK_MAX_DELAY_MS 20
+
+namespace stomp {
+  struct AckPolicy {
+    // When acknowledgements are sent: once maxAcks messages have been acknowledged, or
+    // maxDelay after the first of them, whichever comes first.
+    size_t maxAcks {STOMP_ACK_MAX_BATCH};
+    std::chrono::milliseconds maxDelay {STOMP_ACK_MAX_DELAY_MS};
+  };
+
+  class AckManager : public ConnectionListener, public DeliveryTracker {
+    // Acknowledges messages in batches instead of with an ACK frame each. It learns the ack
+    // mode of each subscription from the SUBSCRIBE frames sent and the protocol version
+    // from CONNECTED, and keeps the ids of the messages delivered on client and
+    // client-individual subscriptions and not acknowledged yet. On a client subscription
+    // an ACK covers every message delivered before it, so however many messages are
+    // acknowledged, one ACK goes out, for the latest. On a client-individual subscription
+    // each message needs an ACK of its own, and those are written together. The batch
+    // goes out when the policy says, on flush(), and before the connection disconnects;
+    // when it goes out on its deadline, that is on a thread of the manager's own, as the
+    // timer wheel's thread must not wait for the socket. STOMP 1.0 subscriptions without
+    // an id are known by their destination.
+    // Acknowledgements not flushed when the connection is lost, or before an UNSUBSCRIBE,
+    // are dropped and the server redelivers the messages. Acknowledge in a transaction
+    // with ack() on the connection.
+  protected:
+    class IdQueue {
+      // Ids in a ring of strings that keep their capacity, so that once warmed up queueing
+      // an id doesn't allocate.
+    protected:
+      std::vector<std::string> ids_ {};
+      size_t head_ {0};
+      size_t size_ {0};
+    public:
+      size_t size() const { return size_; }
+      std::string& operator[](size_t i) { return ids_[(head_ + i) % ids_.size()]; }
+      void push(std::string_view id) {
+        if (size_ == ids_.size()) {
+          std::rotate(ids_.begin(), ids_.begin() + head_, ids_.end());
+          head_ = 0;
+          ids_.resize(std::max<size_t>(8, ids_.size() * 2));
+        }
+        (*this)[size_].assign(id);
+        size_++;
+      }
+      // Drop the first n ids.
+      void pop(size_t n) {
+        if (n == 0) return;
+        head_ = (head_ + n) % ids_.size();
+        size_ -= n;
+      }
+      // Position of id, or npos.
+      size_t find(std::string_view id) {
+        for (size_t i=0; i<size_; i++) {
+          if ((*this)[i] == id) return i;
+        }
+        return std::string::npos;
+      }
+      // Drop the id at i, keeping the others in order.
+      void erase(size_t i) {
+        for (; i>0; i--) std::swap((*this)[i], (*this)[i - 1]);
+        this->pop(1);
+      }
+      void clear() {
+        head_ = 0;
+        size_ = 0;
+      }
+    };
+    // A subscription's id, or for a STOMP 1.0 subscription without one, its destination:
+    // the messages of those have no subscription header.
+    struct Key {
+      std::string_view name;
+      bool byDestination;
+      bool operator==(const Key& other) const { return byDestination == other.byDestination && name == other.name; }
+    };
+    struct KeyHash {
+      size_t operator()(const Key& key) const { return std::hash<std::string_view> {}(key.name) + key.byDestination; }
+    };
+    struct Subscription {
+      std::string id {};
+      std::string destination {};
+      bool individual {false};
+      // false for a subscription not seen being made, whose messages are acknowledged as given
+      bool tracked {true};
+      // ack ids of the messages delivered and not acknowledged, oldest first
+      IdQueue delivered {};
+      // client-individual: the ids acknowledged since the last flush
+      IdQueue acked {};
+      // client: the latest id acknowledged since the last flush
+      std::string latest {};
+      bool hasLatest {false};
+      // messages acknowledged since the last flush
+      size_t unflushed {0};
+    };
+    std::weak_ptr<BaseTransport> transport_;
+    AckPolicy policy_;
+    std::mutex mutex_ {};
+    // keys are views of the ids or destinations held by the entries
+    std::unordered_map<Key,std::unique_ptr<Subscription>,KeyHash> subscriptions_ {};
+    // the version the server accepted, which decides how messages are acknowledged
+    std::atomic<bool> stomp11_ {false};
+    std::atomic<bool> stomp12_ {false};
+    size_t unflushed_ {0};
+    // messages delivered and not acknowledged, on every subscription
+    size_t unacknowledged_ {0};
+    // told how many messages are unacknowledged, if set
+    FlowControlPtr flow_ {};
+    WheelTimer timer_;
+    // flushes when the timer comes due, as that waits for the socket
+    HandOffThreadPtr flusher_ {std::make_shared<HandOffThread>([this](uint64_t generation){ this->expire(generation); })};
+    // keeps batches in order; flushing only
+    std::mutex flushMutex_ {};
+    std::vector<FramePtr> batch_ {};
+  public:
+    AckManager(std::weak_ptr<BaseTransport> transport, AckPolicy policy = {}, TimerWheelPtr wheel = TimerWheel::shared()) :
+      transport_ {std::move(transport)}, policy_ {policy}, timer_ {std::move(wheel)} {}
+    virtual ~AckManager() {
+      flusher_->stop();
+      std::lock_guard<std::mutex> lock {mutex_};
+      timer_.stop();
+    }
+    // Acknowledge a message received on the connection.
+    void ack(const FrameView& message) {
+      auto id = this->ackId(message);
+      if (!id) return;
+      this->acknowledge(this->keyOf(message), *id, false);
+    }
+    void ack(const FramePtr& message) { this->ack(FrameView {message}); }
+    // Acknowledge every message delivered on subscription up to and including the one
+    // with the given ack id (its message-id, or its ack header from STOMP 1.2 on).
+    void ackUpTo(std::string_view subscription, std::string_view id) {
+      this->acknowledge(Key {subscription, false}, id, true);
+    }
+    // Send the acknowledgements waiting, in one write.
+    void flush() {
+      std::lock_guard<std::mutex> flushLock {flushMutex_};
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        timer_.stop();
+        if (unflushed_ == 0) return;
+        unflushed_ = 0;
+        for (auto& [key, subscription] : subscriptions_) {
+          if (subscription->hasLatest) batch_.push_back(this->ackFrame(*subscription, subscription->latest));
+          for (size_t i=0; i<subscription->acked.size(); i++) {
+            batch_.push_back(this->ackFrame(*subscription, subscription->acked[i]));
+          }
+          subscription->acked.clear();
+          subscription->hasLatest = false;
+          subscription->unflushed = 0;
+        }
+      }
+      auto transport = transport_.lock();
+      try {
+        if (transport) transport->transmitBatch(batch_);
+      } catch (...) {
+        batch_.clear();
+        throw;
+      }
+      batch_.clear();
+    }
+    // Messages acknowledged and not flushed yet.
+    size_t getUnflushed() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      return unflushed_;
+    }
+    // Messages delivered on client and client-individual subscriptions and not acknowledged yet.
+    size_t getUnacknowledged() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      return unacknowledged_;
+    }
+    // Keep flow informed of the messages unacknowledged, for its maxUnacked limit.
+    void setFlowControl(FlowControlPtr flow) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      flow_ = std::move(flow);
+      this->countUnacknowledged(0);
+    }
+    virtual void onDelivered(const FrameView& message) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      if (subscriptions_.empty()) return;
+      auto found = subscriptions_.find(this->keyOf(message));
+      if (found == subscriptions_.end() || !found->second->tracked) return;
+      auto id = this->ackId(message);
+      if (!id) return;
+      found->second->delivered.push(*id);
+      this->countUnacknowledged(1);
+    }
+    // Messages are seen through onDelivered(), not copied out for this listener.
+    virtual void onMessage(const FrameView& /*view*/) {}
+    virtual void onSend(FramePtr frame) {
+      FrameType frameType = frame->getType();
+      if (frameType != FrameType::Subscribe && frameType != FrameType::Unsubscribe) return;
+      const Headers& headers = frame->getHeaders();
+      // STOMP 1.0 subscriptions may have no id, and their messages no subscription header
+      bool byDestination = !headers.has(HeaderId::Id);
+      const std::string& id = headers.get(HeaderId::Id);
+      const std::string& destination = headers.get(HeaderId::Destination);
+      std::lock_guard<std::mutex> lock {mutex_};
+      if (frameType == FrameType::Unsubscribe) {
+        if (byDestination) {
+          this->removeDestination(destination);
+        } else {
+          this->remove(Key {id, false});
+        }
+        return;
+      }
+      this->remove(Key {byDestination? destination: id, byDestination});
+      const std::string& mode = headers.get(HeaderId::Ack);
+      if (mode != "client" && mode != "client-individual") return;
+      auto subscription = std::make_unique<Subscription>();
+      subscription->id = id;
+      subscription->destination = destination;
+      subscription->individual = mode == "client-individual";
+      Key key {byDestination? subscription->destination: subscription->id, byDestination};
+      subscriptions_.emplace(key, std::move(subscription));
+    }
+    virtual void onConnected(FramePtr frame) {
+      const std::string& version = frame->getHeaders().get(HEADER_VERSION);
+      stomp11_ = version == "1.1";
+      stomp12_ = version == "1.2";
+    }
+    virtual void onDisconnected() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      timer_.stop();
+      for (auto& [key, subscription] : subscriptions_) {
+        subscription->delivered.clear();
+        subscription->acked.clear();
+        subscription->hasLatest = false;
+        subscription->unflushed = 0;
+      }
+      unflushed_ = 0;
+      unacknowledged_ = 0;
+      this->countUnacknowledged(0);
+    }
+  protected:
+    // The id a message is acknowledged by in the protocol version spoken.
+    std::optional<std::string_view> ackId(const FrameView& message) {
+      return message.getHeader(stomp12_? HEADER_ACK: HEADER_MESSAGE_ID);
+    }
+    // The subscription a message was delivered on.
+    Key keyOf(const FrameView& message) {
+      if (auto subscription = message.getHeader(HEADER_SUBSCRIPTION)) return Key {*subscription, false};
+      return Key {message.getHeader(HEADER_DESTINATION).value_or(""), true};
+    }
+    void acknowledge(Key key, std::string_view id, bool upTo) {
+      bool full {false};
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        auto found = subscriptions_.find(key);
+        if (found == subscriptions_.end()) {
+          auto subscription = std::make_unique<Subscription>();
+          (key.byDestination? subscription->destination: subscription->id) = key.name;
+          subscription->individual = true;
+          subscription->tracked = false;
+          key.name = key.byDestination? subscription->destination: subscription->id;
+          found = subscriptions_.emplace(key, std::move(subscription)).first;
+        }
+        Subscription& subscription = *found->second;
+        size_t index = subscription.delivered.find(id);
+        // acknowledged already, unless it wasn't tracked
+        if (index == std::string::npos && subscription.tracked) return;
+        size_t covered {1};
+        if (!subscription.tracked) {
+          subscription.acked.push(id);
+        } else if (!subscription.individual) {
+          covered = index + 1;
+          subscription.delivered.pop(covered);
+          subscription.latest.assign(id);
+          subscription.hasLatest = true;
+        } else if (upTo) {
+          covered = index + 1;
+          for (size_t i=0; i<covered; i++) subscription.acked.push(subscription.delivered[i]);
+          subscription.delivered.pop(covered);
+        } else {
+          subscription.delivered.erase(index);
+          subscription.acked.push(id);
+        }
+        subscription.unflushed += covered;
+        unflushed_ += covered;
+        if (subscription.tracked) this->countUnacknowledged(-static_cast<ptrdiff_t>(covered));
+        full = unflushed_ >= policy_.maxAcks;
+        if (!full && !timer_.isArmed()) this->arm();
+      }
+      if (full) this->flush();
+    }
+    // With mutex_ held.
+    FramePtr ackFrame(const Subscription& subscription, std::string_view id) {
+      SmallVector<HeaderView,2> headers {};
+      if (stomp12_) {
+        headers.emplace_back(HEADER_ID, id);
+      } else {
+        headers.emplace_back(HEADER_MESSAGE_ID, id);
+        if (stomp11_) headers.emplace_back(HEADER_SUBSCRIPTION, subscription.id);
+      }
+      return FramePool::local()->copy(FRAME_ACK, headers, Payload {});
+    }
+    // With mutex_ held.
+    void remove(Key key) {
+      auto found = subscriptions_.find(key);
+      if (found == subscriptions_.end()) return;
+      unflushed_ -= found->second->unflushed;
+      this->countUnacknowledged(-static_cast<ptrdiff_t>(found->second->delivered.size()));
+      subscriptions_.erase(found);
+    }
+    // With mutex_ held.
+    void removeDestination(std::string_view destination) {
+      for (auto it = subscriptions_.begin(); it != subscriptions_.end();) {
+        if (it->second->destination == destination) {
+          unflushed_ -= it->second->unflushed;
+          this->countUnacknowledged(-static_cast<ptrdiff_t>(it->second->delivered.size()));
+          it = subscriptions_.erase(it);
+        } else {
+          it++;
+        }
+      }
+    }
+    // With mutex_ held.
+    void countUnacknowledged(ptrdiff_t delta) {
+      unacknowledged_ += delta;
+      if (flow_) flow_->setUnacked(unacknowledged_);
+    }
+    // With mutex_ held.
+    void arm() {
+      std::weak_ptr<HandOffThread> flusher {flusher_};
+      timer_.arm(policy_.maxDelay, [flusher](uint64_t generation){
+        if (auto thread = flusher.lock()) thread->handOff(generation);
+      });
+    }
+    // On the flusher thread, when the timer has come due.
+    void expire(uint64_t generation) {
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        if (!timer_.fire(generation)) return;
+      }
+      this->flush();
+    }
+  };
+  using AckManagerPtr = std::shared_ptr<AckManager>;
+}
+
+#endif
@@ -7,39 +7,126 @@
 #include <map>
 #include <memory>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <algorithm>
 
 #include "publisher.h"
 #include "listener.h"
 #include "frame.h"
+#include "frame_view.h"
+#include "frame_parser.h"
+#include "frame_encoder.h"
+#include "outbound_buffer.h"
+#include "bounded_queue.h"
+#include "subscription_table.h"
+#include "interceptor_chain.h"
+#include "receipt_tracker.h"
+#include "flow_control.h"
 
 #define STOMP_BUF_SIZE 1024
-#define STOMP_RECV_BUF_SIZE 2048
+#define STOMP_ASYNC_CAPACITY 4096
+#define STOMP_ASYNC_BURST 64
 
 namespace stomp {
+  struct AsyncPolicy {
+    // Settings for the queue behind transmitAsync().
+    enum class Backpressure {
+      // wait for the writer thread to make room
+      Block,
+      // discard the oldest queued frame
+      DropOldest,
+      // reject the new frame
+      FailFast
+    };
+    size_t capacity {STOMP_ASYNC_CAPACITY};
+    Backpressure backpressure {Backpressure::Block};
+  };
+  // Called on the writer thread with a frame queued by transmitAsync() that could not be
+  // sent, and why.
+  using SendFailureCallback = std::function<void(FramePtr frame, std::exception_ptr error)>;
+
   class BaseTransport : public Publisher {
   protected:
     // recvbuf
-    bool running_ {false};
+    std::atomic<bool> running_ {false};
     // blocking_
-    bool connected_ {false};
-    bool connectionError_ {false};
-    std::map<std::string,std::string> receipts_ {};
+    std::atomic<bool> connected_ {false};
+    std::atomic<bool> connectionError_ {false};
+    ReceiptTracker receipts_ {};
     HostAndPortPtr currentHostAndPort_ {};
     std::optional<std::string> disconnectReceipt_ {};
     bool notifiedOnDisconnect_ {false};
+    // reconnect instead of stopping when the connection is lost
+    std::atomic<bool> autoReconnect_ {false};
+    // set from losing the connection until the session has been replayed on the new one
+    std::atomic<bool> reconnecting_ {false};
+    // transmitMutex_, held by the thread reconnecting from when the new socket is in place
+    // until listeners told CONNECTING have replayed the session, so nothing goes out ahead
+    // of the replay
+    std::unique_lock<std::recursive_mutex> replayLock_ {};
     std::thread createThreadFc_;
     // listenersChangeCondition_
     // receiverThreadExitCondition_
     // receiverThreadExited_
     // sendWaitCondition_
-    // connectWaitCondition_
+    // guards changes to connected_ and connectionError_ for waitForConnection()
+    std::mutex connectMutex_ {};
+    std::condition_variable connectCondition_ {};
     bool autoDecode_ {true};
     std::string encoding_ {};
-    char receiveBuf[STOMP_RECV_BUF_SIZE+1];
-    size_t bufEnd = 0;
+    FrameParser parser_ {};
+    // the parser refused a frame as too large; receiver thread only
+    bool frameRefused_ {false};
+    // frames parsed from the last read, reused from one read to the next; receiver thread only
+    std::vector<FrameView> received_ {};
+    FrameEncoder encoder_ {};
+    // header escaping of the protocol version asked for; what the server accepts applies once connected
+    HeaderEscaping escaping_ {HeaderEscaping::None};
+    FlushPolicy flushPolicy_ {};
+    // serializes transmit() (listener callbacks, encoding and the write) between threads;
+    // recursive, as listeners replaying a session transmit while replayLock_ holds it
+    std::recursive_mutex transmitMutex_ {};
+    // set while the writer thread writes a burst of queued frames, so the transport
+    // buffers them and writes them together
+    bool batching_ {false};
+    AsyncPolicy asyncPolicy_ {};
+    std::unique_ptr<BoundedQueue<FramePtr>> sendQueue_ {};
+    // set once transmitAsync() has been used, so start() brings the writer thread back after stop()
+    std::atomic<bool> writerStarted_ {false};
+    std::thread writer_ {};
+    std::mutex writerMutex_ {};
+    // wakes the writer thread
+    std::condition_variable writerCondition_ {};
+    // wakes producers waiting for room and drain()
+    std::condition_variable spaceCondition_ {};
+    std::atomic<bool> writerRunning_ {false};
+    bool writerBusy_ {false};
+    std::atomic<bool> writerSleeping_ {false};
+    std::atomic<size_t> blockedProducers_ {0};
+    std::atomic<size_t> droppedFrames_ {0};
+    std::atomic<size_t> failedFrames_ {0};
+    SendFailureCallback sendFailure_ {};
+    // frames of the burst being written and the failures among them; writer thread only
+    std::vector<FramePtr> burst_ {};
+    std::vector<std::pair<FramePtr,std::exception_ptr>> failed_ {};
+    SubscriptionTable subscriptions_ {};
+    std::shared_ptr<DeliveryTracker> deliveryTracker_ {};
+    std::shared_ptr<FlowControl> flow_ {};
+    InterceptorChain interceptors_ {};
+    // when data was last received and a frame last sent (steady clock ticks), for heart-beating
+    std::atomic<int64_t> lastReceived_ {std::chrono::steady_clock::now().time_since_epoch().count()};
+    std::atomic<int64_t> lastSent_ {std::chrono::steady_clock::now().time_since_epoch().count()};
   public:
     BaseTransport(bool autoDecode = true, std::string encoding = "utf8") :
       autoDecode_ {autoDecode}, encoding_ {encoding} {}
+    virtual ~BaseTransport() {
+      this->stopWriter();
+    }
     // Override for thread creation. Use an alternate threading library by
     // setting this to a function with a single argument (which is the receiver loop callback).
     // The thread which is returned should be started (ready to run)
@@ -51,97 +138,278 @@ namespace stomp {
     // handshake will occur.
     virtual void start() {
       running_ = true;
+      notifiedOnDisconnect_ = false;
+      if (writerStarted_) this->startWriter();
       this->attemptConnection();
       createThreadFc_ = std::thread([this](){ receiverLoop(); });
-      this->notify(std::make_shared<Frame>(FRAME_CONNECTING, Headers {}, ""));
+      this->notify(FramePool::local()->make(FRAME_CONNECTING));
     }
     // Stop the connection. Performs a clean shutdown by waiting for the
     // receiver thread to exit.
     virtual void stop() {
+      this->stopWriter();
       createThreadFc_.join();
     }
     virtual bool isConnected() { return connected_; }
     virtual bool hasConnectError() { return connectionError_; }
+    // Connect again, with the usual backoff, when the connection is lost rather than stop.
+    // Frames sent in the meantime fail as they would when disconnected.
+    virtual void setAutoReconnect(bool autoReconnect) { autoReconnect_ = autoReconnect; }
+    // Whether the transport is connecting again after losing its connection. Listeners see
+    // this set when they are told CONNECTING for the new connection.
+    virtual bool isReconnecting() { return reconnecting_; }
     virtual void setConnected(bool connected) {
-      // TODO connect wait semaphore
-      connected_ = connected;
+      {
+        std::lock_guard<std::mutex> lock {connectMutex_};
+        connected_ = connected;
+      }
+      connectCondition_.notify_all();
     }
     virtual void setReceipt(std::string receiptId, std::optional<std::string> value) {
       if (value) {
-        receipts_[receiptId] = value.value();
+        receipts_.set(receiptId, value.value());
       } else {
         receipts_.erase(receiptId);
       }
     }
+    // Call callback with the RECEIPT (or ERROR) for receiptId. Waits while the window of
+    // unconfirmed frames is full, so call it before sending the frame and not from a listener.
+    virtual void expectReceipt(std::string receiptId, ReceiptCallback callback) {
+      receipts_.expect(receiptId, std::move(callback));
+    }
+    // A receipt id that is unique on this connection.
+    virtual std::string nextReceiptId() { return receipts_.nextId(); }
+    // Set how many frames sent with expectReceipt() may be unconfirmed at once.
+    virtual void setReceiptWindow(size_t window) { receipts_.setWindow(window); }
+    // Escape headers by the rules of the protocol version the connection asks for (1.1 or
+    // later). Set before connecting: once the server has answered, the rules of the version
+    // in its CONNECTED apply.
+    virtual void setHeaderEscaping(HeaderEscaping escaping) {
+      escaping_ = escaping;
+      encoder_.setEscaping(escaping);
+      parser_.setEscaping(escaping);
+    }
+    // Refuse frames from the server larger than maxFrameSize bytes (0 for no limit). Such a
+    // frame is not buffered: the listeners get an ERROR and the connection is dropped.
+    // Set before connecting.
+    virtual void setMaxFrameSize(size_t maxFrameSize) { parser_.setMaxFrameSize(maxFrameSize); }
+    // The broker connected to, or nullptr.
+    HostAndPortPtr getCurrentHostAndPort() const { return currentHostAndPort_; }
     // Set a named listener to use with this connection.
     virtual void setListener(std::string name, ConnectionListenerPtr listener) {
-      // TODO listener change semaphore
-      listeners_[name] = listener;
+      listeners_.set(name, listener);
     }
     // Remove a listener according to the specified name.
     virtual void removeListener(std::string name) {
-      // TODO listener change semaphore
-      listeners_.erase(name);
+      listeners_.remove(name);
     }
     // Return the named listener.
     virtual ConnectionListenerPtr getListener(std::string name) {
-      return listeners_[name];
+      return listeners_.get(name);
+    }
+    // Hand MESSAGE frames for the subscription id to handler alone, instead of to the listeners.
+    virtual void addSubscription(std::string id, std::string destination, MessageHandler handler) {
+      subscriptions_.add(std::move(id), std::move(destination), std::move(handler));
+    }
+    virtual void removeSubscription(std::string id) {
+      subscriptions_.remove(id);
+    }
+    // Remove the handlers of every subscription to destination.
+    virtual void removeSubscriptions(std::string destination) {
+      subscriptions_.removeDestination(destination);
+    }
+    // Tell tracker of every MESSAGE delivered. Set before start().
+    virtual void setDeliveryTracker(std::shared_ptr<DeliveryTracker> tracker) {
+      deliveryTracker_ = std::move(tracker);
+    }
+    // Hold the receiver back as flow says; see FlowControl. Set before start().
+    virtual void setFlowControl(std::shared_ptr<FlowControl> flow) {
+      flow_ = std::move(flow);
+      if (flow_) flow_->watch(parser_.getPool());
+    }
+    // Add a named interceptor to the end of the chain each MESSAGE goes through before
+    // it is handed on.
+    virtual void addInterceptor(std::string name, MessageInterceptor interceptor) {
+      interceptors_.add(name, std::move(interceptor));
+    }
+    // Run the listener's onBeforeMessage() as an interceptor.
+    virtual void addInterceptor(std::string name, ConnectionListenerPtr listener) {
+      interceptors_.add(name, [listener](const FramePtr& message){ listener->onBeforeMessage(message); });
+    }
+    virtual void removeInterceptor(std::string name) {
+      interceptors_.remove(name);
     }
     virtual void processFrame(FramePtr frame) {
-      std::string frameType = frame->getCmd();
-      if (frameType == FRAME_MESSAGE) {
-        FramePtr beforeFrame = std::make_shared<Frame>(FRAME_BEFORE_MESSAGE, frame->getHeaders(), frame->getBody());
-        this->notify(beforeFrame);
-        frame->setHeaders(beforeFrame->getHeaders());
-        frame->setBody(beforeFrame->getBody());
+      switch (frame->getType()) {
+        case FrameType::Message: {
+          if (!interceptors_.empty()) interceptors_.run(frame);
+          FrameView message {frame};
+          if (deliveryTracker_) deliveryTracker_->onDelivered(message);
+          if (this->route(message)) return;
+          this->notify(frame);
+          break;
+        }
+        case FrameType::Connected:
+        case FrameType::Receipt:
+        case FrameType::Error:
+        case FrameType::Heartbeat:
+          this->notify(frame);
+          break;
+        default:
+          break;
+      }
+    }
+    // Process a frame straight from the receive buffer. Only MESSAGE frames are
+    // passed on as views; anything else is rare enough to go through processFrame(FramePtr).
+    virtual void processFrame(const FrameView& view) {
+      if (view.getType() != FrameType::Message) {
+        this->processFrame(view.toFrame());
+        return;
       }
-      if (frameType == FRAME_MESSAGE || frameType == FRAME_CONNECTED || frameType == FRAME_RECEIPT || frameType == FRAME_ERROR || frameType == FRAME_HEARTBEAT) {
-        this->notify(frame);
+      if (interceptors_.empty()) {
+        this->dispatch(view);
+        return;
       }
-      // TODO call notify
+      // interceptors change the message in place, so it has to be copied out of the receive buffer
+      FramePtr frame = view.toFrame();
+      interceptors_.run(frame);
+      this->dispatch(FrameView {frame});
+    }
+    // Hand a MESSAGE to its subscription handler, or else to the listeners.
+    void dispatch(const FrameView& message) {
+      if (deliveryTracker_) deliveryTracker_->onDelivered(message);
+      if (this->route(message)) return;
+      auto listeners = listeners_.snapshot();
+      for (auto& [name, listener] : *listeners) {
+        listener->notify(message, currentHostAndPort_);
+      }
+    }
+    // Pass a MESSAGE to the handler of its subscription, if it has one.
+    bool route(const FrameView& message) {
+      if (subscriptions_.empty()) return false;
+      auto id = message.getHeader(HEADER_SUBSCRIPTION);
+      if (!id) return false;
+      SubscriptionPtr subscription {subscriptions_.find(*id)};
+      if (!subscription) return false;
+      subscription->handler(message);
+      return true;
     }
     // Utility function for notifying listeners of incoming and outgoing messages.
     virtual void notify(FramePtr frame) {
-      std::string frameType = frame->getCmd();
-      if (frameType == FRAME_RECEIPT) {
+      FrameType frameType = frame->getType();
+      if (frameType == FrameType::Receipt) {
         std::string receipt = frame->getReceiptIdHeader();
-        std::string receiptValue = receipts_[receipt];
-        // TODO use semaphore
-        this->setReceipt(receipt, std::nullopt);
-        if (receiptValue == FRAME_DISCONNECT) {
+        auto receiptValue = receipts_.complete(receipt, frame);
+        if (receiptValue && receiptValue.value() == FRAME_DISCONNECT) {
           this->setConnected(false);
           if (disconnectReceipt_ && receipt == disconnectReceipt_.value()) {
             this->disconnectSocket();
           }
           disconnectReceipt_ = std::nullopt;
         }
-      } else if (frameType == FRAME_CONNECTED) {
+      } else if (frameType == FrameType::Connected) {
+        if (escaping_ != HeaderEscaping::None) this->negotiateEscaping(frame->getHeaders().get(HEADER_VERSION));
         this->setConnected(true);
-      } else if (frameType == FRAME_DISCONNECTED) {
+      } else if (frameType == FrameType::Disconnected) {
         this->setConnected(false);
+        // frames awaiting receipts may yet be confirmed once they are replayed on the new connection
+        if (!reconnecting_) receipts_.failAll();
+      } else if (frameType == FrameType::Error && frame->getHeaders().has(HeaderId::ReceiptId)) {
+        receipts_.complete(frame->getReceiptIdHeader(), frame);
       }
-      for (auto& [name, listener] : listeners_) {
+      auto listeners = listeners_.snapshot();
+      for (auto& [name, listener] : *listeners) {
         listener->notify(frame, currentHostAndPort_);
       }
-      if (frameType == FRAME_ERROR && !connected_) {
-        // TODO use connect semaphore
-        connectionError_ = true;
+      if (frameType == FrameType::Error && !connected_) {
+        {
+          std::lock_guard<std::mutex> lock {connectMutex_};
+          connectionError_ = true;
+        }
+        connectCondition_.notify_all();
       }
     }
     // Convert a frame object to a frame string and transmit to the server.
     virtual void transmit(FramePtr frame) {
-      for (auto& [name, listener] : listeners_) {
-        listener->onSend(frame);
+      this->waitForRoom();
+      std::lock_guard<std::recursive_mutex> lock {transmitMutex_};
+      this->transmitLocked(frame);
+    }
+    // Set the size of the transmitAsync() queue and what happens when it is full. Takes
+    // effect if called before the first transmitAsync().
+    virtual void setAsyncPolicy(AsyncPolicy policy) {
+      asyncPolicy_ = policy;
+    }
+    // Queue a frame to be transmitted by the transport's writer thread, so the caller does
+    // not wait for the socket. Frames queued from one thread are sent in order. Returns
+    // false if the frame was rejected (a full queue with Backpressure::FailFast), or if the
+    // transport has been stopped and not started again.
+    virtual bool transmitAsync(FramePtr frame) {
+      if (!writerStarted_) this->startWriter();
+      if (!writerRunning_) return false;
+      switch (asyncPolicy_.backpressure) {
+        case AsyncPolicy::Backpressure::FailFast:
+          if (!sendQueue_->tryPush(std::move(frame))) return false;
+          break;
+        case AsyncPolicy::Backpressure::DropOldest:
+          while (!sendQueue_->tryPush(std::move(frame))) {
+            FramePtr oldest {};
+            if (sendQueue_->tryPop(oldest)) droppedFrames_++;
+          }
+          break;
+        case AsyncPolicy::Backpressure::Block:
+          while (!sendQueue_->tryPush(std::move(frame))) {
+            std::unique_lock<std::mutex> lock {writerMutex_};
+            blockedProducers_++;
+            writerCondition_.notify_one();
+            spaceCondition_.wait(lock, [this](){
+              return sendQueue_->size() < sendQueue_->capacity() || !writerRunning_;
+            });
+            blockedProducers_--;
+            if (!writerRunning_) return false;
+          }
+          break;
       }
-      if (frame->getCmd() == FRAME_DISCONNECT && frame->hasReceiptHeader()) {
-        disconnectReceipt_ = frame->getReceiptHeader();
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (writerSleeping_) {
+        std::lock_guard<std::mutex> lock {writerMutex_};
+        writerCondition_.notify_one();
       }
-      std::string content {frame->getContents()};
-      this->send(content);
+      return true;
+    }
+    // Wait until every frame queued by transmitAsync() has been written.
+    virtual void drain() {
+      std::unique_lock<std::mutex> lock {writerMutex_};
+      spaceCondition_.wait(lock, [this](){
+        return !writerRunning_ || (sendQueue_->empty() && !writerBusy_);
+      });
+    }
+    // Number of frames discarded by Backpressure::DropOldest.
+    size_t getDroppedFrames() const { return droppedFrames_; }
+    // Number of frames queued by transmitAsync() that could not be sent.
+    size_t getFailedFrames() const { return failedFrames_; }
+    // Call callback with each frame queued by transmitAsync() that could not be sent. A
+    // frame expecting a receipt also has its receipt callback called with nullptr. Set
+    // before the first transmitAsync().
+    virtual void setSendFailureCallback(SendFailureCallback callback) {
+      sendFailure_ = std::move(callback);
     }
-    // Send an encoded frame over this transport (to be implemented in subclasses).
-    virtual void send(std::string content) = 0;
-    // Receive a chunk of data (to be implemented in subclasses).
+    // Set when buffered outbound frames are written to the socket.
+    virtual void setFlushPolicy(FlushPolicy policy) {
+      flushPolicy_ = policy;
+    }
+    FlushPolicy getFlushPolicy() const { return flushPolicy_; }
+    // Write any buffered outbound frames now.
+    virtual void flush() {}
+    // Send an encoded frame over this transport.
+    virtual void send(std::string content) {
+      this->send(content, {});
+    }
+    // Send an encoded frame, given as its head and body, followed by the NUL terminator
+    // (to be implemented in subclasses).
+    virtual void send(std::string_view head, std::string_view body) = 0;
+    // Receive a chunk of data into the region returned by parser_.prepare() and
+    // commit it (to be implemented in subclasses).
     virtual void receive() = 0;
     // Cleanup the transport (to be implemented in subclasses).
     virtual void cleanup() = 0;
@@ -149,61 +417,203 @@ namespace stomp {
     virtual void attemptConnection() = 0;
     // Disconnect the socket.
     virtual void disconnectSocket() = 0;
-    // Wait until we've established a connection with the server.
-    virtual void waitForConnection(double timeout = 0) {
-      // TODO implement timeout
+    // Send a heart-beat (an EOL) now, after whatever is buffered. This runs on the shared
+    // TimerWheel thread, so it must not block: it does nothing if another thread is
+    // writing or the socket takes nothing at once, and the last sent time then tells the
+    // caller to try again. Does nothing unless connected.
+    virtual void sendHeartbeat() {}
+    // Break the connection without closing the socket, e.g. when the server has stopped
+    // heart-beating: the receiving side then finds the connection lost and handles that as
+    // usual, reconnecting if set to.
+    virtual void abortConnection() {}
+    std::chrono::steady_clock::time_point getLastReceived() const {
+      // while flow control holds reads back, the silence is ours and not the server's
+      if (flow_ && flow_->isPaused()) return std::chrono::steady_clock::now();
+      return std::chrono::steady_clock::time_point {std::chrono::steady_clock::duration {lastReceived_.load(std::memory_order_relaxed)}};
+    }
+    std::chrono::steady_clock::time_point getLastSent() const {
+      return std::chrono::steady_clock::time_point {std::chrono::steady_clock::duration {lastSent_.load(std::memory_order_relaxed)}};
+    }
+    // Wait until we've established a connection with the server, or it refused us, or the
+    // connection was lost. timeout is in seconds, 0 to wait without limit. Returns whether
+    // we are connected.
+    virtual bool waitForConnection(double timeout = 0) {
+      std::unique_lock<std::mutex> lock {connectMutex_};
+      auto settled = [this](){ return connected_ || connectionError_ || !running_; };
+      if (timeout > 0) {
+        connectCondition_.wait_for(lock, std::chrono::duration<double>(timeout), settled);
+      } else {
+        connectCondition_.wait(lock, settled);
+      }
+      return connected_;
+    }
+    // Transmit frames together, written out in as few writes as the flush policy allows, e.g.
+    // to restore a session in one round trip.
+    virtual void transmitBatch(const std::vector<FramePtr>& frames) {
+      this->waitForRoom();
+      {
+        std::lock_guard<std::recursive_mutex> lock {transmitMutex_};
+        batching_ = true;
+        try {
+          for (auto& frame : frames) this->transmitLocked(frame);
+        } catch (...) {
+          batching_ = false;
+          throw;
+        }
+        batching_ = false;
+      }
+      this->flush();
+    }
+    // Called before transmitMutex_ is taken, for the transport to hold the sender back
+    // while the server is slow to take what was sent.
+    virtual void waitForRoom() {}
+    // Transmit with transmitMutex_ held.
+    virtual void transmitLocked(FramePtr frame) {
+      auto listeners = listeners_.snapshot();
+      for (auto& [name, listener] : *listeners) {
+        listener->onSend(frame);
+      }
+      FrameType frameType = frame->getType();
+      if (frameType == FrameType::Disconnect && frame->hasReceiptHeader()) {
+        disconnectReceipt_ = frame->getReceiptHeader();
+      }
+      EncodedFrame encoded {encoder_.encode(*frame)};
+      this->send(encoded.head, encoded.body);
+      this->markSent();
+      if (!batching_ && (frameType == FrameType::Connect || frameType == FrameType::Stomp || frameType == FrameType::Disconnect)) {
+        // the server's reply is being waited for, so don't leave these buffered
+        this->flush();
+      }
+    }
+    // Apply the escaping rules of the version the server accepted (1.0 if it didn't say).
+    void negotiateEscaping(const std::string& version) {
+      HeaderEscaping escaping {HeaderEscaping::None};
+      if (version == "1.1") escaping = HeaderEscaping::Stomp11;
+      if (version == "1.2") escaping = HeaderEscaping::Stomp12;
+      escaping = std::min(escaping, escaping_);
+      encoder_.setEscaping(escaping);
+      parser_.setEscaping(escaping);
+    }
+    // Start the writer thread, unless it is running. The queue is kept from one run to the next.
+    void startWriter() {
+      std::lock_guard<std::mutex> lock {writerMutex_};
+      if (writerRunning_ || writer_.joinable()) return;
+      if (!sendQueue_) sendQueue_ = std::make_unique<BoundedQueue<FramePtr>>(asyncPolicy_.capacity);
+      writerRunning_ = writerBusy_ = true;
+      writerStarted_ = true;
+      writer_ = std::thread([this](){ writerLoop(); });
+    }
+    // Stop the writer thread once it has written everything already queued.
+    void stopWriter() {
+      {
+        std::lock_guard<std::mutex> lock {writerMutex_};
+        writerRunning_ = false;
+      }
+      writerCondition_.notify_all();
+      if (writer_.joinable()) writer_.join();
+      spaceCondition_.notify_all();
+    }
+    // Writer thread: takes frames off the queue in bursts and writes each burst together.
+    virtual void writerLoop() {
+      FramePtr frame {};
+      while (true) {
+        if (!sendQueue_->tryPop(frame)) {
+          std::unique_lock<std::mutex> lock {writerMutex_};
+          writerBusy_ = false;
+          spaceCondition_.notify_all();
+          if (!writerRunning_) break;
+          writerSleeping_ = true;
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          writerCondition_.wait_for(lock, std::chrono::milliseconds(10), [this](){
+            return !sendQueue_->empty() || !writerRunning_;
+          });
+          writerSleeping_ = false;
+          writerBusy_ = true;
+          continue;
+        }
+        this->waitForRoom();
+        {
+          std::lock_guard<std::recursive_mutex> lock {transmitMutex_};
+          batching_ = true;
+          size_t count {0};
+          do {
+            try {
+              this->transmitLocked(frame);
+              burst_.push_back(std::move(frame));
+            } catch (std::exception& e) {
+              // the receiver thread will see the broken connection; whoever queued the frame is told
+              failed_.emplace_back(std::move(frame), std::current_exception());
+            }
+          } while (++count < STOMP_ASYNC_BURST && sendQueue_->tryPop(frame));
+          batching_ = false;
+        }
+        frame = nullptr;
+        try {
+          this->flush();
+        } catch (std::exception& e) {
+          // which of the burst reached the socket before it failed is not known
+          auto error = std::current_exception();
+          for (auto& sent : burst_) failed_.emplace_back(std::move(sent), error);
+        }
+        burst_.clear();
+        if (!failed_.empty()) this->reportFailed();
+        // pairs with the producer counting itself blocked before it looks for room
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (blockedProducers_ > 0) {
+          std::lock_guard<std::mutex> lock {writerMutex_};
+          spaceCondition_.notify_all();
+        }
+      }
+    }
+    // Tell whoever queued them that the frames in failed_ could not be sent, on the writer
+    // thread without transmitMutex_ held, so the callbacks may transmit again.
+    void reportFailed() {
+      for (auto& [frame, error] : failed_) {
+        failedFrames_++;
+        if (frame->hasReceiptHeader()) receipts_.complete(frame->getReceiptHeader(), nullptr);
+        if (sendFailure_) sendFailure_(frame, error);
+      }
+      failed_.clear();
     }
     // Main loop listening for incoming data.
     virtual void receiverLoop() {
       while (running_) {
-        std::vector<std::string> frames = this->read();
-        for (auto& content : frames) {
-          FramePtr frame = std::make_shared<Frame>(content);
-          this->processFrame(frame);
+        if (flow_) flow_->waitToRead(parser_.getSlabCapacity(), running_);
+        for (auto& view : this->read()) {
+          this->processFrame(view);
+          // let go of its slab, and of any frame copied from it, as soon as it is handled
+          view = FrameView {};
         }
+        if (frameRefused_) this->refuseFrame();
       }
-      this->notify(std::make_shared<Frame>(FRAME_RECEIVER_LOOP_COMPLETED, Headers {}, ""));
+      this->notify(FramePool::local()->make(FRAME_RECEIVER_LOOP_COMPLETED));
       if (!notifiedOnDisconnect_) {
-        this->notify(std::make_shared<Frame>(FRAME_DISCONNECTED, Headers {}, ""));
+        this->notify(FramePool::local()->make(FRAME_DISCONNECTED));
       }
     }
     // Read the next frame(s) from the socket.
-    virtual std::vector<std::string> read() {
-      std::vector<std::string> frames {};
-      char msgBuf[STOMP_BUF_SIZE+1];
+    virtual std::vector<FrameView>& read() {
+      received_.clear();
       if (running_) {
         this->receive();
-        int bufPos = 0;
-        while (bufPos<bufEnd) {
-          int msgPos = 0;
-          // copy a frame into the message buffer
-          while (bufPos<bufEnd && receiveBuf[bufPos] != 0) {
-            msgBuf[msgPos++] = receiveBuf[bufPos++];
-          }
-          if (bufPos < bufEnd) {
-            // got whole frame
-            msgBuf[msgPos] = 0;
-            std::string frame {msgBuf};
-            frames.push_back(frame);
-            bufPos++;
-            while (bufPos<bufEnd && receiveBuf[bufPos] == '\n') bufPos++;
-            if (bufPos == bufEnd) {
-              // all buffer consumed
-              bufEnd = 0;
-              break;
-            }
-          } else {
-            // incomplete frame?
-            // move to start of buffer and end
-            for (int j=0; j<msgPos; j++) {
-              receiveBuf[j] = msgBuf[j];
-            }
-            bufEnd = msgPos;
-            break;
-          }
-        }
+        this->markReceived();
+        frameRefused_ = !parser_.parse(received_);
       }
-      return frames;
+      return received_;
+    }
+    // After the parser has refused a frame as too large. The rest of the stream can't be
+    // trusted to line up with frame boundaries, so the connection is dropped (and made
+    // again if set to reconnect).
+    void refuseFrame() {
+      frameRefused_ = false;
+      this->notify(FramePool::local()->make(FRAME_ERROR, Headers {{HEADER_MESSAGE, "frame too large"}}));
+      this->abortConnection();
+    }
+    void markReceived() {
+      lastReceived_.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    }
+    void markSent() {
+      lastSent_.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
     }
   };
   using TransportPtr = std::shared_ptr<BaseTransport>;
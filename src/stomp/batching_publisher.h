@@ -0,0 +1,321 @@
+#ifndef STOMP_BATCHING_PUBLISHER_H
+#define STOMP_BATCHING_PUBLISHER_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <optional>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+#include "listener.h"
+#include "base_transport.h"
+#include "frame_pool.h"
+#include "payload.h"
+#include "timer_wheel.h"
+#include "hand_off_thread.h"
+
+// messages that close a batch
+#define STOMP_BATCH_MAX_MESSAGES 256
+// bytes of message bodies that close a batch
+#define STOMP_BATCH_MAX_BYTES (1024 * 1024)
+// microseconds a batch may stay open after its first message
+#define STOMP_BATCH_MAX_DELAY_US 10000
+// times a batch whose commit failed is sent again before it is given up
+#define STOMP_BATCH_MAX_RETRIES 3
+
+namespace stomp {
+  struct BatchPolicy {
+    // When a batch is committed: once it holds maxMessages messages or maxBytes bytes of
+    // bodies, or maxDelay after its first message (rounded up to the timer wheel's tick),
+    // whichever comes first.
+    size_t maxMessages {STOMP_BATCH_MAX_MESSAGES};
+    size_t maxBytes {STOMP_BATCH_MAX_BYTES};
+    std::chrono::microseconds maxDelay {STOMP_BATCH_MAX_DELAY_US};
+    // how many times a failed commit is retried, and how long after an ERROR
+    unsigned maxRetries {STOMP_BATCH_MAX_RETRIES};
+    std::chrono::milliseconds retryDelay {100};
+  };
+
+  // Called with the messages of a batch given up after its retries, and the ERROR for its
+  // last commit, or nullptr if the connection was lost.
+  using BatchFailureCallback = std::function<void(const std::vector<FramePtr>& messages, FramePtr error)>;
+
+  class BatchingPublisher : public ConnectionListener, public std::enable_shared_from_this<BatchingPublisher> {
+    // Publishes in transactions of many messages. Messages are gathered into a batch as they
+    // are sent, and when the batch closes it goes out as BEGIN, its SENDs and a COMMIT with
+    // a receipt, together in one write. A broker persisting messages syncs once per commit
+    // rather than once per message, so durable publishing goes at the rate of batches. If
+    // the commit fails, with an ERROR or because the connection is lost, the broker rolls
+    // the transaction back and the batch is sent again in a new transaction once the
+    // connection is up, so a message may arrive twice if only the receipt was lost, and
+    // a retried batch may arrive after batches closed later. Batches closed while the
+    // connection is down wait for it. Commits in flight count against the connection's
+    // receipt window, which bounds how far publishing runs ahead of the broker. A batch
+    // filled by send() goes out on the sending thread; one closed by its deadline, or
+    // waiting for the connection or a retry, goes out on a sender thread of the
+    // publisher's own, since the wheel's thread serves every connection and must not wait
+    // for the broker.
+  protected:
+    struct Batch {
+      std::vector<FramePtr> messages {};
+      size_t bytes {0};
+      // commits sent for the batch so far
+      unsigned attempts {0};
+    };
+    using BatchPtr = std::unique_ptr<Batch>;
+    std::weak_ptr<BaseTransport> transport_;
+    BatchPolicy policy_;
+    bool autoContentLength_ {true};
+    std::mutex mutex_ {};
+    BatchPtr open_ {};
+    // closed and not sent yet, oldest first
+    std::deque<BatchPtr> closed_ {};
+    // failed and waiting to be sent again
+    std::deque<BatchPtr> retries_ {};
+    // committing, by the receipt asked for with the COMMIT
+    std::unordered_map<std::string,BatchPtr> committing_ {};
+    BatchFailureCallback onFailure_ {};
+    size_t committed_ {0};
+    size_t failed_ {0};
+    WheelTimer timer_;
+    // sends the batches the wheel hands over
+    HandOffThreadPtr sender_ {std::make_shared<HandOffThread>([this](uint64_t generation){ this->expire(generation); })};
+    // keeps batches in order; transmitting only
+    std::mutex transmitMutex_ {};
+    std::vector<FramePtr> frames_ {};
+    std::string transactionPrefix_ {this->generateUuid() + "-"};
+    uint64_t transactions_ {0};
+  public:
+    BatchingPublisher(std::weak_ptr<BaseTransport> transport, BatchPolicy policy = {}, bool autoContentLength = true, TimerWheelPtr wheel = TimerWheel::shared()) :
+      transport_ {std::move(transport)}, policy_ {policy}, autoContentLength_ {autoContentLength}, timer_ {std::move(wheel)} {}
+    // Waits for a commit the sender thread is sending, which may be waiting for room in
+    // the receipt window.
+    virtual ~BatchingPublisher() {
+      sender_->stop();
+      std::lock_guard<std::mutex> lock {mutex_};
+      timer_.stop();
+    }
+    const BatchPolicy& getPolicy() const { return policy_; }
+    // Add a message to the open batch, committing the batch if that fills it.
+    void send(std::string destination, Payload body, std::optional<std::string> contentType = std::nullopt, Headers headers = {}) {
+      headers[HEADER_DESTINATION] = std::move(destination);
+      if (contentType) headers[HEADER_CONTENT_TYPE] = contentType.value();
+      if (autoContentLength_ && headers.count(HEADER_CONTENT_LENGTH) == 0) {
+        headers[HEADER_CONTENT_LENGTH] = std::to_string(body.size());
+      }
+      size_t size {body.size()};
+      FramePtr frame = FramePool::local()->make(FRAME_SEND, std::move(headers), std::move(body));
+      bool full {false};
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        if (!open_) {
+          open_ = std::make_unique<Batch>();
+          open_->messages.reserve(policy_.maxMessages);
+          this->arm();
+        }
+        open_->messages.push_back(std::move(frame));
+        open_->bytes += size;
+        full = open_->messages.size() >= policy_.maxMessages || open_->bytes >= policy_.maxBytes;
+        if (full) this->close();
+      }
+      if (full) this->transmitPending();
+    }
+    // Commit the open batch now, with any batch waiting to be sent.
+    void flush() {
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        this->close();
+      }
+      this->transmitPending();
+    }
+    // Call onFailure with the messages of each batch given up.
+    void setOnFailure(BatchFailureCallback onFailure) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      onFailure_ = std::move(onFailure);
+    }
+    // Messages sent and not committed yet, open, waiting or committing.
+    size_t getPending() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      size_t pending {open_? open_->messages.size(): 0};
+      for (auto& batch : closed_) pending += batch->messages.size();
+      for (auto& batch : retries_) pending += batch->messages.size();
+      for (auto& [receipt, batch] : committing_) pending += batch->messages.size();
+      return pending;
+    }
+    // Messages the broker confirmed committed.
+    size_t getCommitted() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      return committed_;
+    }
+    // Messages given up after their retries.
+    size_t getFailed() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      return failed_;
+    }
+    // Send what waited for the connection.
+    virtual void onConnected(FramePtr /*frame*/) {
+      this->resumeAfter(std::chrono::milliseconds(0));
+    }
+    // Commits in flight will not be confirmed now: send them again on the next connection.
+    virtual void onDisconnected() {
+      std::vector<std::string> receipts {};
+      std::vector<BatchPtr> givenUp {};
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        for (auto& [receipt, batch] : committing_) {
+          receipts.push_back(receipt);
+          if (auto failed = this->fail(std::move(batch))) givenUp.push_back(std::move(failed));
+        }
+        committing_.clear();
+      }
+      // with the transport reconnecting by itself they are still expected
+      if (auto transport = transport_.lock()) {
+        for (auto& receipt : receipts) transport->setReceipt(receipt, std::nullopt);
+      }
+      for (auto& batch : givenUp) this->giveUp(*batch, nullptr);
+    }
+    // Messages are not copied out for this listener.
+    virtual void onMessage(const FrameView& /*view*/) {}
+  protected:
+    // With mutex_ held.
+    void close() {
+      timer_.stop();
+      if (open_) closed_.push_back(std::move(open_));
+    }
+    // Send the batches waiting, retries first, if the connection is up.
+    void transmitPending() {
+      std::lock_guard<std::mutex> transmitLock {transmitMutex_};
+      auto transport = transport_.lock();
+      if (!transport || !transport->isConnected()) return;
+      std::deque<BatchPtr> batches {};
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        batches.swap(retries_);
+        for (auto& batch : closed_) batches.push_back(std::move(batch));
+        closed_.clear();
+      }
+      while (!batches.empty()) {
+        BatchPtr batch {std::move(batches.front())};
+        batches.pop_front();
+        try {
+          this->transmit(*transport, std::move(batch));
+        } catch (...) {
+          std::lock_guard<std::mutex> lock {mutex_};
+          for (auto& rest : batches) retries_.push_back(std::move(rest));
+          throw;
+        }
+      }
+    }
+    // Send batch in a transaction of its own, with transmitMutex_ held.
+    void transmit(BaseTransport& transport, BatchPtr batch) {
+      std::string transaction {transactionPrefix_ + std::to_string(++transactions_)};
+      std::string receipt {transport.nextReceiptId()};
+      batch->attempts++;
+      frames_.clear();
+      frames_.push_back(FramePool::local()->make(FRAME_BEGIN, Headers {{HEADER_TRANSACTION, transaction}}));
+      for (auto& message : batch->messages) {
+        message->setHeader(HEADER_TRANSACTION, transaction);
+        frames_.push_back(message);
+      }
+      frames_.push_back(FramePool::local()->make(FRAME_COMMIT, Headers {{HEADER_TRANSACTION, transaction}, {HEADER_RECEIPT, receipt}}));
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        committing_.emplace(receipt, std::move(batch));
+      }
+      std::weak_ptr<BatchingPublisher> self {this->weak_from_this()};
+      transport.expectReceipt(receipt, [self, receipt](FramePtr frame){
+        if (auto publisher = self.lock()) publisher->settle(receipt, frame);
+      });
+      try {
+        transport.transmitBatch(frames_);
+      } catch (...) {
+        frames_.clear();
+        transport.setReceipt(receipt, std::nullopt);
+        BatchPtr failed {};
+        {
+          std::lock_guard<std::mutex> lock {mutex_};
+          auto found = committing_.find(receipt);
+          if (found != committing_.end()) {
+            failed = this->fail(std::move(found->second));
+            committing_.erase(found);
+          }
+        }
+        if (failed) this->giveUp(*failed, nullptr);
+        throw;
+      }
+      frames_.clear();
+    }
+    // On the receiving thread, with the RECEIPT or ERROR for a commit, or nullptr if the
+    // connection was lost.
+    void settle(const std::string& receipt, FramePtr frame) {
+      BatchPtr givenUp {};
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        auto found = committing_.find(receipt);
+        if (found == committing_.end()) return;
+        BatchPtr batch {std::move(found->second)};
+        committing_.erase(found);
+        if (frame && frame->getType() == FrameType::Receipt) {
+          committed_ += batch->messages.size();
+          return;
+        }
+        givenUp = this->fail(std::move(batch));
+      }
+      if (givenUp) {
+        this->giveUp(*givenUp, frame);
+      } else if (frame) {
+        // the connection may still be up; if not, it is retried on the next one
+        this->resumeAfter(policy_.retryDelay);
+      }
+    }
+    // With mutex_ held. Queue batch to be sent again, or return it if it has run out of retries.
+    BatchPtr fail(BatchPtr batch) {
+      if (batch->attempts > policy_.maxRetries) {
+        failed_ += batch->messages.size();
+        return batch;
+      }
+      retries_.push_back(std::move(batch));
+      return nullptr;
+    }
+    void giveUp(const Batch& batch, FramePtr error) {
+      BatchFailureCallback onFailure {};
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        onFailure = onFailure_;
+      }
+      if (onFailure) onFailure(batch.messages, error);
+    }
+    // Have the sender thread send what is waiting after delay, since waiting for room in
+    // the receipt window on the receiving thread would never end.
+    void resumeAfter(TimerWheel::Clock::duration delay) {
+      std::weak_ptr<HandOffThread> sender {sender_};
+      timer_.getWheel()->schedule(delay, [sender](){
+        if (auto thread = sender.lock()) thread->handOff();
+      });
+    }
+    // With mutex_ held.
+    void arm() {
+      std::weak_ptr<HandOffThread> sender {sender_};
+      timer_.arm(policy_.maxDelay, [sender](uint64_t generation){
+        if (auto thread = sender.lock()) thread->handOff(generation);
+      });
+    }
+    // On the sender thread: close the open batch if its timer has come due, then send
+    // what is waiting.
+    void expire(uint64_t generation) {
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        if (timer_.fire(generation) && open_) closed_.push_back(std::move(open_));
+      }
+      this->transmitPending();
+    }
+  };
+  using BatchingPublisherPtr = std::shared_ptr<BatchingPublisher>;
+}
+
+#endif
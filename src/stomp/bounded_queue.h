@@ -0,0 +1,89 @@
+#ifndef STOMP_BOUNDED_QUEUE_H
+#define STOMP_BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace stomp {
+  template <typename T>
+  class BoundedQueue {
+    // Fixed-capacity lock-free ring (D. Vyukov's bounded queue). Any number of threads may
+    // push; the transport's writer thread is the regular consumer, but pops from other
+    // threads are safe too, which is what lets a producer drop the oldest entry when the
+    // ring is full. Each cell carries a sequence number saying whether it is ready to be
+    // written or read, so push and pop each cost one CAS in the uncontended case.
+  protected:
+    struct Cell {
+      std::atomic<size_t> sequence;
+      T value;
+    };
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> enqueuePos_ {0};
+    alignas(64) std::atomic<size_t> dequeuePos_ {0};
+  public:
+    // capacity is rounded up to a power of two
+    BoundedQueue(size_t capacity) {
+      size_t size = 2;
+      while (size < capacity) size <<= 1;
+      cells_.reset(new Cell[size]);
+      mask_ = size - 1;
+      for (size_t i=0; i<size; i++) cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+    size_t capacity() const { return mask_ + 1; }
+    // Approximate number of queued entries.
+    size_t size() const {
+      size_t enqueued = enqueuePos_.load(std::memory_order_relaxed);
+      size_t dequeued = dequeuePos_.load(std::memory_order_relaxed);
+      return enqueued > dequeued? enqueued - dequeued: 0;
+    }
+    bool empty() const { return this->size() == 0; }
+    // Append value, unless the queue is full. value is only moved from on success.
+    bool tryPush(T&& value) {
+      Cell* cell;
+      size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+      for (;;) {
+        cell = &cells_[pos & mask_];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+          if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = enqueuePos_.load(std::memory_order_relaxed);
+        }
+      }
+      cell->value = std::move(value);
+      cell->sequence.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+    // Take the oldest entry, if any.
+    bool tryPop(T& value) {
+      Cell* cell;
+      size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+      for (;;) {
+        cell = &cells_[pos & mask_];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+        if (diff == 0) {
+          if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+          return false;
+        } else {
+          pos = dequeuePos_.load(std::memory_order_relaxed);
+        }
+      }
+      value = std::move(cell->value);
+      cell->value = T {};
+      cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+      return true;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef STOMP_BUFFER_H
+#define STOMP_BUFFER_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <functional>
+
+#define STOMP_SLAB_SIZE 65536
+#define STOMP_POOL_MAX_FREE 16
+
+namespace stomp {
+  class Slab {
+    // A fixed-size block of receive buffer. Slabs are shared (by reference count) between
+    // the frame parser and any FrameView that still points into them.
+  protected:
+    std::unique_ptr<char[]> data_;
+    size_t capacity_;
+  public:
+    Slab(size_t capacity) : data_ {new char[capacity]}, capacity_ {capacity} {}
+    char* data() { return data_.get(); }
+    const char* data() const { return data_.get(); }
+    size_t capacity() const { return capacity_; }
+  };
+  using SlabPtr = std::shared_ptr<Slab>;
+
+  class BufferPool : public std::enable_shared_from_this<BufferPool> {
+    // A free list of equally sized slabs. A slab goes back to the pool when its last
+    // reference is dropped, so a steady stream of frames keeps reusing the same memory.
+    // The pool counts the bytes of the slabs handed out and not released yet, which is
+    // the receive memory still held by the parser and by frames the application keeps.
+  protected:
+    size_t slabSize_;
+    size_t maxFree_;
+    std::mutex mutex_ {};
+    std::vector<std::unique_ptr<Slab>> free_ {};
+    std::atomic<size_t> outstanding_ {0};
+    std::function<void()> onRelease_ {};
+  public:
+    BufferPool(size_t slabSize = STOMP_SLAB_SIZE, size_t maxFree = STOMP_POOL_MAX_FREE) :
+      slabSize_ {slabSize}, maxFree_ {maxFree} {}
+    size_t getSlabSize() const { return slabSize_; }
+    // Bytes in slabs handed out and not released yet.
+    size_t getOutstanding() const { return outstanding_.load(); }
+    // Call onRelease, on whichever thread drops the last reference, each time a slab is
+    // released. Set before the pool is used.
+    void setOnRelease(std::function<void()> onRelease) { onRelease_ = std::move(onRelease); }
+    // Get a slab of at least minCapacity bytes. Requests larger than the pool's slab size
+    // get a dedicated slab which is freed rather than pooled.
+    SlabPtr acquire(size_t minCapacity = 0) {
+      std::unique_ptr<Slab> slab {};
+      if (minCapacity > slabSize_) {
+        slab = std::make_unique<Slab>(minCapacity);
+      } else {
+        std::lock_guard<std::mutex> lock {mutex_};
+        if (!free_.empty()) {
+          slab = std::move(free_.back());
+          free_.pop_back();
+        }
+      }
+      if (!slab) slab = std::make_unique<Slab>(slabSize_);
+      outstanding_.fetch_add(slab->capacity());
+      std::weak_ptr<BufferPool> pool {this->shared_from_this()};
+      return SlabPtr {slab.release(), [pool](Slab* released) {
+        if (auto owner = pool.lock()) {
+          owner->recycle(released);
+        } else {
+          delete released;
+        }
+      }};
+    }
+  protected:
+    void recycle(Slab* slab) {
+      std::unique_ptr<Slab> owned {slab};
+      outstanding_.fetch_sub(owned->capacity());
+      if (owned->capacity() == slabSize_) {
+        std::lock_guard<std::mutex> lock {mutex_};
+        if (free_.size() < maxFree_) free_.push_back(std::move(owned));
+      }
+      if (onRelease_) onRelease_();
+    }
+  };
+  using BufferPoolPtr = std::shared_ptr<BufferPool>;
+}
+
+#endif
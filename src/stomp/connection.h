@@ -2,16 +2,29 @@
 #define STOMP_CONNECTION_H
 
 #include <memory>
+#include <chrono>
+#include <stdexcept>
 
 #include "publisher.h"
 #include "base_transport.h"
+#include "heartbeat_listener.h"
+#include "session_recovery.h"
+#include "ack_manager.h"
+#include "flow_control.h"
+#include "batching_publisher.h"
 
 namespace stomp {
   class BaseConnection : public Publisher {
   protected:
     TransportPtr transport_;
+    AckManagerPtr acks_ {};
+    FlowControlPtr flow_ {};
+    BatchingPublisherPtr batching_ {};
+    // whether batched messages get a content-length header
+    bool batchContentLength_ {true};
   public:
-    BaseConnection(TransportPtr transport) : transport_ {transport} {}
+    BaseConnection(TransportPtr transport, bool autoContentLength = true) :
+      transport_ {transport}, batchContentLength_ {autoContentLength} {}
     virtual void setListener(std::string name, ConnectionListenerPtr listener) {
       transport_->setListener(name, listener);
     }
@@ -21,10 +34,90 @@ namespace stomp {
     virtual ConnectionListenerPtr getListener(std::string name) {
       return transport_->getListener(name);
     }
+    // Add a named interceptor for incoming MESSAGE frames; see BaseTransport::addInterceptor().
+    virtual void addInterceptor(std::string name, MessageInterceptor interceptor) {
+      transport_->addInterceptor(name, std::move(interceptor));
+    }
+    virtual void addInterceptor(std::string name, ConnectionListenerPtr listener) {
+      transport_->addInterceptor(name, listener);
+    }
+    virtual void removeInterceptor(std::string name) {
+      transport_->removeInterceptor(name);
+    }
+    // Reconnect by itself when the connection is lost, and restore the session on the new
+    // connection: CONNECT, the active subscriptions and the sends whose receipts have not
+    // arrived go out again in one batch. Set before connect(); the session is recorded from then on.
+    virtual void setAutoReconnect(bool autoReconnect) {
+      transport_->setAutoReconnect(autoReconnect);
+      if (autoReconnect) {
+        transport_->setListener("session-recovery", std::make_shared<SessionRecovery>(transport_));
+      } else {
+        transport_->removeListener("session-recovery");
+      }
+    }
+    // Acknowledge messages through an AckManager, returned to acknowledge them with, which
+    // sends ACK frames in batches as policy says. Set before connect().
+    virtual AckManagerPtr setAckPolicy(AckPolicy policy = {}) {
+      acks_ = std::make_shared<AckManager>(transport_, policy);
+      transport_->setListener("acks", acks_);
+      transport_->setDeliveryTracker(acks_);
+      if (flow_) acks_->setFlowControl(flow_);
+      return acks_;
+    }
+    virtual AckManagerPtr getAckManager() { return acks_; }
+    // Limit how far the application may fall behind the broker: the prefetch asked for
+    // each subscription, and the unacknowledged messages and held receive buffer at which
+    // the connection stops reading until the application catches up. Set before connect().
+    virtual FlowControlPtr setFlowPolicy(FlowPolicy policy) {
+      flow_ = std::make_shared<FlowControl>(std::move(policy));
+      transport_->setListener("flow-control", flow_);
+      transport_->setFlowControl(flow_);
+      if (acks_) acks_->setFlowControl(flow_);
+      return flow_;
+    }
+    // Publish through a BatchingPublisher, returned to send with, which groups messages
+    // into transactions committed as policy says. Set before connect(). Setting it again
+    // commits what the publisher replaced holds first, which can't be done while the
+    // connection is down; commits it already has in flight are not retried.
+    virtual BatchingPublisherPtr setBatchPolicy(BatchPolicy policy = {}) {
+      if (batching_) {
+        if (!transport_->isConnected() && batching_->getPending() > 0) {
+          throw std::logic_error("batched messages are waiting for the connection");
+        }
+        batching_->flush();
+      }
+      batching_ = std::make_shared<BatchingPublisher>(transport_, policy, batchContentLength_);
+      transport_->setListener("batching-publisher", batching_);
+      return batching_;
+    }
+    virtual BatchingPublisherPtr getBatchingPublisher() { return batching_; }
     virtual bool isConnected() { return transport_->isConnected(); }
+    // Wait (up to timeout seconds, 0 for no limit) for the server to accept the connection.
+    virtual bool waitForConnection(double timeout = 0) { return transport_->waitForConnection(timeout); }
+    // Set when buffered outbound frames are written to the socket.
+    virtual void setFlushPolicy(FlushPolicy policy) { transport_->setFlushPolicy(policy); }
+    // Write any buffered outbound frames now.
+    virtual void flush() { transport_->flush(); }
+    // Set the size of the sendAsync() queue and what happens when it is full.
+    virtual void setAsyncPolicy(AsyncPolicy policy) { transport_->setAsyncPolicy(policy); }
     virtual void setReceipt(std::string receiptId, std::optional<std::string> value) {
       transport_->setReceipt(receiptId, value);
     }
+    // Refuse frames from the server larger than maxFrameSize bytes (0 for no limit).
+    virtual void setMaxFrameSize(size_t maxFrameSize) { transport_->setMaxFrameSize(maxFrameSize); }
+    // Set how many sends waiting for a receipt may be outstanding at once.
+    virtual void setReceiptWindow(size_t window) { transport_->setReceiptWindow(window); }
+    // Heart-beat with the server: offer to send one every send and ask for one every
+    // receive (0 for none). Set before connect(). If the server goes quiet for longer
+    // than agreed, the listeners are told HEARTBEAT_TIMEOUT and the connection is dropped,
+    // to be made again if the transport reconnects by itself.
+    virtual void setHeartbeats(std::chrono::milliseconds send, std::chrono::milliseconds receive) {
+      if (send.count() == 0 && receive.count() == 0) {
+        transport_->removeListener("heartbeats");
+        return;
+      }
+      transport_->setListener("heartbeats", std::make_shared<HeartbeatListener>(transport_, send, receive));
+    }
   };
   using ConnectionPtr = std::shared_ptr<BaseConnection>;
 }
@@ -12,12 +12,18 @@ namespace stomp {
   protected:
   public:
     Connection10(HostsAndPorts hostsAndPorts = {}, bool autoDecode = true, std::string encoding = "utf8", bool autoContentLength = true) :
-      BaseConnection {std::make_shared<Transport>(hostsAndPorts, autoDecode, encoding)}, Protocol10 {BaseConnection::transport_, autoContentLength} {}
+      BaseConnection {std::make_shared<Transport>(hostsAndPorts, autoDecode, encoding), autoContentLength}, Protocol10 {BaseConnection::transport_, autoContentLength} {}
+    // Use the given transport, e.g. an EpollTransport sharing an EventLoop with other connections.
+    Connection10(TransportPtr transport, bool autoContentLength = true) :
+      BaseConnection {transport, autoContentLength}, Protocol10 {BaseConnection::transport_, autoContentLength} {}
     void connect() {
       BaseConnection::transport_->start();
       Protocol10::connect();
     }
     void disconnect() {
+      // acknowledgements and messages waiting in a batch go out first
+      if (acks_) acks_->flush();
+      if (batching_) batching_->flush();
       Protocol10::disconnect();
       BaseConnection::transport_->stop();
     }
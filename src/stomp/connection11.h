@@ -0,0 +1,34 @@
+#ifndef STOMP_CONNECTION_11_H
+#define STOMP_CONNECTION_11_H
+
+#include <memory>
+
+#include "connection.h"
+#include "protocol11.h"
+#include "transport.h"
+
+namespace stomp {
+  class Connection11 : public BaseConnection, public Protocol11 {
+  protected:
+  public:
+    Connection11(HostsAndPorts hostsAndPorts = {}, bool autoDecode = true, std::string encoding = "utf8", bool autoContentLength = true) :
+      BaseConnection {std::make_shared<Transport>(hostsAndPorts, autoDecode, encoding), autoContentLength}, Protocol11 {BaseConnection::transport_, autoContentLength} {}
+    // Use the given transport, e.g. an EpollTransport sharing an EventLoop with other connections.
+    Connection11(TransportPtr transport, bool autoContentLength = true) :
+      BaseConnection {transport, autoContentLength}, Protocol11 {BaseConnection::transport_, autoContentLength} {}
+    void connect() {
+      BaseConnection::transport_->start();
+      Protocol11::connect();
+    }
+    void disconnect() {
+      // acknowledgements and messages waiting in a batch go out first
+      if (acks_) acks_->flush();
+      if (batching_) batching_->flush();
+      Protocol11::disconnect();
+      BaseConnection::transport_->stop();
+    }
+  };
+  using Connection11Ptr = std::shared_ptr<Connection11>;
+}
+
+#endif
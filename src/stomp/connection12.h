@@ -0,0 +1,34 @@
+#ifndef STOMP_CONNECTION_12_H
+#define STOMP_CONNECTION_12_H
+
+#include <memory>
+
+#include "connection.h"
+#include "protocol12.h"
+#include "transport.h"
+
+namespace stomp {
+  class Connection12 : public BaseConnection, public Protocol12 {
+  protected:
+  public:
+    Connection12(HostsAndPorts hostsAndPorts = {}, bool autoDecode = true, std::string encoding = "utf8", bool autoContentLength = true) :
+      BaseConnection {std::make_shared<Transport>(hostsAndPorts, autoDecode, encoding), autoContentLength}, Protocol12 {BaseConnection::transport_, autoContentLength} {}
+    // Use the given transport, e.g. an EpollTransport sharing an EventLoop with other connections.
+    Connection12(TransportPtr transport, bool autoContentLength = true) :
+      BaseConnection {transport, autoContentLength}, Protocol12 {BaseConnection::transport_, autoContentLength} {}
+    void connect() {
+      BaseConnection::transport_->start();
+      Protocol12::connect();
+    }
+    void disconnect() {
+      // acknowledgements and messages waiting in a batch go out first
+      if (acks_) acks_->flush();
+      if (batching_) batching_->flush();
+      Protocol12::disconnect();
+      BaseConnection::transport_->stop();
+    }
+  };
+  using Connection12Ptr = std::shared_ptr<Connection12>;
+}
+
+#endif
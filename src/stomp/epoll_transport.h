@@ -0,0 +1,459 @@
+#ifndef STOMP_EPOLL_TRANSPORT_H
+#define STOMP_EPOLL_TRANSPORT_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <climits>
+#include <algorithm>
+
+#include <sys/epoll.h>
+#include <sys/uio.h>
+
+#include "transport.h"
+#include "event_loop.h"
+
+// reads per readiness event before other connections on the loop get a turn
+#define STOMP_LOOP_READS 16
+// bytes a slow peer may leave unwritten before senders off the loop thread wait for it
+#define STOMP_LOOP_MAX_OUTBOUND (4 << 20)
+
+namespace stomp {
+  class EpollTransport : public Transport {
+    // A transport driven by an EventLoop instead of a receiver thread of its own, so many
+    // connections can share one thread. The socket is non-blocking: the loop reads and
+    // dispatches frames as data arrives, and whatever a send cannot write straight away
+    // stays in the outbound buffer until the loop sees the socket writable. Connecting is
+    // non-blocking too, one address at a time on the loop. Listeners are called on the
+    // loop thread and must not block.
+  protected:
+    EventLoopPtr loop_;
+    // the connection's socket, or the one still connecting
+    std::atomic<int> descriptor_ {-1};
+    // frames sent before the first connection is made are kept for it; guarded by sendMutex_
+    bool awaitingSocket_ {false};
+    // set while STOMP_LOOP_MAX_OUTBOUND bytes are unwritten, and changed with sendMutex_ held
+    std::atomic<bool> outboundFull_ {false};
+    // wakes senders waiting for a slow peer to take what is buffered
+    std::condition_variable roomCondition_ {};
+    // the round of connection attempts under way; loop thread only
+    Candidates candidates_ {};
+    size_t nextCandidate_ {0};
+    SocketPtr connecting_ {};
+    HostAndPortPtr connectingTo_ {};
+    int connectCount_ {0};
+    int sleepExp_ {1};
+    // timeout of the attempt under way, or the wait before the next round; guarded by sendMutex_
+    uint64_t connectTimer_ {0};
+    // EPOLLOUT is being watched for; guarded by sendMutex_
+    bool writeWanted_ {false};
+    // EPOLLIN is not watched for while flow control holds reading back; guarded by sendMutex_
+    bool readPaused_ {false};
+    // pending flush deadline timer; guarded by sendMutex_
+    uint64_t flushTimer_ {0};
+    std::mutex stateMutex_ {};
+    std::condition_variable detachedCondition_ {};
+    bool attached_ {false};
+  public:
+    EpollTransport(EventLoopPtr loop, HostsAndPorts hostsAndPorts = {}, bool autoDecode = true, std::string encoding = "utf8") :
+      Transport {hostsAndPorts, autoDecode, encoding}, loop_ {loop} {}
+    virtual ~EpollTransport() {
+      this->stopWriter();
+      this->detach();
+    }
+    // Have the loop connect, without waiting for it. Frames sent meanwhile go out once
+    // connected; listeners are told CONNECTING then, or DISCONNECTED if no broker could be
+    // reached. Does not start the loop.
+    virtual void start() {
+      running_ = true;
+      notifiedOnDisconnect_ = false;
+      if (writerStarted_) this->startWriter();
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        awaitingSocket_ = true;
+      }
+      {
+        std::lock_guard<std::mutex> lock {stateMutex_};
+        attached_ = true;
+      }
+      if (flow_) {
+        flow_->setOnResume([this](){
+          loop_->post([this](){ this->pauseReading(false); });
+        });
+      }
+      connectCount_ = 0;
+      sleepExp_ = 1;
+      loop_->post([this](){ this->connectRound(); });
+    }
+    // Wait for the connection to close (after the receipt for DISCONNECT), as
+    // Transport::stop() waits for its receiver thread. From the loop thread itself this
+    // returns straight away and the loop finishes the shutdown.
+    virtual void stop() {
+      this->stopWriter();
+      if (loop_->inLoopThread()) return;
+      std::unique_lock<std::mutex> lock {stateMutex_};
+      detachedCondition_.wait(lock, [this](){ return !attached_; });
+    }
+    virtual void disconnectSocket() {
+      running_ = false;
+      this->detach();
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        socket = nullptr;
+        awaitingSocket_ = false;
+        outbound_.clear();
+        this->checkRoom();
+        writeWanted_ = false;
+        readPaused_ = false;
+      }
+      currentHostAndPort_ = nullptr;
+      if (!notifiedOnDisconnect_) {
+        notifiedOnDisconnect_ = true;
+        this->notify(FramePool::local()->make(FRAME_DISCONNECTED));
+      }
+      auto finish = [this](){
+        this->notify(FramePool::local()->make(FRAME_RECEIVER_LOOP_COMPLETED));
+        std::lock_guard<std::mutex> lock {stateMutex_};
+        attached_ = false;
+        detachedCondition_.notify_all();
+      };
+      // stop() may destroy the transport as soon as it is released, so on the loop thread
+      // release it only after the callback that got here has returned
+      if (loop_->inLoopThread()) {
+        loop_->post(finish);
+      } else {
+        finish();
+      }
+    }
+    // The deadline flush runs on the loop as a timer rather than on a flusher thread.
+    virtual void setFlushPolicy(FlushPolicy policy) {
+      this->flush();
+      std::lock_guard<std::mutex> lock {sendMutex_};
+      flushPolicy_ = policy;
+    }
+    using Transport::send;
+    virtual void send(std::string_view head, std::string_view body) {
+      std::lock_guard<std::mutex> lock {sendMutex_};
+      if (!socket && awaitingSocket_) {
+        outbound_.append(head, body);
+        return;
+      }
+      this->sendLocked(head, body);
+    }
+    // Wait while a slow peer has left STOMP_LOOP_MAX_OUTBOUND bytes unwritten. The loop
+    // thread can't wait for itself to write, so only its own frames go past the limit.
+    virtual void waitForRoom() {
+      if (!outboundFull_ || loop_->inLoopThread()) return;
+      std::unique_lock<std::mutex> lock {sendMutex_};
+      roomCondition_.wait(lock, [this](){ return !outboundFull_ || !socket; });
+    }
+    virtual void cleanup() {
+      this->detach();
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        socket = nullptr;
+      }
+      roomCondition_.notify_all();
+    }
+    EventLoopPtr getEventLoop() const { return loop_; }
+  protected:
+    // Start a round of connection attempts, one address after another. On the loop thread.
+    void connectRound() {
+      if (!running_) return;
+      candidates_ = this->resolveCandidates();
+      nextCandidate_ = 0;
+      this->connectNext();
+    }
+    // Start connecting to the next address of the round. Once the round has failed, wait as
+    // attemptConnection() does before the next, or give up after the last.
+    void connectNext() {
+      while (running_ && nextCandidate_ < candidates_.size()) {
+        auto [address, hostAndPort] = candidates_[nextCandidate_++];
+        SocketPtr candidate {};
+        bool connected {false};
+        try {
+          candidate = std::make_shared<TCPSocket>(address);
+          connected = candidate->startConnect(address);
+        } catch (SocketException& e) {
+          // refused straight away: go on to the next address
+          continue;
+        }
+        connecting_ = candidate;
+        connectingTo_ = hostAndPort;
+        descriptor_ = candidate->getDescriptor();
+        loop_->add(descriptor_, EPOLLOUT, [this](uint32_t events){ onEvents(events); });
+        if (connected) {
+          this->established();
+          return;
+        }
+        auto timeout = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::duration<double>(connectTimeout_));
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        connectTimer_ = loop_->schedule(timeout, [this](){
+          {
+            std::lock_guard<std::mutex> lock {sendMutex_};
+            connectTimer_ = 0;
+          }
+          this->abandonAttempt();
+        });
+        return;
+      }
+      if (!running_) return;
+      connectCount_ += static_cast<int>(hostsAndPorts_.size());
+      if (connectCount_ < reconnectAttemptsMax_ || reconnectAttemptsMax_ == -1) {
+        auto delay = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::duration<double>(this->reconnectDelay(sleepExp_)));
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        connectTimer_ = loop_->schedule(delay, [this](){
+          {
+            std::lock_guard<std::mutex> lock {sendMutex_};
+            connectTimer_ = 0;
+          }
+          this->connectRound();
+        });
+        return;
+      }
+      if (reconnecting_) {
+        // the listeners were told DISCONNECTED when the connection was lost
+        reconnecting_ = false;
+        notifiedOnDisconnect_ = true;
+        receipts_.failAll();
+      }
+      this->disconnectSocket();
+    }
+    // The socket connecting is writable: it has connected, or failed to.
+    void onConnectable() {
+      try {
+        connecting_->finishConnect();
+      } catch (SocketException& e) {
+        this->abandonAttempt();
+        return;
+      }
+      this->established();
+    }
+    // Give up on the attempt under way (failed or timed out) and go on to the next address.
+    void abandonAttempt() {
+      if (!connecting_) return;
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        if (connectTimer_ != 0) loop_->cancel(connectTimer_);
+        connectTimer_ = 0;
+      }
+      int descriptor = descriptor_.exchange(-1);
+      if (descriptor >= 0) loop_->remove(descriptor);
+      connecting_ = nullptr;
+      this->connectNext();
+    }
+    // The attempt under way has connected: read from it, write out what was sent meanwhile
+    // and tell the listeners.
+    void established() {
+      // on a reconnect, nothing goes out on the new socket ahead of the session replayed on it
+      if (reconnecting_) replayLock_ = std::unique_lock<std::recursive_mutex> {transmitMutex_};
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        if (connectTimer_ != 0) loop_->cancel(connectTimer_);
+        connectTimer_ = 0;
+        socket = connecting_;
+        currentHostAndPort_ = connectingTo_;
+        awaitingSocket_ = false;
+        this->watch();
+        if (!outbound_.empty()) this->writePending();
+      }
+      connecting_ = nullptr;
+      this->notify(FramePool::local()->make(FRAME_CONNECTING));
+      if (replayLock_) replayLock_.unlock();
+      reconnecting_ = false;
+    }
+    // Connect again, as Transport::reconnect() does, without waiting for it: the loop goes
+    // on with other connections meanwhile. On the loop thread.
+    virtual void reconnect() {
+      reconnecting_ = true;
+      int descriptor;
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        if (flushTimer_ != 0) loop_->cancel(flushTimer_);
+        flushTimer_ = 0;
+        descriptor = descriptor_.exchange(-1);
+        socket = nullptr;
+        outbound_.clear();
+        this->checkRoom();
+        writeWanted_ = false;
+        readPaused_ = false;
+      }
+      if (descriptor >= 0) loop_->remove(descriptor);
+      currentHostAndPort_ = nullptr;
+      // whatever was half received belongs to the old connection
+      parser_.reset();
+      this->notify(FramePool::local()->make(FRAME_DISCONNECTED));
+      connectCount_ = 0;
+      sleepExp_ = 1;
+      this->connectRound();
+    }
+    // Stop watching the socket. Off the loop thread this waits for a running callback to return.
+    void detach() {
+      // a resume posted before this still runs ahead of the loop letting go of the transport
+      if (flow_) flow_->setOnResume(nullptr);
+      int descriptor;
+      {
+        // taken with sendMutex_ held so watch() never modifies a descriptor removed (and
+        // perhaps reused) since; removed without it, as remove() waits for onEvents() to return
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        if (flushTimer_ != 0) loop_->cancel(flushTimer_);
+        if (connectTimer_ != 0) loop_->cancel(connectTimer_);
+        flushTimer_ = connectTimer_ = 0;
+        descriptor = descriptor_.exchange(-1);
+      }
+      if (descriptor >= 0) loop_->remove(descriptor);
+    }
+    // Write without blocking: whatever the socket does not take is kept, in order, for
+    // when it becomes writable. The cork settings of the flush policy don't apply here.
+    virtual void write(std::string_view head, std::string_view body, bool /*more*/) {
+      static const char terminator {'\0'};
+      if (!outbound_.empty()) {
+        if (!head.empty()) outbound_.append(head, body);
+        this->writePending();
+        return;
+      }
+      if (head.empty()) return;
+      iovec buffers[3] = {
+        {const_cast<char*>(head.data()), head.size()},
+        {const_cast<char*>(body.data()), body.size()},
+        {const_cast<char*>(&terminator), 1}
+      };
+      size_t written = socket->trySendv(buffers, 3);
+      if (written < head.size() + body.size() + 1) {
+        outbound_.appendRemainder(head, body, written);
+        this->checkRoom();
+        this->watchWritable(true);
+      }
+    }
+    // Write as much of outbound_ as the socket takes, with sendMutex_ held.
+    void writePending() {
+      while (!outbound_.empty()) {
+        std::string_view pending {outbound_.data()};
+        iovec buffer {const_cast<char*>(pending.data()), pending.size()};
+        long written = socket->trySendv(&buffer, 1);
+        if (written == 0) break;
+        outbound_.consume(written);
+      }
+      this->checkRoom();
+      this->watchWritable(!outbound_.empty());
+    }
+    virtual bool tryFlush() {
+      size_t before = outbound_.size();
+      this->writePending();
+      return outbound_.size() < before;
+    }
+    // After outbound_ has changed, with sendMutex_ held: hold senders back while it is over
+    // the limit, and let them go once it is under.
+    void checkRoom() {
+      bool full = outbound_.size() >= STOMP_LOOP_MAX_OUTBOUND;
+      if (full == outboundFull_) return;
+      outboundFull_ = full;
+      if (!full) roomCondition_.notify_all();
+    }
+    void watchWritable(bool writable) {
+      if (writable == writeWanted_) return;
+      writeWanted_ = writable;
+      this->watch();
+    }
+    // Stop or go back to watching the socket for reading, as flow control says.
+    void pauseReading(bool paused) {
+      std::lock_guard<std::mutex> lock {sendMutex_};
+      if (paused == readPaused_) return;
+      readPaused_ = paused;
+      this->watch();
+    }
+    // With sendMutex_ held.
+    void watch() {
+      int descriptor = descriptor_;
+      if (descriptor < 0) return;
+      uint32_t reading {static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP)};
+      uint32_t writing {static_cast<uint32_t>(EPOLLOUT)};
+      loop_->modify(descriptor, (readPaused_? 0: reading) | (writeWanted_? writing: 0));
+    }
+    virtual void armFlushDeadline() {
+      if (flushTimer_ != 0) return;
+      flushTimer_ = loop_->schedule(flushPolicy_.maxDelay, [this](){
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        flushTimer_ = 0;
+        try {
+          if (socket && !outbound_.empty()) this->write({}, {}, false);
+        } catch (SocketException& e) {
+          // the read side will see the broken connection
+        }
+      });
+    }
+    // Called on the loop thread when the socket is readable or writable.
+    void onEvents(uint32_t events) {
+      if (connecting_) {
+        this->onConnectable();
+        return;
+      }
+      if (events & EPOLLOUT) {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        try {
+          if (socket) this->writePending();
+        } catch (SocketException& e) {
+          // the read side will see the broken connection
+        }
+      }
+      if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        // a hang-up is reported whether watched for or not, so read on to see the end of the stream
+        this->onReadable((events & (EPOLLHUP | EPOLLERR)) != 0);
+      }
+    }
+    // Read what is available, a bounded number of times, and dispatch complete frames.
+    // Unless hangUp, stop when flow control says, until it resumes reading.
+    void onReadable(bool hangUp = false) {
+      SocketPtr current {};
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        current = socket;
+      }
+      if (!current) return;
+      bool closed {false};
+      for (int reads=0; reads<STOMP_LOOP_READS && running_; reads++) {
+        if (flow_ && !hangUp && !flow_->mayRead(parser_.getSlabCapacity())) {
+          this->pauseReading(true);
+          break;
+        }
+        auto [buffer, size] = parser_.prepare(STOMP_BUF_SIZE);
+        int capacity = static_cast<int>(std::min<size_t>(size, INT_MAX));
+        int bytesRead;
+        try {
+          bytesRead = current->tryRecv(buffer, capacity);
+        } catch (SocketException& e) {
+          closed = true;
+          break;
+        }
+        if (bytesRead < 0) break;
+        if (bytesRead == 0) {
+          closed = true;
+          break;
+        }
+        parser_.commit(bytesRead);
+        this->markReceived();
+        bool parsed = parser_.parse(received_);
+        for (auto& view : received_) {
+          this->processFrame(view);
+          view = FrameView {};
+          // the receipt for DISCONNECT closes the connection
+          if (!running_) break;
+        }
+        received_.clear();
+        if (!running_) return;
+        if (!parsed) {
+          this->refuseFrame();
+          return;
+        }
+        // a short read emptied the socket; the loop (level-triggered) calls again when there is more
+        if (bytesRead < capacity) break;
+      }
+      if (closed) this->connectionLost();
+    }
+  };
+}
+
+#endif
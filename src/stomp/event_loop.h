@@ -0,0 +1,223 @@
+#ifndef STOMP_EVENT_LOOP_H
+#define STOMP_EVENT_LOOP_H
+
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <system_error>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define STOMP_LOOP_MAX_EVENTS 256
+
+namespace stomp {
+  class EventLoop {
+    // A thread waiting on many non-blocking descriptors at once (epoll). Handlers, posted
+    // tasks and timers all run on the loop thread, one at a time, so they must not block.
+    // add(), modify(), remove(), post() and schedule() may be called from any thread.
+  public:
+    using Handler = std::function<void(uint32_t events)>;
+    using Task = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+  protected:
+    struct Timer {
+      Clock::time_point when;
+      uint64_t id;
+      Task task;
+      bool operator>(const Timer& other) const { return when > other.when; }
+    };
+    int epollFd_ {-1};
+    // written to wake the loop thread out of epoll_wait()
+    int wakeFd_ {-1};
+    std::thread thread_ {};
+    std::atomic<bool> running_ {false};
+    std::atomic<std::thread::id> loopThread_ {};
+    std::mutex mutex_ {};
+    std::unordered_map<int,std::shared_ptr<Handler>> handlers_ {};
+    std::vector<Task> tasks_ {};
+    std::priority_queue<Timer,std::vector<Timer>,std::greater<Timer>> timers_ {};
+    std::unordered_set<uint64_t> cancelledTimers_ {};
+    uint64_t nextTimerId_ {1};
+  public:
+    EventLoop() {
+      epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+      if (epollFd_ < 0) throw std::system_error {errno, std::generic_category(), "epoll_create1"};
+      wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (wakeFd_ < 0) {
+        close(epollFd_);
+        throw std::system_error {errno, std::generic_category(), "eventfd"};
+      }
+      epoll_event event {};
+      event.events = EPOLLIN;
+      event.data.fd = wakeFd_;
+      epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event);
+    }
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+    virtual ~EventLoop() {
+      this->stop();
+      close(wakeFd_);
+      close(epollFd_);
+    }
+    // Start the loop thread.
+    void start() {
+      if (running_.exchange(true)) return;
+      thread_ = std::thread([this](){ run(); });
+    }
+    // Stop the loop thread, after the handler or task currently running returns.
+    void stop() {
+      running_ = false;
+      this->wakeup();
+      if (thread_.joinable() && std::this_thread::get_id() != thread_.get_id()) thread_.join();
+    }
+    bool isRunning() const { return running_; }
+    bool inLoopThread() const { return std::this_thread::get_id() == loopThread_.load(); }
+    // Watch fd for the given epoll events (EPOLLIN, EPOLLOUT...). The handler is called on
+    // the loop thread with the events that occurred.
+    void add(int fd, uint32_t events, Handler handler) {
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        handlers_[fd] = std::make_shared<Handler>(std::move(handler));
+      }
+      this->control(EPOLL_CTL_ADD, fd, events);
+    }
+    // Change the events watched for fd.
+    void modify(int fd, uint32_t events) {
+      this->control(EPOLL_CTL_MOD, fd, events);
+    }
+    // Stop watching fd. When called off the loop thread, waits for a handler already
+    // running for fd to return, so whatever the handler refers to may be destroyed after.
+    void remove(int fd) {
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        if (handlers_.erase(fd) == 0) return;
+      }
+      epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+      if (!this->inLoopThread() && running_) {
+        std::promise<void> done {};
+        std::future<void> finished {done.get_future()};
+        this->post([&done](){ done.set_value(); });
+        finished.wait();
+      }
+    }
+    // Run task on the loop thread.
+    void post(Task task) {
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        tasks_.push_back(std::move(task));
+      }
+      this->wakeup();
+    }
+    // Run task on the loop thread after delay. Returns an id for cancel().
+    uint64_t schedule(std::chrono::microseconds delay, Task task) {
+      uint64_t id;
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        id = nextTimerId_++;
+        timers_.push({Clock::now() + delay, id, std::move(task)});
+      }
+      this->wakeup();
+      return id;
+    }
+    // Cancel a timer that has not fired yet.
+    void cancel(uint64_t timerId) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      cancelledTimers_.insert(timerId);
+    }
+  protected:
+    void control(int op, int fd, uint32_t events) {
+      epoll_event event {};
+      event.events = events;
+      event.data.fd = fd;
+      if (epoll_ctl(epollFd_, op, fd, &event) < 0) {
+        throw std::system_error {errno, std::generic_category(), "epoll_ctl"};
+      }
+    }
+    void wakeup() {
+      uint64_t one {1};
+      ssize_t written = ::write(wakeFd_, &one, sizeof(one));
+      (void) written;
+    }
+    // Milliseconds until the next timer is due, for epoll_wait(). Called with mutex_ held.
+    int timeout() const {
+      if (!tasks_.empty()) return 0;
+      if (timers_.empty()) return -1;
+      auto wait = std::chrono::ceil<std::chrono::milliseconds>(timers_.top().when - Clock::now());
+      return wait.count() > 0? static_cast<int>(wait.count()): 0;
+    }
+    void run() {
+      loopThread_ = std::this_thread::get_id();
+      epoll_event events[STOMP_LOOP_MAX_EVENTS];
+      std::vector<Task> due {};
+      while (running_) {
+        int wait;
+        {
+          std::lock_guard<std::mutex> lock {mutex_};
+          wait = this->timeout();
+        }
+        int count = epoll_wait(epollFd_, events, STOMP_LOOP_MAX_EVENTS, wait);
+        if (count < 0 && errno != EINTR) break;
+        for (int i=0; i<count; i++) {
+          int fd = events[i].data.fd;
+          if (fd == wakeFd_) {
+            uint64_t value;
+            ssize_t bytesRead = ::read(wakeFd_, &value, sizeof(value));
+            (void) bytesRead;
+            continue;
+          }
+          std::shared_ptr<Handler> handler {};
+          {
+            std::lock_guard<std::mutex> lock {mutex_};
+            auto found = handlers_.find(fd);
+            if (found != handlers_.end()) handler = found->second;
+          }
+          if (handler) (*handler)(events[i].events);
+        }
+        {
+          std::lock_guard<std::mutex> lock {mutex_};
+          due.swap(tasks_);
+          auto now = Clock::now();
+          while (!timers_.empty() && timers_.top().when <= now) {
+            if (cancelledTimers_.erase(timers_.top().id) == 0) due.push_back(timers_.top().task);
+            timers_.pop();
+          }
+        }
+        for (auto& task : due) task();
+        due.clear();
+      }
+      loopThread_ = std::thread::id {};
+    }
+  };
+  using EventLoopPtr = std::shared_ptr<EventLoop>;
+
+  class EventLoopGroup {
+    // A fixed set of loops, one thread each, handed out round-robin so connections are
+    // spread evenly across them.
+  protected:
+    std::vector<EventLoopPtr> loops_ {};
+    std::atomic<size_t> next_ {0};
+  public:
+    EventLoopGroup(size_t threads = 1) {
+      if (threads == 0) threads = 1;
+      for (size_t i=0; i<threads; i++) loops_.push_back(std::make_shared<EventLoop>());
+    }
+    void start() { for (auto& loop : loops_) loop->start(); }
+    void stop() { for (auto& loop : loops_) loop->stop(); }
+    size_t size() const { return loops_.size(); }
+    EventLoopPtr next() { return loops_[next_++ % loops_.size()]; }
+  };
+  using EventLoopGroupPtr = std::shared_ptr<EventLoopGroup>;
+}
+
+#endif
@@ -5,6 +5,7 @@
 
 namespace stomp {
   using ConnectFailedException = std::runtime_error;
+  using ReceiptFailedException = std::runtime_error;
 }
 
 #endif
@@ -0,0 +1,163 @@
+#ifndef STOMP_FLOW_CONTROL_H
+#define STOMP_FLOW_CONTROL_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+
+#include "listener.h"
+#include "buffer.h"
+
+// the header asking the broker how many messages it may send a subscription ahead of acknowledgements
+#define STOMP_PREFETCH_HEADER "activemq.prefetchSize"
+// reading resumes once what held it back is down to this fraction of its limit
+#define STOMP_FLOW_RESUME 0.75
+
+namespace stomp {
+  struct FlowPolicy {
+    // How far the application may fall behind the broker. Zero leaves a limit unset.
+    // messages the broker may send a subscription ahead of acknowledgements, asked for with
+    // prefetchHeader in each SUBSCRIBE that doesn't set it itself
+    size_t prefetch {0};
+    std::string prefetchHeader {STOMP_PREFETCH_HEADER};
+    // stop reading while this many messages are delivered and not acknowledged, as counted
+    // by the connection's AckManager (see BaseConnection::setAckPolicy())
+    size_t maxUnacked {0};
+    // stop reading while this many bytes of receive buffer are held by messages not let go
+    size_t maxBufferedBytes {0};
+  };
+
+  class FlowControl : public ConnectionListener, public std::enable_shared_from_this<FlowControl> {
+    // Consumer flow control. Prefetch bounds what the broker sends each subscription ahead
+    // of acknowledgements; beyond that, the transport stops reading from the socket while
+    // too many messages are unacknowledged or too much receive buffer is held by messages
+    // the application has not let go (a frame, view or payload keeps its slab), and reads
+    // again once both are down to STOMP_FLOW_RESUME of their limits. With reads stopped the
+    // socket's receive buffer fills and TCP holds the broker back, so memory stays bounded
+    // under a burst without dropping the connection or a message. The slab being read into
+    // doesn't count, so a frame larger than the budget can still come in, and once
+    // DISCONNECT has been sent reading goes on regardless, for its receipt.
+  protected:
+    FlowPolicy policy_;
+    BufferPoolPtr pool_ {};
+    std::mutex mutex_ {};
+    std::condition_variable resumed_ {};
+    std::function<void()> onResume_ {};
+    std::atomic<size_t> unacked_ {0};
+    // the slab being read into; set by the receiver
+    std::atomic<size_t> reading_ {0};
+    std::atomic<bool> paused_ {false};
+    std::atomic<bool> closing_ {false};
+  public:
+    FlowControl(FlowPolicy policy = {}) : policy_ {std::move(policy)} {}
+    const FlowPolicy& getPolicy() const { return policy_; }
+    // Count the slabs handed out by pool against the budget. Called by the transport.
+    void watch(BufferPoolPtr pool) {
+      std::weak_ptr<FlowControl> self {this->weak_from_this()};
+      pool->setOnRelease([self](){
+        if (auto flow = self.lock()) flow->changed();
+      });
+      pool_ = std::move(pool);
+    }
+    // Messages delivered and not acknowledged. Set by the AckManager.
+    void setUnacked(size_t unacked) {
+      unacked_ = unacked;
+      this->changed();
+    }
+    size_t getUnacked() const { return unacked_; }
+    // Bytes of receive buffer held, besides the slab being read into.
+    size_t getBuffered() const {
+      size_t outstanding {pool_? pool_->getOutstanding(): 0};
+      size_t reading {reading_};
+      return outstanding > reading? outstanding - reading: 0;
+    }
+    // Whether reading is held back.
+    bool isPaused() const { return paused_; }
+    // Call onResume when reading may go on after mayRead() said no. It runs on the thread
+    // that freed the budget, with a lock held, so it should only hand the work on.
+    void setOnResume(std::function<void()> onResume) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      onResume_ = std::move(onResume);
+    }
+    // Whether the receiver may read now, about to read into a slab of reading bytes. Once
+    // it says no, reading is paused until onResume is called.
+    bool mayRead(size_t reading) {
+      reading_ = reading;
+      std::lock_guard<std::mutex> lock {mutex_};
+      return this->admit();
+    }
+    // Wait until the receiver may read, or running is cleared.
+    void waitToRead(size_t reading, const std::atomic<bool>& running) {
+      reading_ = reading;
+      std::unique_lock<std::mutex> lock {mutex_};
+      while (!this->admit() && running) {
+        // running is cleared without a notification, so look again now and then
+        resumed_.wait_for(lock, std::chrono::milliseconds(100));
+      }
+    }
+    virtual void onSend(FramePtr frame) {
+      switch (frame->getType()) {
+        case FrameType::Subscribe:
+          if (policy_.prefetch > 0 && frame->getHeaders().count(policy_.prefetchHeader) == 0) {
+            frame->setHeader(policy_.prefetchHeader, std::to_string(policy_.prefetch));
+          }
+          break;
+        case FrameType::Connect:
+        case FrameType::Stomp:
+          closing_ = false;
+          break;
+        case FrameType::Disconnect:
+          closing_ = true;
+          this->changed();
+          break;
+        default:
+          break;
+      }
+    }
+    // Messages are not copied out for this listener.
+    virtual void onMessage(const FrameView& /*view*/) {}
+  protected:
+    // With mutex_ held.
+    bool admit() {
+      if (paused_) {
+        if (!this->resumable()) return false;
+        paused_ = false;
+        return true;
+      }
+      if (!this->exceeded()) return true;
+      paused_ = true;
+      // whatever freed the budget meanwhile saw paused_ unset, so look again
+      if (!this->resumable()) return false;
+      paused_ = false;
+      return true;
+    }
+    bool exceeded() const {
+      if (closing_) return false;
+      return (policy_.maxUnacked > 0 && unacked_ >= policy_.maxUnacked)
+        || (policy_.maxBufferedBytes > 0 && this->getBuffered() >= policy_.maxBufferedBytes);
+    }
+    bool resumable() const {
+      if (closing_) return true;
+      return (policy_.maxUnacked == 0 || unacked_ <= policy_.maxUnacked * STOMP_FLOW_RESUME)
+        && (policy_.maxBufferedBytes == 0 || this->getBuffered() <= policy_.maxBufferedBytes * STOMP_FLOW_RESUME);
+    }
+    // Something that holds reading back went down: resume if it is far enough down.
+    void changed() {
+      if (!paused_) return;
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        if (!paused_ || !this->resumable()) return;
+        paused_ = false;
+        if (onResume_) onResume_();
+      }
+      resumed_.notify_all();
+    }
+  };
+  using FlowControlPtr = std::shared_ptr<FlowControl>;
+}
+
+#endif
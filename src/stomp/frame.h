@@ -3,10 +3,18 @@
 
 #include <string>
 #include <iostream>
-#include <sstream>
 #include <vector>
 #include <memory>
-#include <map>
+#include <string_view>
+#include <atomic>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+#include "headers.h"
+#include "header_codec.h"
+#include "scan.h"
+#include "payload.h"
 
 #define FRAME_CONNECTING               "CONNECTING"
 #define FRAME_CONNECTED                "CONNECTED"
@@ -30,70 +38,209 @@
 #define FRAME_SUBSCRIBE                "SUBSCRIBE"
 #define FRAME_UNSUBSCRIBE              "UNSUBSCRIBE"
 
-#define HEADER_ACCEPT_VERSION          "accept-version"
-#define HEADER_ACK                     "ack"
-#define HEADER_CONTENT_LENGTH          "content-length"
-#define HEADER_CONTENT_TYPE            "content-type"
-#define HEADER_DESTINATION             "destination"
-#define HEADER_HEARTBEAT               "heart-beat"
-#define HEADER_HOST                    "host"
-#define HEADER_ID                      "id"
-#define HEADER_MESSAGE_ID              "message-id"
-#define HEADER_LOGIN                   "login"
-#define HEADER_PASSCODE                "passcode"
-#define HEADER_RECEIPT                 "receipt"
-#define HEADER_SUBSCRIPTION            "subscription"
-#define HEADER_TRANSACTION             "transaction"
-#define HEADER_RECEIPT_ID              "receipt-id"
-
 namespace stomp {
-  using Headers = std::map<std::string,std::string>;
+  // Tokens for the frame commands. A command is mapped to its token once, when the frame
+  // is made or parsed, and dispatch switches on the token instead of comparing strings.
+  enum class FrameType : uint8_t {
+    Unknown = 0,
+    Connecting,
+    Connected,
+    Disconnected,
+    HeartbeatTimeout,
+    BeforeMessage,
+    Message,
+    Receipt,
+    Error,
+    Heartbeat,
+    ReceiverLoopCompleted,
+    Abort,
+    Ack,
+    Begin,
+    Commit,
+    Connect,
+    Disconnect,
+    Nack,
+    Stomp,
+    Send,
+    Subscribe,
+    Unsubscribe,
+    Count
+  };
+
+  // Command names by FrameType.
+  constexpr std::string_view frameNames[] = {
+    "", FRAME_CONNECTING, FRAME_CONNECTED, FRAME_DISCONNECTED, FRAME_HEARTBEAT_TIMEOUT,
+    FRAME_BEFORE_MESSAGE, FRAME_MESSAGE, FRAME_RECEIPT, FRAME_ERROR, FRAME_HEARTBEAT,
+    FRAME_RECEIVER_LOOP_COMPLETED, FRAME_ABORT, FRAME_ACK, FRAME_BEGIN, FRAME_COMMIT,
+    FRAME_CONNECT, FRAME_DISCONNECT, FRAME_NACK, FRAME_STOMP, FRAME_SEND, FRAME_SUBSCRIBE,
+    FRAME_UNSUBSCRIBE
+  };
+  static_assert(sizeof(frameNames) / sizeof(frameNames[0]) == static_cast<size_t>(FrameType::Count));
+
+  constexpr std::string_view frameName(FrameType type) {
+    return frameNames[static_cast<size_t>(type)];
+  }
+
+  // Hash of a command from its first and last characters and its length, which happens
+  // to be collision-free over the command names (checked below).
+  constexpr size_t frameSlot(std::string_view cmd) {
+    return (static_cast<unsigned char>(cmd.front()) + (static_cast<unsigned char>(cmd.back()) << 4) + (cmd.size() << 1)) & 63;
+  }
+
+  struct FrameTypeTable {
+    FrameType slots[64] {};
+    bool perfect {true};
+    constexpr FrameTypeTable() {
+      for (size_t i=1; i<static_cast<size_t>(FrameType::Count); i++) {
+        size_t slot = frameSlot(frameNames[i]);
+        if (slots[slot] != FrameType::Unknown) perfect = false;
+        slots[slot] = static_cast<FrameType>(i);
+      }
+    }
+  };
+  constexpr FrameTypeTable frameTypeTable {};
+  static_assert(frameTypeTable.perfect, "frameSlot() must give each command a slot of its own");
+
+  // Map a command to its token (FrameType::Unknown if it is not a STOMP command): one
+  // table lookup and one compare.
+  constexpr FrameType frameType(std::string_view cmd) {
+    if (cmd.empty()) return FrameType::Unknown;
+    FrameType type = frameTypeTable.slots[frameSlot(cmd)];
+    return frameName(type) == cmd? type: FrameType::Unknown;
+  }
+
+  class Frame;
+  class FrameRecycler {
+    // Where a pooled Frame goes back to when its last FramePtr is dropped.
+  public:
+    virtual ~FrameRecycler() = default;
+    virtual void recycle(Frame* frame) = 0;
+  };
 
   class Frame {
+    friend class FrameView;
+    friend class FrameEncoder;
+    friend class FramePtr;
+    friend class FramePool;
   protected:
     std::string cmd_ {};
+    FrameType type_ {FrameType::Unknown};
     Headers headers_ {};
-    std::string body_ {};
+    Payload body_ {};
+    // references held by FramePtrs, and the pool the frame came from (if any)
+    std::atomic<uint32_t> refs_ {0};
+    std::shared_ptr<FrameRecycler> recycler_ {};
   public:
-    Frame(std::string cmd, Headers headers, std::string body) :
-      cmd_ {cmd}, headers_ {headers}, body_ {body} {}
-    Frame(std::string content) {
-      std::stringstream s {content};
-      std::getline(s, cmd_);
-      std::string line;
-      while (getline(s, line)) {
-        if (line.size() == 0) break;
-        std::string key, value;
-        std::stringstream l {line};
-        getline(l, key, ':');
-        getline(l, value);
-        headers_[key] = value;
+    Frame(std::string cmd, Headers headers, Payload body) :
+      cmd_ {std::move(cmd)}, type_ {frameType(cmd_)}, headers_ {std::move(headers)}, body_ {std::move(body)} {}
+    // Parse a frame from its wire form: the command line, header lines up to a blank line,
+    // then the body up to the NUL (or the end of content).
+    Frame(std::string_view content) {
+      const char* p = content.data();
+      const char* end = p + content.size();
+      const char* eol = scan::find(p, end, '\n');
+      cmd_.assign(p, eol - p);
+      type_ = frameType(cmd_);
+      p = eol == end? end: eol + 1;
+      p += scan::forEachHeader(std::string_view {p, static_cast<size_t>(end - p)}, [this](std::string_view key, std::string_view value){
+        headers_[key] = std::string {value};
+      });
+      body_ = std::string {p, static_cast<size_t>(scan::find(p, end, '\0') - p)};
+    }
+    Frame() {}
+    const std::string& getCmd() const { return cmd_; }
+    FrameType getType() const { return type_; }
+    void setCmd(std::string cmd) {
+      cmd_ = std::move(cmd);
+      type_ = frameType(cmd_);
+    }
+    const Headers& getHeaders() const { return headers_; }
+    void setHeaders(Headers headers) { headers_ = std::move(headers); }
+    // The body, shared rather than copied: keep a copy of the Payload to hold on to it
+    // after the frame has gone.
+    const Payload& getBody() const { return body_; }
+    void setBody(Payload body) { body_ = std::move(body); }
+    // Set a single header, leaving the others as they are.
+    void setHeader(std::string_view key, std::string value) { headers_[key] = std::move(value); }
+    std::string getReceiptIdHeader() const { return headers_.get(HeaderId::ReceiptId); }
+    bool hasReceiptHeader() const { return headers_.has(HeaderId::Receipt); }
+    std::string getReceiptHeader() const { return headers_.get(HeaderId::Receipt); }
+    // Append the command line, the header lines and the blank line ending the headers to
+    // out, escaping header names and values as the protocol version requires.
+    void appendHead(std::string& out, HeaderEscaping escaping = HeaderEscaping::None) const {
+      if (type_ == FrameType::Connect || type_ == FrameType::Stomp || type_ == FrameType::Connected) {
+        escaping = HeaderEscaping::None;
       }
-      while (getline(s, line, '\0')) {
-        body_ += line;
+      out.append(cmd_);
+      out.push_back('\n');
+      for (auto& [key, value] : headers_) {
+        appendEscaped(out, key, escaping);
+        out.push_back(':');
+        appendEscaped(out, value, escaping);
+        out.push_back('\n');
       }
+      out.push_back('\n');
     }
-    Frame() {}
-    std::string getCmd() const { return cmd_; }
-    Headers getHeaders() const { return headers_; }
-    void setHeaders(Headers headers) { headers_ = headers; }
-    std::string getBody() const { return body_; }
-    void setBody(std::string body) { body_ = body; }
-    std::string getReceiptIdHeader() { return headers_[HEADER_RECEIPT_ID]; }
-    bool hasReceiptHeader() const { return headers_.count(HEADER_RECEIPT); }
-    std::string getReceiptHeader() { return headers_[HEADER_RECEIPT]; }
     std::string getContents() const {
-      std::stringstream s {};
-      s << cmd_ << std::endl;
-      for (auto& [key, value] : headers_) {
-        s << key << ":" << value << std::endl;
+      std::string contents {};
+      contents.reserve(cmd_.size() + body_.size() + 64 * headers_.size() + 2);
+      this->appendHead(contents);
+      contents.append(body_.view());
+      return contents;
+    }
+  };
+
+  class FramePtr {
+    // A counted reference to a Frame. Used like a shared_ptr, but the count lives in the
+    // frame itself, so a reference costs no allocation of its own. When the last one is
+    // dropped the frame goes back to the FramePool it came from, or is deleted.
+  protected:
+    Frame* frame_ {nullptr};
+  public:
+    FramePtr() {}
+    FramePtr(std::nullptr_t) {}
+    // Take a reference on frame, which must be heap allocated (see makeFrame()).
+    explicit FramePtr(Frame* frame) : frame_ {frame} { this->retain(); }
+    FramePtr(const FramePtr& other) : frame_ {other.frame_} { this->retain(); }
+    FramePtr(FramePtr&& other) noexcept : frame_ {other.frame_} { other.frame_ = nullptr; }
+    ~FramePtr() { this->release(); }
+    FramePtr& operator=(FramePtr other) noexcept {
+      std::swap(frame_, other.frame_);
+      return *this;
+    }
+    Frame* get() const { return frame_; }
+    Frame& operator*() const { return *frame_; }
+    Frame* operator->() const { return frame_; }
+    explicit operator bool() const { return frame_ != nullptr; }
+    void reset() {
+      this->release();
+      frame_ = nullptr;
+    }
+    bool operator==(const FramePtr& other) const { return frame_ == other.frame_; }
+    bool operator!=(const FramePtr& other) const { return frame_ != other.frame_; }
+    bool operator==(std::nullptr_t) const { return frame_ == nullptr; }
+    bool operator!=(std::nullptr_t) const { return frame_ != nullptr; }
+  protected:
+    void retain() {
+      if (frame_) frame_->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    void release() {
+      if (!frame_ || frame_->refs_.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+      if (frame_->recycler_) {
+        // the frame's reference on its pool goes with it, so the pool outlives the call
+        std::shared_ptr<FrameRecycler> recycler {std::move(frame_->recycler_)};
+        recycler->recycle(frame_);
+      } else {
+        delete frame_;
       }
-      s << std::endl;
-      s << body_;
-      return s.str();
     }
   };
-  using FramePtr = std::shared_ptr<Frame>;
+
+  // A new frame of its own, not from a pool.
+  template <typename... Args>
+  FramePtr makeFrame(Args&&... args) {
+    return FramePtr {new Frame(std::forward<Args>(args)...)};
+  }
 }
 
 #endif
@@ -0,0 +1,41 @@
+#ifndef STOMP_FRAME_ENCODER_H
+#define STOMP_FRAME_ENCODER_H
+
+#include <string>
+#include <string_view>
+#include <atomic>
+
+#include "frame.h"
+
+#define STOMP_ENCODER_RESERVE 512
+
+namespace stomp {
+  struct EncodedFrame {
+    // The wire form of a frame is head + body + NUL. The head lives in the encoder's
+    // scratch buffer and the body in the frame itself, so both are only valid until the
+    // next encode() (and for as long as the frame is alive).
+    std::string_view head;
+    std::string_view body;
+  };
+
+  class FrameEncoder {
+    // Serializes frames for sending. The command and headers are written into a scratch
+    // buffer that is reused from frame to frame; the body is not copied at all.
+  protected:
+    std::string scratch_ {};
+    std::atomic<HeaderEscaping> escaping_ {HeaderEscaping::None};
+  public:
+    FrameEncoder() { scratch_.reserve(STOMP_ENCODER_RESERVE); }
+    // Escape headers by the rules of the protocol version in use. May be changed while
+    // another thread is encoding.
+    void setEscaping(HeaderEscaping escaping) { escaping_ = escaping; }
+    HeaderEscaping getEscaping() const { return escaping_; }
+    EncodedFrame encode(const Frame& frame) {
+      scratch_.clear();
+      frame.appendHead(scratch_, escaping_.load(std::memory_order_relaxed));
+      return {scratch_, frame.body_.view()};
+    }
+  };
+}
+
+#endif
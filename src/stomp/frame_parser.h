@@ -0,0 +1,264 @@
+#ifndef STOMP_FRAME_PARSER_H
+#define STOMP_FRAME_PARSER_H
+
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+
+#include "frame.h"
+#include "frame_view.h"
+#include "buffer.h"
+#include "scan.h"
+
+// the largest frame accepted by default, headers and body included
+#define STOMP_MAX_FRAME_SIZE (64 * 1024 * 1024)
+
+namespace stomp {
+  class FrameParser {
+    // Incremental STOMP frame parser. The transport reads straight into the parser's
+    // current slab (prepare()/commit()), or hands over a slab it read into (adopt()), and
+    // the parser keeps its position between calls, so a frame may be split across any
+    // number of reads. Bodies with a content-length
+    // header are read by length (and may contain NULs), otherwise the body ends at the
+    // first NUL. Completed frames are emitted as FrameViews into the slab, so frame data
+    // is never copied on the way in; only the unparsed tail of a full slab is moved when
+    // a new slab is started. So a frame may span any number of reads and slabs, and the
+    // slabs behind it are freed (back to the pool) once its views are dropped. A frame
+    // larger than the maximum frame size is not buffered: the parser stops in the TooLarge
+    // state and discards its input until reset(). The line breaks of a header block are
+    // found 64 bytes at a time with the scan kernels.
+  public:
+    enum class State { Idle, Command, Headers, Body, Terminator, TooLarge };
+  protected:
+    BufferPoolPtr pool_;
+    SlabPtr slab_ {};
+    State state_ {State::Idle};
+    // offsets into the slab
+    size_t frameStart_ {0};
+    size_t pos_ {0};
+    size_t end_ {0};
+    size_t lineStart_ {0};
+    size_t cmdEnd_ {0};
+    size_t headersStart_ {0};
+    size_t headersEnd_ {0};
+    size_t bodyStart_ {0};
+    size_t bodyEnd_ {0};
+    std::optional<size_t> contentLength_ {};
+    HeaderEscaping escaping_ {HeaderEscaping::None};
+    size_t maxFrameSize_ {STOMP_MAX_FRAME_SIZE};
+  public:
+    FrameParser(BufferPoolPtr pool = std::make_shared<BufferPool>()) : pool_ {std::move(pool)} {}
+    State getState() const { return state_; }
+    // Have the frames emitted from now on unescape their headers by these rules.
+    void setEscaping(HeaderEscaping escaping) { escaping_ = escaping; }
+    // Refuse frames larger than maxFrameSize bytes (0 for no limit).
+    void setMaxFrameSize(size_t maxFrameSize) { maxFrameSize_ = maxFrameSize == 0? SIZE_MAX: maxFrameSize; }
+    size_t getMaxFrameSize() const { return maxFrameSize_; }
+    const BufferPoolPtr& getPool() const { return pool_; }
+    // Size of the slab being read into, 0 if there is none.
+    size_t getSlabCapacity() const { return slab_? slab_->capacity(): 0; }
+    // Discard any partially parsed frame (e.g. after the socket has been reconnected).
+    void reset() {
+      slab_ = nullptr;
+      state_ = State::Idle;
+      frameStart_ = pos_ = end_ = lineStart_ = 0;
+      contentLength_ = std::nullopt;
+    }
+    // Get a writable region of at least minSize bytes for the next read.
+    std::pair<char*,size_t> prepare(size_t minSize) {
+      if (!slab_ || slab_->capacity() - end_ < minSize) {
+        this->startSlab(minSize);
+      }
+      return {slab_->data() + end_, slab_->capacity() - end_};
+    }
+    // Mark n bytes of the region returned by prepare() as filled.
+    void commit(size_t n) { end_ += n; }
+    // Bytes of the frame under way, which adopt() moves in front of the data it is given.
+    size_t getPartial() const { return slab_? end_ - frameStart_: 0; }
+    // Go on in slab, whose bytes [offset, offset + n) were read into it elsewhere, rather
+    // than copy them into the current slab. The frame under way moves in front of them, so
+    // offset must be at least getPartial(). Parse before adopting the next slab.
+    void adopt(SlabPtr slab, size_t offset, size_t n) {
+      size_t partial = this->getPartial();
+      size_t start = offset - partial;
+      if (partial > 0) std::memcpy(slab->data() + start, slab_->data() + frameStart_, partial);
+      this->rebase(frameStart_, start);
+      end_ += n;
+      slab_ = std::move(slab);
+    }
+    // Copy len bytes into the parser and parse them.
+    void feed(const char* data, size_t len, std::vector<FrameView>& frames) {
+      while (len > 0) {
+        auto [buffer, size] = this->prepare(1);
+        size_t n = std::min(size, len);
+        std::memcpy(buffer, data, n);
+        this->commit(n);
+        this->parse(frames);
+        data += n;
+        len -= n;
+      }
+    }
+    // Parse everything committed so far, appending any completed frames to frames.
+    // Returns false if the frame under way turned out to be over the maximum frame size;
+    // from then on input is discarded until reset().
+    bool parse(std::vector<FrameView>& frames) {
+      if (!slab_) return true;
+      if (state_ == State::TooLarge) {
+        frameStart_ = pos_ = end_ = 0;
+        return true;
+      }
+      const char* data = slab_->data();
+      while (pos_ < end_) {
+        switch (state_) {
+          case State::Idle:
+            // EOLs between frames are heart-beats (or padding after the NUL)
+            while (pos_ < end_ && (data[pos_] == '\n' || data[pos_] == '\r')) pos_++;
+            frameStart_ = lineStart_ = pos_;
+            if (pos_ < end_) state_ = State::Command;
+            break;
+          case State::Command:
+          case State::Headers: {
+            // every line ending in the next block, which usually holds several header lines
+            size_t block = pos_;
+            uint64_t lines = scan::match(data, block, end_, '\n');
+            while (lines != 0 && state_ != State::Body) {
+              size_t eol = block + scan::lowestBit(lines);
+              lines &= lines - 1;
+              this->onLine(lineStart_, eol);
+              pos_ = lineStart_ = eol + 1;
+            }
+            if (state_ == State::Body) {
+              bodyStart_ = pos_;
+              // refused before a slab is sized for it
+              if (contentLength_ && this->exceeds(bodyStart_ - frameStart_ + 1, contentLength_.value())) return this->refuse();
+            } else {
+              pos_ = std::min(end_, block + STOMP_SCAN_BLOCK);
+            }
+            break;
+          }
+          case State::Body:
+            if (contentLength_) {
+              if (end_ - bodyStart_ < contentLength_.value()) {
+                pos_ = end_;
+              } else {
+                bodyEnd_ = pos_ = bodyStart_ + contentLength_.value();
+                state_ = State::Terminator;
+              }
+            } else {
+              const char* nul = scan::find(data + pos_, data + end_, '\0');
+              if (nul == data + end_) {
+                pos_ = end_;
+              } else {
+                bodyEnd_ = nul - data;
+                pos_ = bodyEnd_ + 1;
+                this->emit(frames);
+              }
+            }
+            break;
+          case State::Terminator: {
+            // the frame should end right after the body; skip anything up to the NUL
+            const char* nul = scan::find(data + pos_, data + end_, '\0');
+            if (nul == data + end_) {
+              pos_ = end_;
+            } else {
+              pos_ = nul - data + 1;
+              this->emit(frames);
+            }
+            break;
+          }
+          case State::TooLarge:
+            break;
+        }
+      }
+      if (state_ == State::Idle) {
+        frameStart_ = pos_;
+      } else if (end_ - frameStart_ > maxFrameSize_) {
+        return this->refuse();
+      }
+      return true;
+    }
+  protected:
+    // Whether a frame of used bytes so far plus more would be over the maximum.
+    bool exceeds(size_t used, size_t more) const {
+      return used > maxFrameSize_ || more > maxFrameSize_ - used;
+    }
+    // Give up on the frame under way, dropping what there is of it.
+    bool refuse() {
+      slab_ = nullptr;
+      state_ = State::TooLarge;
+      frameStart_ = pos_ = end_ = lineStart_ = 0;
+      contentLength_ = std::nullopt;
+      return false;
+    }
+    // Handle a complete command or header line spanning [start, eol).
+    void onLine(size_t start, size_t eol) {
+      const char* data = slab_->data();
+      size_t lineEnd = (eol > start && data[eol-1] == '\r')? eol - 1: eol;
+      if (state_ == State::Command) {
+        cmdEnd_ = lineEnd;
+        headersStart_ = eol + 1;
+        state_ = State::Headers;
+      } else if (lineEnd == start) {
+        headersEnd_ = start;
+        state_ = State::Body;
+      } else if (!contentLength_) {
+        // only content-length matters for framing, the other headers are split lazily by FrameView
+        static constexpr std::string_view prefix {HEADER_CONTENT_LENGTH ":"};
+        std::string_view line {data + start, lineEnd - start};
+        if (line.compare(0, prefix.size(), prefix) == 0) {
+          std::string value {line.substr(prefix.size())};
+          char* parsedEnd = nullptr;
+          unsigned long long length = std::strtoull(value.c_str(), &parsedEnd, 10);
+          if (parsedEnd != value.c_str()) contentLength_ = length;
+        }
+      }
+    }
+    void emit(std::vector<FrameView>& frames) {
+      const char* data = slab_->data();
+      frames.emplace_back(slab_,
+          std::string_view {data + frameStart_, cmdEnd_ - frameStart_},
+          std::string_view {data + headersStart_, headersEnd_ - headersStart_},
+          std::string_view {data + bodyStart_, bodyEnd_ - bodyStart_}, escaping_);
+      contentLength_ = std::nullopt;
+      state_ = State::Idle;
+      frameStart_ = pos_;
+    }
+    // Switch to a slab with at least minSize bytes free, carrying over the partial frame.
+    void startSlab(size_t minSize) {
+      size_t partial = end_ - frameStart_;
+      size_t capacity = std::max(pool_->getSlabSize(), partial + minSize);
+      if (state_ == State::Body || state_ == State::Terminator) {
+        if (contentLength_) {
+          // room for the whole frame, so a large body is read into place in one go
+          capacity = std::max(capacity, bodyStart_ - frameStart_ + contentLength_.value() + 1);
+        } else {
+          capacity = std::max(capacity, 2 * partial);
+        }
+      }
+      SlabPtr slab {};
+      if (slab_ && slab_.use_count() == 1 && slab_->capacity() >= capacity) {
+        // no views point into the current slab, so the partial frame can move to the front
+        slab = slab_;
+        std::memmove(slab->data(), slab->data() + frameStart_, partial);
+      } else {
+        slab = pool_->acquire(capacity);
+        if (partial > 0) std::memcpy(slab->data(), slab_->data() + frameStart_, partial);
+      }
+      this->rebase(frameStart_, 0);
+      slab_ = slab;
+    }
+    // The frame under way has moved from offset from to offset to. Offsets before it are
+    // left over from frames already emitted and go to to.
+    void rebase(size_t from, size_t to) {
+      for (size_t* offset : {&frameStart_, &pos_, &end_, &lineStart_, &cmdEnd_, &headersStart_, &headersEnd_, &bodyStart_, &bodyEnd_}) {
+        *offset = *offset < from? to: *offset - from + to;
+      }
+    }
+  };
+}
+
+#endif
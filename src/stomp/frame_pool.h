@@ -0,0 +1,85 @@
+#ifndef STOMP_FRAME_POOL_H
+#define STOMP_FRAME_POOL_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "frame.h"
+
+#define STOMP_FRAME_POOL_MAX_FREE 64
+
+namespace stomp {
+  class FramePool : public FrameRecycler, public std::enable_shared_from_this<FramePool> {
+    // A free list of Frames. A frame goes back to the pool when its last FramePtr is
+    // dropped, and keeps the capacity of its command and header strings, so once the pool
+    // has warmed up, frames of the usual sizes are made without allocating. Each
+    // thread that makes frames has a pool of its own (local()): a connection's receiver
+    // thread, or the loop thread serving EpollTransports, so consumer connections don't
+    // contend for the allocator. A frame dropped on another thread still goes back to the
+    // pool it came from.
+  protected:
+    size_t maxFree_;
+    std::mutex mutex_ {};
+    std::vector<std::unique_ptr<Frame>> free_ {};
+  public:
+    FramePool(size_t maxFree = STOMP_FRAME_POOL_MAX_FREE) : maxFree_ {maxFree} {}
+    // The calling thread's pool.
+    static const std::shared_ptr<FramePool>& local() {
+      thread_local std::shared_ptr<FramePool> pool {std::make_shared<FramePool>()};
+      return pool;
+    }
+    // A frame with the given command, headers and body.
+    FramePtr make(std::string_view cmd, Headers headers = {}, Payload body = {}) {
+      Frame* frame = this->take();
+      frame->cmd_.assign(cmd);
+      frame->type_ = frameType(frame->cmd_);
+      frame->headers_ = std::move(headers);
+      frame->body_ = std::move(body);
+      return FramePtr {frame};
+    }
+    // A frame copied from the given command and (key, value) header pairs, into the strings
+    // of a recycled frame where there is one, sharing the given body.
+    template <typename HeaderRange>
+    FramePtr copy(std::string_view cmd, const HeaderRange& headers, Payload body) {
+      Frame* frame = this->take();
+      frame->cmd_.assign(cmd);
+      frame->type_ = frameType(frame->cmd_);
+      frame->headers_.assign(headers);
+      frame->body_ = std::move(body);
+      return FramePtr {frame};
+    }
+    size_t getFree() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      return free_.size();
+    }
+    virtual void recycle(Frame* frame) {
+      std::unique_ptr<Frame> owned {frame};
+      // the headers are left for the next copy() to write over, but the body goes now, so a
+      // pooled frame doesn't keep a receive buffer alive
+      owned->cmd_.clear();
+      owned->body_ = Payload {};
+      std::lock_guard<std::mutex> lock {mutex_};
+      if (free_.size() < maxFree_) free_.push_back(std::move(owned));
+    }
+  protected:
+    Frame* take() {
+      std::unique_ptr<Frame> frame {};
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        if (!free_.empty()) {
+          frame = std::move(free_.back());
+          free_.pop_back();
+        }
+      }
+      if (!frame) frame = std::make_unique<Frame>();
+      frame->recycler_ = this->shared_from_this();
+      return frame.release();
+    }
+  };
+  using FramePoolPtr = std::shared_ptr<FramePool>;
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef STOMP_FRAME_VIEW_H
+#define STOMP_FRAME_VIEW_H
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <memory>
+
+#include "frame.h"
+#include "frame_pool.h"
+#include "header_codec.h"
+#include "scan.h"
+#include "small_vector.h"
+
+namespace stomp {
+  using HeaderView = std::pair<std::string_view,std::string_view>;
+
+  class FrameView {
+    // A received frame whose command, headers and body point straight into the receive
+    // buffer, so nothing is copied until (and unless) a listener asks for a Frame, and even
+    // then the body stays where it is (see getPayload()). Header
+    // lines are only split into key/value pairs on first access, and escaped names and
+    // values (STOMP 1.1 and later) are only copied out to be unescaped if the header block
+    // has a backslash at all. The view holds a reference on the buffer it points into, so
+    // copies of it stay valid.
+  protected:
+    std::shared_ptr<const void> owner_ {};
+    std::string_view cmd_ {};
+    FrameType type_ {FrameType::Unknown};
+    HeaderEscaping escaping_ {HeaderEscaping::None};
+    std::string_view headerBlock_ {};
+    std::string_view body_ {};
+    mutable bool headersParsed_ {false};
+    mutable SmallVector<HeaderView,STOMP_HEADERS_INLINE> headers_ {};
+    // unescaped names and values, shared by copies of the view
+    mutable std::shared_ptr<std::string> unescaped_ {};
+    mutable FramePtr frame_ {};
+  public:
+    FrameView() {}
+    FrameView(std::shared_ptr<const void> owner, std::string_view cmd, std::string_view headerBlock, std::string_view body,
+        HeaderEscaping escaping = HeaderEscaping::None) :
+      owner_ {std::move(owner)}, cmd_ {cmd}, type_ {frameType(cmd)}, escaping_ {escaping}, headerBlock_ {headerBlock}, body_ {body} {
+        if (type_ == FrameType::Connected) escaping_ = HeaderEscaping::None;
+      }
+    // View an existing frame. toFrame() returns the frame itself.
+    FrameView(FramePtr frame) :
+      cmd_ {frame->cmd_}, type_ {frame->type_}, body_ {frame->body_.view()}, headersParsed_ {true}, frame_ {frame} {
+      headers_.reserve(frame->headers_.size());
+      for (auto& [key, value] : frame->headers_) {
+        headers_.emplace_back(key, value);
+      }
+    }
+    std::string_view getCmd() const { return cmd_; }
+    FrameType getType() const { return type_; }
+    std::string_view getBody() const { return body_; }
+    // The body as a Payload sharing the receive buffer, which it keeps alive.
+    Payload getPayload() const {
+      return frame_? frame_->body_: Payload {owner_, body_};
+    }
+    // All headers in the order they were received.
+    const SmallVector<HeaderView,STOMP_HEADERS_INLINE>& getHeaders() const {
+      if (!headersParsed_) this->parseHeaders();
+      return headers_;
+    }
+    // Value of the named header (the first one, if it was repeated).
+    std::optional<std::string_view> getHeader(std::string_view key) const {
+      for (auto& [k, v] : this->getHeaders()) {
+        if (k == key) return v;
+      }
+      return std::nullopt;
+    }
+    bool hasHeader(std::string_view key) const { return this->getHeader(key).has_value(); }
+    // Copy the view into an owning Frame, from this thread's FramePool. The body is not
+    // copied but shared with the receive buffer. The frame is made once and shared by later
+    // calls.
+    FramePtr toFrame() const {
+      if (!frame_) frame_ = FramePool::local()->copy(cmd_, this->getHeaders(), this->getPayload());
+      return frame_;
+    }
+  protected:
+    void parseHeaders() const {
+      scan::forEachHeader(headerBlock_, [this](std::string_view key, std::string_view value){
+        headers_.emplace_back(key, value);
+      });
+      if (needsUnescaping(headerBlock_, escaping_)) this->unescapeHeaders();
+      headersParsed_ = true;
+    }
+    void unescapeHeaders() const {
+      // never longer than the escaped block, so the views into it stay put as it fills
+      unescaped_ = std::make_shared<std::string>();
+      unescaped_->reserve(headerBlock_.size());
+      auto unescape = [this](std::string_view& field){
+        if (!needsUnescaping(field, escaping_)) return;
+        size_t start = unescaped_->size();
+        appendUnescaped(*unescaped_, field, escaping_);
+        field = std::string_view {*unescaped_}.substr(start);
+      };
+      for (auto& [key, value] : headers_) {
+        unescape(key);
+        unescape(value);
+      }
+    }
+  };
+}
+
+#endif
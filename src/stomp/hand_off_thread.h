@@ -0,0 +1,76 @@
+#ifndef STOMP_HAND_OFF_THREAD_H
+#define STOMP_HAND_OFF_THREAD_H
+
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <algorithm>
+#include <cstdint>
+
+namespace stomp {
+  class HandOffThread {
+    // A thread of an object's own for the work its TimerWheel tasks can't do on the wheel's
+    // thread, which serves every connection: anything that may wait for the socket or the
+    // broker. A task hands off a token (e.g. its WheelTimer generation), and the thread
+    // runs the work with it; tokens handed off while the work runs are coalesced to the
+    // highest. The thread is started on the first hand-off. Tasks hold the thread through
+    // a weak_ptr and never the object itself, so the object is never destroyed on the
+    // wheel's thread; the object calls stop() first thing in its destructor, after which
+    // hand-offs do nothing.
+  public:
+    using Work = std::function<void(uint64_t)>;
+  protected:
+    Work work_;
+    std::mutex mutex_ {};
+    std::condition_variable condition_ {};
+    bool wanted_ {false};
+    uint64_t token_ {0};
+    bool stopping_ {false};
+    std::thread thread_ {};
+  public:
+    explicit HandOffThread(Work work) : work_ {std::move(work)} {}
+    HandOffThread(const HandOffThread&) = delete;
+    HandOffThread& operator=(const HandOffThread&) = delete;
+    ~HandOffThread() { this->stop(); }
+    void handOff(uint64_t token = 0) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      if (stopping_) return;
+      if (!thread_.joinable()) thread_ = std::thread([this](){ this->run(); });
+      token_ = wanted_? std::max(token_, token): token;
+      wanted_ = true;
+      condition_.notify_one();
+    }
+    // Stop the thread, waiting for the work under way.
+    void stop() {
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        stopping_ = true;
+      }
+      condition_.notify_all();
+      if (thread_.joinable()) thread_.join();
+    }
+  protected:
+    void run() {
+      std::unique_lock<std::mutex> lock {mutex_};
+      while (true) {
+        condition_.wait(lock, [this](){ return wanted_ || stopping_; });
+        if (stopping_) break;
+        wanted_ = false;
+        uint64_t token {token_};
+        lock.unlock();
+        try {
+          work_(token);
+        } catch (std::exception& e) {
+          // the receiving side will see the broken connection
+        }
+        lock.lock();
+      }
+    }
+  };
+  using HandOffThreadPtr = std::shared_ptr<HandOffThread>;
+}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef STOMP_HEADER_CODEC_H
+#define STOMP_HEADER_CODEC_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+
+namespace stomp {
+  // Which header escaping rules apply: none in STOMP 1.0; 1.1 escapes LF, ':' and '\';
+  // 1.2 escapes CR as well. CONNECT and CONNECTED frames are never escaped.
+  enum class HeaderEscaping : uint8_t { None, Stomp11, Stomp12 };
+
+  namespace codec {
+    // Bytes are tested eight at a time as a 64-bit word: a word holds the byte c iff
+    // word ^ (c in every byte) has a zero byte, and zeroBytes() finds those with a few
+    // integer operations. Only a word that holds one is looked at byte by byte.
+    constexpr uint64_t ones = 0x0101010101010101ull;
+    constexpr uint64_t highs = 0x8080808080808080ull;
+    constexpr uint64_t zeroBytes(uint64_t word) { return (word - ones) & ~word & highs; }
+    constexpr uint64_t matches(uint64_t word, unsigned char c) { return zeroBytes(word ^ (ones * c)); }
+    inline uint64_t load(const char* p) {
+      uint64_t word;
+      std::memcpy(&word, p, sizeof(word));
+      return word;
+    }
+    inline bool isSpecial(char c, bool cr) {
+      return c == '\n' || c == ':' || c == '\\' || (cr && c == '\r');
+    }
+    // The first byte in [p, end) that has to be escaped, or end.
+    inline const char* findSpecial(const char* p, const char* end, bool cr) {
+      for (; end - p >= 8; p += 8) {
+        uint64_t word = load(p);
+        uint64_t found = matches(word, '\n') | matches(word, ':') | matches(word, '\\');
+        if (cr) found |= matches(word, '\r');
+        if (found != 0) break;
+      }
+      for (; p < end; p++) {
+        if (isSpecial(*p, cr)) return p;
+      }
+      return end;
+    }
+  }
+
+  // Whether value has anything to escape.
+  inline bool needsEscaping(std::string_view value, HeaderEscaping escaping) {
+    if (escaping == HeaderEscaping::None) return false;
+    const char* end = value.data() + value.size();
+    return codec::findSpecial(value.data(), end, escaping == HeaderEscaping::Stomp12) != end;
+  }
+
+  // Append value to out, escaped. Runs of plain bytes are copied in one go, so a value
+  // with nothing to escape costs one scan and one append.
+  inline void appendEscaped(std::string& out, std::string_view value, HeaderEscaping escaping) {
+    if (escaping == HeaderEscaping::None) {
+      out.append(value);
+      return;
+    }
+    bool cr = escaping == HeaderEscaping::Stomp12;
+    const char* p = value.data();
+    const char* end = p + value.size();
+    while (true) {
+      const char* special = codec::findSpecial(p, end, cr);
+      out.append(p, special - p);
+      if (special == end) return;
+      out.push_back('\\');
+      switch (*special) {
+        case '\n': out.push_back('n'); break;
+        case '\r': out.push_back('r'); break;
+        case ':': out.push_back('c'); break;
+        default: out.push_back('\\'); break;
+      }
+      p = special + 1;
+    }
+  }
+
+  // Whether value has escape sequences to undo.
+  inline bool needsUnescaping(std::string_view value, HeaderEscaping escaping) {
+    return escaping != HeaderEscaping::None && std::memchr(value.data(), '\\', value.size()) != nullptr;
+  }
+
+  // Append value to out with its escape sequences undone. Sequences the rules don't
+  // define (which the spec makes a protocol error) are kept as they are.
+  inline void appendUnescaped(std::string& out, std::string_view value, HeaderEscaping escaping) {
+    if (escaping == HeaderEscaping::None) {
+      out.append(value);
+      return;
+    }
+    const char* p = value.data();
+    const char* end = p + value.size();
+    while (true) {
+      const char* slash = static_cast<const char*>(std::memchr(p, '\\', end - p));
+      if (slash == nullptr) {
+        out.append(p, end - p);
+        return;
+      }
+      out.append(p, slash - p);
+      char next = slash + 1 < end? slash[1]: '\0';
+      switch (next) {
+        case 'n': out.push_back('\n'); break;
+        case 'c': out.push_back(':'); break;
+        case '\\': out.push_back('\\'); break;
+        case 'r':
+          if (escaping == HeaderEscaping::Stomp12) {
+            out.push_back('\r');
+            break;
+          }
+          [[fallthrough]];
+        default:
+          out.push_back('\\');
+          if (slash + 1 < end) out.push_back(next);
+          break;
+      }
+      p = slash + 1 < end? slash + 2: end;
+    }
+  }
+}
+
+#endif
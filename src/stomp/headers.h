@@ -0,0 +1,232 @@
+#ifndef STOMP_HEADERS_H
+#define STOMP_HEADERS_H
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+
+#include "small_vector.h"
+
+#define HEADER_ACCEPT_VERSION          "accept-version"
+#define HEADER_ACK                     "ack"
+#define HEADER_CONTENT_LENGTH          "content-length"
+#define HEADER_CONTENT_TYPE            "content-type"
+#define HEADER_DESTINATION             "destination"
+#define HEADER_HEARTBEAT               "heart-beat"
+#define HEADER_HOST                    "host"
+#define HEADER_ID                      "id"
+#define HEADER_MESSAGE_ID              "message-id"
+#define HEADER_LOGIN                   "login"
+#define HEADER_PASSCODE                "passcode"
+#define HEADER_RECEIPT                 "receipt"
+#define HEADER_SUBSCRIPTION            "subscription"
+#define HEADER_TRANSACTION             "transaction"
+#define HEADER_RECEIPT_ID              "receipt-id"
+#define HEADER_VERSION                 "version"
+#define HEADER_MESSAGE                 "message"
+
+#define STOMP_HEADERS_INLINE 10
+
+namespace stomp {
+  // Tokens for the well-known header names. Names are interned once when a header is
+  // added, after which looking one of these up is an array index.
+  enum class HeaderId : uint8_t {
+    Custom = 0,
+    AcceptVersion,
+    Ack,
+    ContentLength,
+    ContentType,
+    Destination,
+    Heartbeat,
+    Host,
+    Id,
+    MessageId,
+    Login,
+    Passcode,
+    Receipt,
+    Subscription,
+    Transaction,
+    ReceiptId,
+    Count
+  };
+
+  // Map a header name to its token (HeaderId::Custom if it is not a well-known one).
+  inline HeaderId internHeader(std::string_view key) {
+    auto is = [&key](const char* name) { return std::memcmp(key.data(), name, key.size()) == 0; };
+    switch (key.size()) {
+      case 2:  if (is(HEADER_ID)) return HeaderId::Id; break;
+      case 3:  if (is(HEADER_ACK)) return HeaderId::Ack; break;
+      case 4:  if (is(HEADER_HOST)) return HeaderId::Host; break;
+      case 5:  if (is(HEADER_LOGIN)) return HeaderId::Login; break;
+      case 7:  if (is(HEADER_RECEIPT)) return HeaderId::Receipt; break;
+      case 8:  if (is(HEADER_PASSCODE)) return HeaderId::Passcode; break;
+      case 10:
+        if (is(HEADER_MESSAGE_ID)) return HeaderId::MessageId;
+        if (is(HEADER_RECEIPT_ID)) return HeaderId::ReceiptId;
+        if (is(HEADER_HEARTBEAT)) return HeaderId::Heartbeat;
+        break;
+      case 11:
+        if (is(HEADER_DESTINATION)) return HeaderId::Destination;
+        if (is(HEADER_TRANSACTION)) return HeaderId::Transaction;
+        break;
+      case 12:
+        if (is(HEADER_SUBSCRIPTION)) return HeaderId::Subscription;
+        if (is(HEADER_CONTENT_TYPE)) return HeaderId::ContentType;
+        break;
+      case 14:
+        if (is(HEADER_CONTENT_LENGTH)) return HeaderId::ContentLength;
+        if (is(HEADER_ACCEPT_VERSION)) return HeaderId::AcceptVersion;
+        break;
+    }
+    return HeaderId::Custom;
+  }
+
+  class Headers {
+    // Frame headers as a flat list of (key, value) pairs in insertion order, stored inline
+    // for typical frames. Keys are unique. Alongside the list, a small table records where
+    // each well-known header lives, so get(HeaderId) is O(1); custom headers are found by
+    // a scan of the (short) list.
+  public:
+    using Entry = std::pair<std::string,std::string>;
+    using iterator = Entry*;
+    using const_iterator = const Entry*;
+  protected:
+    SmallVector<Entry,STOMP_HEADERS_INLINE> entries_ {};
+    // 1-based index into entries_ per HeaderId, 0 when absent
+    uint16_t slots_[static_cast<size_t>(HeaderId::Count)] {};
+    SmallVector<HeaderId,STOMP_HEADERS_INLINE> ids_ {};
+  public:
+    Headers() {}
+    Headers(std::initializer_list<std::pair<std::string_view,std::string_view>> values) {
+      for (auto& [key, value] : values) this->emplace(key, value);
+    }
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    iterator begin() { return entries_.begin(); }
+    iterator end() { return entries_.end(); }
+    const_iterator begin() const { return entries_.begin(); }
+    const_iterator end() const { return entries_.end(); }
+    void clear() {
+      entries_.clear();
+      ids_.clear();
+      std::memset(slots_, 0, sizeof(slots_));
+    }
+
+    iterator find(HeaderId id) {
+      uint16_t slot = slots_[static_cast<size_t>(id)];
+      return (id == HeaderId::Custom || slot == 0)? this->end(): entries_.begin() + slot - 1;
+    }
+    const_iterator find(HeaderId id) const {
+      return const_cast<Headers*>(this)->find(id);
+    }
+    iterator find(std::string_view key) {
+      HeaderId id = internHeader(key);
+      if (id != HeaderId::Custom) return this->find(id);
+      for (size_t i=0; i<entries_.size(); i++) {
+        if (ids_[i] == HeaderId::Custom && entries_[i].first == key) return entries_.begin() + i;
+      }
+      return this->end();
+    }
+    const_iterator find(std::string_view key) const {
+      return const_cast<Headers*>(this)->find(key);
+    }
+    size_t count(HeaderId id) const { return this->find(id) != this->end(); }
+    size_t count(std::string_view key) const { return this->find(key) != this->end(); }
+    bool has(HeaderId id) const { return this->count(id) > 0; }
+    // Value of the header, or an empty string if it is not set.
+    const std::string& get(HeaderId id) const {
+      static const std::string empty {};
+      auto it = this->find(id);
+      return it == this->end()? empty: it->second;
+    }
+    const std::string& get(std::string_view key) const {
+      static const std::string empty {};
+      auto it = this->find(key);
+      return it == this->end()? empty: it->second;
+    }
+
+    // Add a header unless one with the same key is already present.
+    std::pair<iterator,bool> emplace(std::string_view key, std::string_view value) {
+      HeaderId id = internHeader(key);
+      auto it = (id == HeaderId::Custom)? this->find(key): this->find(id);
+      if (it != this->end()) return {it, false};
+      return {this->append(id, std::string {key}, std::string {value}), true};
+    }
+    std::string& operator[](std::string_view key) {
+      HeaderId id = internHeader(key);
+      auto it = (id == HeaderId::Custom)? this->find(key): this->find(id);
+      if (it == this->end()) it = this->append(id, std::string {key}, std::string {});
+      return it->second;
+    }
+    // Replace all headers with the (key, value) pairs of values, keeping the first of any
+    // repeated key. The strings of the entries already here are reused, with their
+    // capacity, so refilling a recycled frame's headers doesn't allocate.
+    template <typename Range>
+    void assign(const Range& values) {
+      std::memset(slots_, 0, sizeof(slots_));
+      size_t n {0};
+      for (auto& [key, value] : values) {
+        HeaderId id = internHeader(key);
+        if (id != HeaderId::Custom && slots_[static_cast<size_t>(id)] != 0) continue;
+        if (id == HeaderId::Custom && this->findCustom(key, n)) continue;
+        if (n < entries_.size()) {
+          entries_[n].first.assign(key);
+          entries_[n].second.assign(value);
+          ids_[n] = id;
+        } else {
+          entries_.emplace_back(std::string {key}, std::string {value});
+          ids_.push_back(id);
+        }
+        n++;
+        if (id != HeaderId::Custom) slots_[static_cast<size_t>(id)] = static_cast<uint16_t>(n);
+      }
+      while (entries_.size() > n) {
+        entries_.pop_back();
+        ids_.pop_back();
+      }
+    }
+    size_t erase(std::string_view key) {
+      auto it = this->find(key);
+      if (it == this->end()) return 0;
+      size_t index = it - entries_.begin();
+      entries_.erase(it);
+      ids_.erase(ids_.begin() + index);
+      this->reindex();
+      return 1;
+    }
+    bool operator==(const Headers& other) const {
+      if (this->size() != other.size()) return false;
+      for (auto& [key, value] : *this) {
+        auto it = other.find(key);
+        if (it == other.end() || it->second != value) return false;
+      }
+      return true;
+    }
+    bool operator!=(const Headers& other) const { return !(*this == other); }
+  protected:
+    iterator append(HeaderId id, std::string key, std::string value) {
+      entries_.emplace_back(std::move(key), std::move(value));
+      ids_.push_back(id);
+      if (id != HeaderId::Custom) slots_[static_cast<size_t>(id)] = static_cast<uint16_t>(entries_.size());
+      return &entries_.back();
+    }
+    // Whether a custom header named key is among the first n entries.
+    bool findCustom(std::string_view key, size_t n) const {
+      for (size_t i=0; i<n; i++) {
+        if (ids_[i] == HeaderId::Custom && entries_[i].first == key) return true;
+      }
+      return false;
+    }
+    void reindex() {
+      std::memset(slots_, 0, sizeof(slots_));
+      for (size_t i=0; i<ids_.size(); i++) {
+        if (ids_[i] != HeaderId::Custom) slots_[static_cast<size_t>(ids_[i])] = static_cast<uint16_t>(i + 1);
+      }
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef STOMP_HEARTBEAT_LISTENER_H
+#define STOMP_HEARTBEAT_LISTENER_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+
+#include "listener.h"
+#include "base_transport.h"
+#include "timer_wheel.h"
+
+// how many receive intervals may pass without data before the server is taken for dead
+#define STOMP_HEARTBEAT_GRACE 1.5
+
+namespace stomp {
+  class HeartbeatListener : public ConnectionListener, public std::enable_shared_from_this<HeartbeatListener> {
+    // STOMP heart-beating. Offers the intervals in the heart-beat header of CONNECT and
+    // settles them from the server's reply in CONNECTED: each side beats at the slower of
+    // what one offers and the other wants. Then a single timer on the shared TimerWheel
+    // looks after the connection. Sending and receiving only note the time; when the timer
+    // comes due it sends an EOL if nothing has gone out for the send interval, and if
+    // nothing has come in for STOMP_HEARTBEAT_GRACE receive intervals it tells the
+    // listeners HEARTBEAT_TIMEOUT and breaks the connection, which the transport then
+    // handles as any lost connection (reconnecting if set to).
+  protected:
+    using Clock = std::chrono::steady_clock;
+    std::weak_ptr<BaseTransport> transport_;
+    // what we offer: how often we can send, and how often we want to hear from the server
+    std::chrono::milliseconds sendOffered_;
+    std::chrono::milliseconds receiveWanted_;
+    double grace_ {STOMP_HEARTBEAT_GRACE};
+    std::mutex mutex_ {};
+    // negotiated, zero for none
+    Clock::duration sendInterval_ {0};
+    Clock::duration receiveInterval_ {0};
+    WheelTimer timer_;
+  public:
+    HeartbeatListener(std::weak_ptr<BaseTransport> transport, std::chrono::milliseconds sendOffered,
+        std::chrono::milliseconds receiveWanted, TimerWheelPtr wheel = TimerWheel::shared()) :
+      transport_ {std::move(transport)}, sendOffered_ {sendOffered}, receiveWanted_ {receiveWanted}, timer_ {std::move(wheel)} {}
+    virtual ~HeartbeatListener() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      timer_.stop();
+    }
+    // Take the server for dead after grace receive intervals without data.
+    void setGrace(double grace) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      grace_ = grace;
+    }
+    virtual void onSend(FramePtr frame) {
+      FrameType frameType = frame->getType();
+      if (frameType != FrameType::Connect && frameType != FrameType::Stomp) return;
+      frame->setHeader(HEADER_HEARTBEAT, std::to_string(sendOffered_.count()) + "," + std::to_string(receiveWanted_.count()));
+    }
+    virtual void onConnected(FramePtr frame) {
+      // the server's heart-beat header: how often it can send, then how often it wants to hear from us
+      long serverSends {0}, serverWants {0};
+      const Headers& headers = frame->getHeaders();
+      if (headers.has(HeaderId::Heartbeat)) {
+        const std::string& value = headers.get(HeaderId::Heartbeat);
+        char* end {nullptr};
+        serverSends = std::strtol(value.c_str(), &end, 10);
+        if (*end == ',') serverWants = std::strtol(end + 1, nullptr, 10);
+      }
+      std::lock_guard<std::mutex> lock {mutex_};
+      timer_.stop();
+      sendInterval_ = Clock::duration::zero();
+      receiveInterval_ = Clock::duration::zero();
+      if (sendOffered_.count() > 0 && serverWants > 0) {
+        sendInterval_ = std::max<Clock::duration>(sendOffered_, std::chrono::milliseconds(serverWants));
+      }
+      if (receiveWanted_.count() > 0 && serverSends > 0) {
+        receiveInterval_ = std::max<Clock::duration>(receiveWanted_, std::chrono::milliseconds(serverSends));
+      }
+      if (sendInterval_ > Clock::duration::zero() || receiveInterval_ > Clock::duration::zero()) {
+        this->arm(this->untilDue(Clock::now()));
+      }
+    }
+    virtual void onDisconnected() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      timer_.stop();
+    }
+    // The negotiated intervals, zero where that side does not heart-beat.
+    Clock::duration getSendInterval() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      return sendInterval_;
+    }
+    Clock::duration getReceiveInterval() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      return receiveInterval_;
+    }
+  protected:
+    // With mutex_ held.
+    void arm(Clock::duration delay) {
+      std::weak_ptr<HeartbeatListener> self {this->weak_from_this()};
+      timer_.arm(delay, [self](uint64_t generation){
+        if (auto listener = self.lock()) listener->check(generation);
+      });
+    }
+    // Time from now until something is due, with mutex_ held.
+    Clock::duration untilDue(Clock::time_point now) {
+      auto transport = transport_.lock();
+      if (!transport) return Clock::duration::max();
+      auto due = Clock::time_point::max();
+      if (sendInterval_ > Clock::duration::zero()) {
+        due = std::min(due, transport->getLastSent() + sendInterval_);
+      }
+      if (receiveInterval_ > Clock::duration::zero()) {
+        due = std::min(due, transport->getLastReceived() + std::chrono::duration_cast<Clock::duration>(receiveInterval_ * grace_));
+      }
+      return due - now;
+    }
+    // On the wheel thread, when the timer comes due.
+    void check(uint64_t generation) {
+      auto transport = transport_.lock();
+      if (!transport) return;
+      std::unique_lock<std::mutex> lock {mutex_};
+      if (!timer_.fire(generation)) return;
+      auto now = Clock::now();
+      if (receiveInterval_ > Clock::duration::zero()
+          && now - transport->getLastReceived() >= std::chrono::duration_cast<Clock::duration>(receiveInterval_ * grace_)) {
+        timer_.stop();
+        lock.unlock();
+        transport->notify(FramePool::local()->make(FRAME_HEARTBEAT_TIMEOUT));
+        transport->abortConnection();
+        return;
+      }
+      // the wheel may fire up to a tick late, so beat a tick early rather than miss the interval
+      if (sendInterval_ > Clock::duration::zero() && now - transport->getLastSent() >= sendInterval_ - timer_.getWheel()->getResolution()) {
+        lock.unlock();
+        try {
+          transport->sendHeartbeat();
+        } catch (std::exception& e) {
+          // no beat is needed on a connection that broke; reading finds it lost
+        }
+        lock.lock();
+        if (!timer_.isCurrent(generation)) return;
+        now = Clock::now();
+      }
+      // a beat that could not go out without waiting is tried again a tick later
+      this->arm(std::max(this->untilDue(now), timer_.getWheel()->getResolution()));
+    }
+  };
+  using HeartbeatListenerPtr = std::shared_ptr<HeartbeatListener>;
+}
+
+#endif
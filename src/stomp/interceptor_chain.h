@@ -0,0 +1,67 @@
+#ifndef STOMP_INTERCEPTOR_CHAIN_H
+#define STOMP_INTERCEPTOR_CHAIN_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <algorithm>
+
+#include "frame.h"
+
+namespace stomp {
+  // Called on the receiving thread with each MESSAGE before it reaches the subscription
+  // handlers and listeners. Changes made to the frame (setHeaders(), setBody()...) are
+  // what they see.
+  using MessageInterceptor = std::function<void(const FramePtr& message)>;
+
+  class InterceptorChain {
+    // Named message interceptors, run in the order they were added. Kept copy-on-write like
+    // ListenerRegistry; the count is kept apart so that, with no interceptors, the receiver
+    // skips the chain (and the copy of the message it would need) after one atomic load.
+  public:
+    using Entry = std::pair<std::string,MessageInterceptor>;
+    using Chain = std::vector<Entry>;
+    using ChainPtr = std::shared_ptr<const Chain>;
+  protected:
+    ChainPtr chain_ {std::make_shared<const Chain>()};
+    std::atomic<size_t> size_ {0};
+    std::mutex updateMutex_ {};
+  public:
+    // Add an interceptor at the end of the chain, or replace the one with the same name in place.
+    void add(const std::string& name, MessageInterceptor interceptor) {
+      std::lock_guard<std::mutex> lock {updateMutex_};
+      auto next = std::make_shared<Chain>(*chain_);
+      auto found = std::find_if(next->begin(), next->end(), [&name](const Entry& entry){ return entry.first == name; });
+      if (found != next->end()) {
+        found->second = std::move(interceptor);
+      } else {
+        next->emplace_back(name, std::move(interceptor));
+      }
+      size_ = next->size();
+      std::atomic_store(&chain_, ChainPtr {std::move(next)});
+    }
+    void remove(const std::string& name) {
+      std::lock_guard<std::mutex> lock {updateMutex_};
+      auto next = std::make_shared<Chain>(*chain_);
+      auto found = std::find_if(next->begin(), next->end(), [&name](const Entry& entry){ return entry.first == name; });
+      if (found == next->end()) return;
+      next->erase(found);
+      size_ = next->size();
+      std::atomic_store(&chain_, ChainPtr {std::move(next)});
+    }
+    bool empty() const { return size_.load(std::memory_order_acquire) == 0; }
+    // Pass message through every interceptor in turn.
+    void run(const FramePtr& message) const {
+      ChainPtr current {std::atomic_load(&chain_)};
+      for (auto& [name, interceptor] : *current) {
+        interceptor(message);
+      }
+    }
+  };
+}
+
+#endif
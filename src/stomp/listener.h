@@ -13,6 +13,7 @@ using HostAndPort = std::pair<std::string,unsigned short>;
 using HostAndPortPtr = std::shared_ptr<HostAndPort>;
 
 #include "frame.h"
+#include "frame_view.h"
 #include "publisher.h"
 
 namespace stomp {
@@ -22,29 +23,28 @@ namespace stomp {
   public:
     virtual ~ConnectionListener() = default;
     virtual void notify(FramePtr frame, HostAndPortPtr hostAndPort = nullptr) {
-      std::string frameType = frame->getCmd();
-      if (frameType == FRAME_CONNECTING) {
-        this->onConnecting(hostAndPort);
-      } else if (frameType == FRAME_CONNECTED) {
-        this->onConnected(frame);
-      } else if (frameType == FRAME_DISCONNECTED) {
-        this->onDisconnected();
-      } else if (frameType == FRAME_HEARTBEAT_TIMEOUT) {
-        this->onHeartbeatTimeout();
-      } else if (frameType == FRAME_BEFORE_MESSAGE) {
-        this->onBeforeMessage(frame);
-      } else if (frameType == FRAME_MESSAGE) {
-        this->onMessage(frame);
-      } else if (frameType == FRAME_RECEIPT) {
-        this->onReceipt(frame);
-      } else if (frameType == FRAME_ERROR) {
-        this->onError(frame);
-      } else if (frameType == FRAME_SEND) {
-        this->onSend(frame);
-      } else if (frameType == FRAME_HEARTBEAT) {
-        this->onHeartbeat();
-      } else if (frameType == FRAME_RECEIVER_LOOP_COMPLETED) {
-        this->onReceiverLoopCompleted(frame);
+      switch (frame->getType()) {
+        case FrameType::Connecting: this->onConnecting(hostAndPort); break;
+        case FrameType::Connected: this->onConnected(frame); break;
+        case FrameType::Disconnected: this->onDisconnected(); break;
+        case FrameType::HeartbeatTimeout: this->onHeartbeatTimeout(); break;
+        case FrameType::BeforeMessage: this->onBeforeMessage(frame); break;
+        case FrameType::Message: this->onMessage(frame); break;
+        case FrameType::Receipt: this->onReceipt(frame); break;
+        case FrameType::Error: this->onError(frame); break;
+        case FrameType::Send: this->onSend(frame); break;
+        case FrameType::Heartbeat: this->onHeartbeat(); break;
+        case FrameType::ReceiverLoopCompleted: this->onReceiverLoopCompleted(frame); break;
+        default: break;
+      }
+    }
+    // Notify the listener of a frame received from the server. The default implementation
+    // hands MESSAGE frames to onMessage(const FrameView&) and materializes anything else.
+    virtual void notify(const FrameView& view, HostAndPortPtr hostAndPort = nullptr) {
+      if (view.getType() == FrameType::Message) {
+        this->onMessage(view);
+      } else {
+        this->notify(view.toFrame(), hostAndPort);
       }
     }
     std::string generateUuid() {
@@ -71,11 +71,16 @@ namespace stomp {
     // Called by the STOMP connection when a heartbeat message has not been
     // received beyond the specified period.
     virtual void onHeartbeatTimeout() {}
-    // Called by the STOMP connection before a message is returned to the client app. Returns a tuple
-    // containing the headers and body (so that implementing listeners can pre-process the content).
+    // Called by the STOMP connection before a message is returned to the client app, so the
+    // listener can pre-process the headers and body in place. Only called for listeners
+    // added with addInterceptor() as well as setListener().
     virtual void onBeforeMessage(FramePtr frame) {}
     // Called by the STOMP connection when a MESSAGE frame is received.
     virtual void onMessage(FramePtr frame) {}
+    // Called by the STOMP connection when a MESSAGE frame is received, with a view into
+    // the receive buffer. Override this to read messages without copying them; the default
+    // implementation calls onMessage(FramePtr).
+    virtual void onMessage(const FrameView& view) { this->onMessage(view.toFrame()); }
     // Called by the STOMP connection when a RECEIPT frame is
     // received, sent by the server if requested by the client using
     // the 'receipt' header.
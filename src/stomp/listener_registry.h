@@ -0,0 +1,70 @@
+#ifndef STOMP_LISTENER_REGISTRY_H
+#define STOMP_LISTENER_REGISTRY_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <utility>
+#include <algorithm>
+
+#include "listener.h"
+
+namespace stomp {
+  class ListenerRegistry {
+    // Named listeners, kept copy-on-write for dispatch. The listeners live in an immutable
+    // array sorted by name; readers take the current snapshot and iterate it without
+    // holding any lock, so they never see a half-made change and a listener removed
+    // mid-dispatch stays alive until the dispatch ends. Each change copies the array and
+    // publishes the copy atomically; changes are serialized with each other only.
+    // Taking the snapshot is not free of locks: std::atomic_load on a shared_ptr holds one
+    // of the library's pooled mutexes while it copies the pointer and bumps its count. A
+    // reader waits at most for another copy or swap of the pointer, never for a change to
+    // be built or for a dispatch.
+  public:
+    using Entry = std::pair<std::string,ConnectionListenerPtr>;
+    using Snapshot = std::vector<Entry>;
+    using SnapshotPtr = std::shared_ptr<const Snapshot>;
+  protected:
+    SnapshotPtr snapshot_ {std::make_shared<const Snapshot>()};
+    std::mutex updateMutex_ {};
+  public:
+    // The current listeners, in name order. Briefly takes the lock std::atomic_load uses.
+    SnapshotPtr snapshot() const {
+      return std::atomic_load(&snapshot_);
+    }
+    // Add a listener, replacing any with the same name.
+    void set(const std::string& name, ConnectionListenerPtr listener) {
+      std::lock_guard<std::mutex> lock {updateMutex_};
+      auto next = std::make_shared<Snapshot>(*snapshot_);
+      auto found = std::lower_bound(next->begin(), next->end(), name, [](const Entry& entry, const std::string& key){
+        return entry.first < key;
+      });
+      if (found != next->end() && found->first == name) {
+        found->second = std::move(listener);
+      } else {
+        next->emplace(found, name, std::move(listener));
+      }
+      std::atomic_store(&snapshot_, SnapshotPtr {std::move(next)});
+    }
+    void remove(const std::string& name) {
+      std::lock_guard<std::mutex> lock {updateMutex_};
+      auto next = std::make_shared<Snapshot>(*snapshot_);
+      auto found = std::find_if(next->begin(), next->end(), [&name](const Entry& entry){ return entry.first == name; });
+      if (found == next->end()) return;
+      next->erase(found);
+      std::atomic_store(&snapshot_, SnapshotPtr {std::move(next)});
+    }
+    // The named listener, or nullptr.
+    ConnectionListenerPtr get(const std::string& name) const {
+      SnapshotPtr current {this->snapshot()};
+      for (auto& [key, listener] : *current) {
+        if (key == name) return listener;
+      }
+      return nullptr;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef STOMP_OUTBOUND_BUFFER_H
+#define STOMP_OUTBOUND_BUFFER_H
+
+#include <string>
+#include <string_view>
+#include <chrono>
+
+#define STOMP_FLUSH_MAX_BYTES 65536
+
+namespace stomp {
+  struct FlushPolicy {
+    // When buffered outbound frames are written to the socket. The buffer is flushed as
+    // soon as any limit is reached, or on an explicit flush(). The default (maxFrames 1)
+    // writes every frame immediately.
+    enum class Cork { None, MsgMore, TcpCork };
+    // flush once this many bytes are buffered
+    size_t maxBytes {STOMP_FLUSH_MAX_BYTES};
+    // flush once this many frames are buffered
+    size_t maxFrames {1};
+    // flush at most this long after the first frame was buffered (0 for no deadline, in
+    // which case frames wait for a limit or an explicit flush())
+    std::chrono::microseconds maxDelay {0};
+    // tell the kernel more data follows when flushing because a limit was reached, so it
+    // can fill whole segments: MSG_MORE on the write, or TCP_CORK until the next explicit
+    // or deadline flush. What the kernel holds back is pushed out maxDelay later if nothing
+    // follows, so without a deadline limit flushes are never held.
+    Cork cork {Cork::None};
+    bool coalesces() const { return maxFrames != 1; }
+  };
+
+  class OutboundBuffer {
+    // Encoded frames waiting to be written, stored back to back exactly as they go on the wire.
+  protected:
+    std::string data_ {};
+    // bytes at the front already written by a partial write
+    size_t written_ {0};
+    size_t frames_ {0};
+    std::chrono::steady_clock::time_point firstQueued_ {};
+  public:
+    OutboundBuffer(size_t reserve = STOMP_FLUSH_MAX_BYTES) { data_.reserve(reserve); }
+    bool empty() const { return frames_ == 0; }
+    size_t size() const { return data_.size() - written_; }
+    size_t frames() const { return frames_; }
+    std::string_view data() const { return std::string_view {data_}.substr(written_); }
+    std::chrono::steady_clock::time_point firstQueued() const { return firstQueued_; }
+    void append(std::string_view head, std::string_view body) {
+      if (frames_ == 0) firstQueued_ = std::chrono::steady_clock::now();
+      data_.append(head);
+      data_.append(body);
+      data_.push_back('\0');
+      frames_++;
+    }
+    // Append a heart-beat: an EOL, which the server skips between frames.
+    void appendHeartbeat() {
+      if (frames_ == 0) firstQueued_ = std::chrono::steady_clock::now();
+      data_.push_back('\n');
+      frames_++;
+    }
+    // Append the part of a frame left over after its first offset bytes were written.
+    void appendRemainder(std::string_view head, std::string_view body, size_t offset) {
+      if (frames_ == 0) firstQueued_ = std::chrono::steady_clock::now();
+      if (offset < head.size()) {
+        data_.append(head.substr(offset));
+        offset = 0;
+      } else {
+        offset -= head.size();
+      }
+      if (offset < body.size()) {
+        data_.append(body.substr(offset));
+        offset = 0;
+      } else {
+        offset -= body.size();
+      }
+      if (offset == 0) data_.push_back('\0');
+      frames_++;
+    }
+    // Drop the first n bytes, which have been written.
+    void consume(size_t n) {
+      written_ += n;
+      if (written_ >= data_.size()) this->clear();
+    }
+    void clear() {
+      data_.clear();
+      written_ = 0;
+      frames_ = 0;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef STOMP_PAYLOAD_H
+#define STOMP_PAYLOAD_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <ostream>
+
+namespace stomp {
+  class Payload {
+    // An immutable run of bytes with shared ownership, used for frame bodies: copying a
+    // Payload only adds a reference. It either owns a string of its own or points into a
+    // buffer it keeps alive, such as the receive slab a frame was parsed from, so a
+    // message body goes from the socket to every listener and on into application queues
+    // without being copied. A payload in a receive slab keeps the whole slab from going
+    // back to its pool, so use str() to keep a small body for long.
+  protected:
+    std::shared_ptr<const void> owner_ {};
+    std::string_view data_ {};
+  public:
+    Payload() {}
+    Payload(std::string data) {
+      if (data.empty()) return;
+      auto owned = std::make_shared<const std::string>(std::move(data));
+      data_ = *owned;
+      owner_ = std::move(owned);
+    }
+    Payload(const char* data) : Payload {std::string {data}} {}
+    // The bytes data, inside memory that owner keeps alive.
+    Payload(std::shared_ptr<const void> owner, std::string_view data) : owner_ {std::move(owner)}, data_ {data} {}
+    const char* data() const { return data_.data(); }
+    size_t size() const { return data_.size(); }
+    bool empty() const { return data_.empty(); }
+    const char* begin() const { return data_.data(); }
+    const char* end() const { return data_.data() + data_.size(); }
+    std::string_view view() const { return data_; }
+    operator std::string_view() const { return data_; }
+    // A copy of the bytes, owned by the caller.
+    std::string str() const { return std::string {data_}; }
+    // Part of the payload, sharing its buffer.
+    Payload substr(size_t pos, size_t count = std::string_view::npos) const { return Payload {owner_, data_.substr(pos, count)}; }
+  };
+
+  inline bool operator==(const Payload& payload, std::string_view value) { return payload.view() == value; }
+  inline bool operator==(std::string_view value, const Payload& payload) { return payload.view() == value; }
+  inline bool operator!=(const Payload& payload, std::string_view value) { return payload.view() != value; }
+  inline bool operator!=(std::string_view value, const Payload& payload) { return payload.view() != value; }
+  inline std::ostream& operator<<(std::ostream& out, const Payload& payload) { return out << payload.view(); }
+}
+
+#endif
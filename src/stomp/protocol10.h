@@ -2,6 +2,7 @@
 #define STOMP_PROTOCOL_10_H
 
 #include <memory>
+#include <future>
 
 #include "listener.h"
 #include "base_transport.h"
@@ -22,9 +23,15 @@ class Protocol10 : public ConnectionListener {
       }
     // Encode and send a stomp frame through the underlying transport.
     void sendFrame(std::string cmd, Headers headers = {}, std::string body="") {
-      FramePtr frame = std::make_shared<Frame>(cmd, headers, body);
+      FramePtr frame = FramePool::local()->make(cmd, std::move(headers), std::move(body));
       transport_->transmit(frame);
     }
+    // Queue a stomp frame for the transport's writer thread instead of sending it on this
+    // thread. Returns false if the queue was full and the backpressure policy rejected it.
+    bool sendFrameAsync(std::string cmd, Headers headers = {}, std::string body="") {
+      FramePtr frame = FramePool::local()->make(cmd, std::move(headers), std::move(body));
+      return transport_->transmitAsync(frame);
+    }
     // Abort a transaction.
     void abort(std::string transaction, Headers headers = {}) {
       headers[HEADER_TRANSACTION] = transaction;
@@ -53,24 +60,58 @@ class Protocol10 : public ConnectionListener {
       if (username) headers[HEADER_LOGIN] = username.value();
       if (passcode) headers[HEADER_PASSCODE] = passcode.value();
       this->sendFrame(FRAME_CONNECT, headers);
-      if (wait) {
-        transport_->waitForConnection();
-        if (transport_->hasConnectError()) throw ConnectFailedException("connect failed");
+      if (wait && !transport_->waitForConnection()) {
+        throw ConnectFailedException("connect failed");
       }
     }
     void disconnect(OptString receipt = std::nullopt, Headers headers = {}) {
-      std::string receiptId {receipt? receipt.value(): generateUuid()};
+      // let anything queued by sendAsync() go out first
+      transport_->drain();
+      std::string receiptId {receipt? receipt.value(): transport_->nextReceiptId()};
       headers[HEADER_RECEIPT] = receiptId;
       transport_->setReceipt(receiptId, FRAME_DISCONNECT);
       this->sendFrame(FRAME_DISCONNECT, headers);
     }
     void send(std::string destination, std::string body, OptString contentType = std::nullopt, Headers headers = {}) {
-      headers[HEADER_DESTINATION] = destination;
-      if (contentType) headers[HEADER_CONTENT_TYPE] = contentType.value();
-      if (autoContentLength_ && headers.count(HEADER_CONTENT_LENGTH) == 0) {
-        headers[HEADER_CONTENT_LENGTH] = std::to_string(body.size());
+      this->prepareSend(destination, body, contentType, headers);
+      this->sendFrame(FRAME_SEND, std::move(headers), std::move(body));
+    }
+    // Send with a receipt requested, and call onReceipt with the server's RECEIPT once it
+    // arrives (or the ERROR it sent instead, or nullptr if the connection was lost). Does not
+    // wait for the receipt, only for room in the receipt window if it is full.
+    void send(std::string destination, std::string body, ReceiptCallback onReceipt, OptString contentType = std::nullopt, Headers headers = {}) {
+      this->prepareSend(destination, body, contentType, headers);
+      std::string receiptId {transport_->nextReceiptId()};
+      headers[HEADER_RECEIPT] = receiptId;
+      transport_->expectReceipt(receiptId, std::move(onReceipt));
+      try {
+        this->sendFrame(FRAME_SEND, std::move(headers), std::move(body));
+      } catch (...) {
+        transport_->setReceipt(receiptId, std::nullopt);
+        throw;
       }
-      this->sendFrame(FRAME_SEND, headers, body);
+    }
+    // Send with a receipt requested. The future is ready with the RECEIPT once the server has
+    // the message, and throws ReceiptFailedException if it reported an error or the connection was lost.
+    std::future<FramePtr> sendConfirmed(std::string destination, std::string body, OptString contentType = std::nullopt, Headers headers = {}) {
+      auto promise = std::make_shared<std::promise<FramePtr>>();
+      std::future<FramePtr> confirmed {promise->get_future()};
+      this->send(std::move(destination), std::move(body), [promise](FramePtr frame){
+        if (frame && frame->getType() == FrameType::Receipt) {
+          promise->set_value(frame);
+        } else {
+          std::string reason {frame? "send failed: " + frame->getHeaders().get("message"): "connection lost before receipt"};
+          promise->set_exception(std::make_exception_ptr(ReceiptFailedException(reason)));
+        }
+      }, contentType, std::move(headers));
+      return confirmed;
+    }
+    // Like send(), but the frame is queued and written by the transport's writer thread, so
+    // any number of threads can publish through the connection without waiting on the
+    // socket. Returns false if the frame was rejected by the queue's backpressure policy.
+    bool sendAsync(std::string destination, std::string body, OptString contentType = std::nullopt, Headers headers = {}) {
+      this->prepareSend(destination, body, contentType, headers);
+      return this->sendFrameAsync(FRAME_SEND, std::move(headers), std::move(body));
     }
     void subscribe(std::string destination, OptString id = std::nullopt, std::string ack = "auto", Headers headers = {}) {
       headers[HEADER_DESTINATION] = destination;
@@ -78,13 +119,37 @@ class Protocol10 : public ConnectionListener {
       headers[HEADER_ACK] = ack;
       this->sendFrame(FRAME_SUBSCRIBE, headers);
     }
+    // Subscribe with a handler of its own: MESSAGE frames for the subscription are routed
+    // to handler by id and not passed to the listeners. Returns the subscription id.
+    std::string subscribe(std::string destination, MessageHandler handler, OptString id = std::nullopt, std::string ack = "auto", Headers headers = {}) {
+      std::string subscriptionId {id? id.value(): generateUuid()};
+      // registered first, so a message arriving straight after SUBSCRIBE is not missed
+      transport_->addSubscription(subscriptionId, destination, std::move(handler));
+      try {
+        this->subscribe(destination, subscriptionId, ack, std::move(headers));
+      } catch (...) {
+        transport_->removeSubscription(subscriptionId);
+        throw;
+      }
+      return subscriptionId;
+    }
     void unsubscribeDestination(std::string destination, Headers headers = {}) {
       headers[HEADER_DESTINATION] = destination;
       this->sendFrame(FRAME_UNSUBSCRIBE, headers);
+      transport_->removeSubscriptions(destination);
     }
     void unsubscribeId(std::string id, Headers headers = {}) {
       headers[HEADER_ID] = id;
       this->sendFrame(FRAME_UNSUBSCRIBE, headers);
+      transport_->removeSubscription(id);
+    }
+  protected:
+    void prepareSend(const std::string& destination, const std::string& body, const OptString& contentType, Headers& headers) {
+      headers[HEADER_DESTINATION] = destination;
+      if (contentType) headers[HEADER_CONTENT_TYPE] = contentType.value();
+      if (autoContentLength_ && headers.count(HEADER_CONTENT_LENGTH) == 0) {
+        headers[HEADER_CONTENT_LENGTH] = std::to_string(body.size());
+      }
     }
   };
 using Protocol10Ptr = std::shared_ptr<Protocol10>;
@@ -0,0 +1,59 @@
+#ifndef STOMP_PROTOCOL_11_H
+#define STOMP_PROTOCOL_11_H
+
+#include <memory>
+
+#include "protocol10.h"
+#include "header_codec.h"
+
+namespace stomp {
+class Protocol11 : public Protocol10 {
+    // STOMP 1.1: every subscription has an id, messages are acknowledged (or not, with
+    // NACK) by message-id and subscription, and header names and values are escaped.
+    // Heart-beats are set up with BaseConnection::setHeartbeats().
+  public:
+    Protocol11(TransportPtr transport, bool autoContentLength = true) :
+      Protocol10 {transport, autoContentLength} {
+        version_ = "1.1";
+        transport_->setHeaderEscaping(HeaderEscaping::Stomp11);
+      }
+    // Acknowledge 'consumption' of a message by id, as received on subscription.
+    void ack(std::string id, std::string subscription, OptString transaction = std::nullopt, OptString receipt = std::nullopt) {
+      this->sendFrame(FRAME_ACK, this->ackHeaders(id, subscription, transaction, receipt));
+    }
+    // Tell the server the message was not consumed.
+    void nack(std::string id, std::string subscription, OptString transaction = std::nullopt, OptString receipt = std::nullopt) {
+      this->sendFrame(FRAME_NACK, this->ackHeaders(id, subscription, transaction, receipt));
+    }
+    // Connect, naming the broker's host (as 1.1 requires) unless headers do.
+    void connect(OptString username = std::nullopt, OptString passcode = std::nullopt, bool wait = false, Headers headers = {}) {
+      if (!headers.has(HeaderId::Host)) {
+        HostAndPortPtr hostAndPort {transport_->getCurrentHostAndPort()};
+        if (hostAndPort) headers[HEADER_HOST] = hostAndPort->first;
+      }
+      Protocol10::connect(username, passcode, wait, std::move(headers));
+    }
+    using Protocol10::subscribe;
+    // Subscribe under the given id, or a generated one. Returns the id.
+    std::string subscribe(std::string destination, OptString id = std::nullopt, std::string ack = "auto", Headers headers = {}) {
+      std::string subscriptionId {id? id.value(): generateUuid()};
+      Protocol10::subscribe(destination, subscriptionId, ack, std::move(headers));
+      return subscriptionId;
+    }
+    void unsubscribe(std::string id, Headers headers = {}) {
+      this->unsubscribeId(id, std::move(headers));
+    }
+    // Subscriptions are known by id alone from 1.1 on.
+    void unsubscribeDestination(std::string destination, Headers headers = {}) = delete;
+  protected:
+    Headers ackHeaders(const std::string& id, const std::string& subscription, const OptString& transaction, const OptString& receipt) {
+      Headers headers {{HEADER_MESSAGE_ID, id}, {HEADER_SUBSCRIPTION, subscription}};
+      if (transaction) headers[HEADER_TRANSACTION] = transaction.value();
+      if (receipt) headers[HEADER_RECEIPT] = receipt.value();
+      return headers;
+    }
+  };
+using Protocol11Ptr = std::shared_ptr<Protocol11>;
+}
+
+#endif
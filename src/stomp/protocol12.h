@@ -0,0 +1,37 @@
+#ifndef STOMP_PROTOCOL_12_H
+#define STOMP_PROTOCOL_12_H
+
+#include <memory>
+
+#include "protocol11.h"
+
+namespace stomp {
+class Protocol12 : public Protocol11 {
+    // STOMP 1.2: messages are acknowledged by the id in their ack header, and carriage
+    // returns in headers are escaped too.
+  public:
+    Protocol12(TransportPtr transport, bool autoContentLength = true) :
+      Protocol11 {transport, autoContentLength} {
+        version_ = "1.2";
+        transport_->setHeaderEscaping(HeaderEscaping::Stomp12);
+      }
+    // Acknowledge 'consumption' of a message, given the value of its ack header.
+    void ack(std::string id, OptString transaction = std::nullopt, OptString receipt = std::nullopt) {
+      this->sendFrame(FRAME_ACK, this->ackHeaders(id, transaction, receipt));
+    }
+    // Tell the server the message was not consumed, given the value of its ack header.
+    void nack(std::string id, OptString transaction = std::nullopt, OptString receipt = std::nullopt) {
+      this->sendFrame(FRAME_NACK, this->ackHeaders(id, transaction, receipt));
+    }
+  protected:
+    Headers ackHeaders(const std::string& id, const OptString& transaction, const OptString& receipt) {
+      Headers headers {{HEADER_ID, id}};
+      if (transaction) headers[HEADER_TRANSACTION] = transaction.value();
+      if (receipt) headers[HEADER_RECEIPT] = receipt.value();
+      return headers;
+    }
+  };
+using Protocol12Ptr = std::shared_ptr<Protocol12>;
+}
+
+#endif
@@ -3,15 +3,15 @@
 
 #include <string>
 #include <memory>
-#include <map>
 
 #include "listener.h"
+#include "listener_registry.h"
 
 namespace stomp {
   class Publisher {
     // A registry of listeners
   protected:
-    std::map<std::string,ConnectionListenerPtr> listeners_ {};
+    ListenerRegistry listeners_ {};
   public:
     virtual ~Publisher() = default;
     // Set a named listener to use with this connection.
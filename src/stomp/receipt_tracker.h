@@ -0,0 +1,121 @@
+#ifndef STOMP_RECEIPT_TRACKER_H
+#define STOMP_RECEIPT_TRACKER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <functional>
+#include <optional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+#include "frame.h"
+
+// unconfirmed frames allowed in flight before a confirmed send waits
+#define STOMP_RECEIPT_WINDOW 1024
+
+namespace stomp {
+  // Called once with the RECEIPT for a frame, the ERROR the server sent instead, or
+  // nullptr if the connection was lost first or the frame could not be sent. Runs on the
+  // receiving thread, or on the writer thread for a frame queued by transmitAsync().
+  using ReceiptCallback = std::function<void(FramePtr frame)>;
+
+  class ReceiptTracker {
+    // Receipts requested from the server and not received yet. Receipt ids come from a
+    // per-connection counter. Frames sent with a callback count against a window: once
+    // that many are unconfirmed, the next one waits for a receipt before it goes out, so
+    // a publisher can keep the link busy without letting the backlog grow without bound.
+  protected:
+    struct Pending {
+      // what the receipt is for, e.g. FRAME_DISCONNECT
+      std::string value {};
+      ReceiptCallback callback {};
+      bool windowed {false};
+    };
+    std::mutex mutex_ {};
+    std::condition_variable spaceCondition_ {};
+    std::unordered_map<std::string,Pending> pending_ {};
+    std::atomic<uint64_t> counter_ {0};
+    size_t window_ {STOMP_RECEIPT_WINDOW};
+    size_t inFlight_ {0};
+  public:
+    // A receipt id unique on this connection.
+    std::string nextId() {
+      return "r-" + std::to_string(++counter_);
+    }
+    void setWindow(size_t window) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      window_ = window == 0? 1: window;
+      spaceCondition_.notify_all();
+    }
+    size_t getWindow() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      return window_;
+    }
+    // Unconfirmed frames sent with a callback.
+    size_t inFlight() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      return inFlight_;
+    }
+    // Expect a receipt for id and call callback with it, after waiting for room in the window.
+    void expect(const std::string& id, ReceiptCallback callback) {
+      std::unique_lock<std::mutex> lock {mutex_};
+      spaceCondition_.wait(lock, [this](){ return inFlight_ < window_; });
+      inFlight_++;
+      pending_[id] = Pending {{}, std::move(callback), true};
+    }
+    // Expect a receipt for id, remembering what it is for. Does not count against the window.
+    void set(const std::string& id, std::string value) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      auto& pending = pending_[id];
+      if (pending.windowed) this->release();
+      pending = Pending {std::move(value), nullptr, false};
+    }
+    void erase(const std::string& id) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      auto found = pending_.find(id);
+      if (found == pending_.end()) return;
+      if (found->second.windowed) this->release();
+      pending_.erase(found);
+    }
+    // Settle the receipt for id with frame (a RECEIPT or ERROR). Returns what the receipt
+    // was for, or nothing if it was not expected.
+    std::optional<std::string> complete(const std::string& id, FramePtr frame) {
+      Pending pending;
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        auto found = pending_.find(id);
+        if (found == pending_.end()) return std::nullopt;
+        pending = std::move(found->second);
+        pending_.erase(found);
+        if (pending.windowed) this->release();
+      }
+      if (pending.callback) pending.callback(frame);
+      return std::move(pending.value);
+    }
+    // The connection is gone: nothing outstanding will be confirmed.
+    void failAll() {
+      std::vector<ReceiptCallback> callbacks {};
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        for (auto& [id, pending] : pending_) {
+          if (pending.callback) callbacks.push_back(std::move(pending.callback));
+        }
+        pending_.clear();
+        inFlight_ = 0;
+        spaceCondition_.notify_all();
+      }
+      for (auto& callback : callbacks) callback(nullptr);
+    }
+  protected:
+    // Called with mutex_ held.
+    void release() {
+      inFlight_--;
+      spaceCondition_.notify_one();
+    }
+  };
+}
+
+#endif
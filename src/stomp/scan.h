@@ -0,0 +1,206 @@
+#ifndef STOMP_SCAN_H
+#define STOMP_SCAN_H
+
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define STOMP_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+#define STOMP_SCAN_BLOCK 64
+
+namespace stomp {
+  namespace scan {
+    // Delimiter scanning for the parser. A kernel looks at a 64-byte block at a time and
+    // returns bitmasks of where the line breaks (and colons) are, bit i for byte i, so the
+    // header lines in a block are all found with one pass over it instead of one memchr
+    // per line. The kernel is picked once at startup by what the CPU supports: AVX2 (two
+    // 32-byte compares per block), SSE2 (four 16-byte ones), or a portable scalar
+    // fallback. Finding a single byte over a long run, e.g. the NUL ending a body, is left
+    // to memchr, which the C library already dispatches to the best vector code.
+    struct Masks {
+      uint64_t newline;
+      uint64_t colon;
+    };
+    struct Kernel {
+      const char* name;
+      // bits of the bytes equal to c in a full block
+      uint64_t (*match)(const char* block, char c);
+      // line breaks and colons of a full block
+      void (*masks)(const char* block, Masks& masks);
+    };
+
+    inline unsigned lowestBit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+      return static_cast<unsigned>(__builtin_ctzll(bits));
+#else
+      unsigned i {0};
+      while (!(bits & 1)) {
+        bits >>= 1;
+        i++;
+      }
+      return i;
+#endif
+    }
+
+    inline uint64_t scalarMatch(const char* block, char c) {
+      uint64_t bits {0};
+      for (unsigned i=0; i<STOMP_SCAN_BLOCK; i++) {
+        bits |= static_cast<uint64_t>(block[i] == c) << i;
+      }
+      return bits;
+    }
+    inline void scalarMasks(const char* block, Masks& masks) {
+      uint64_t newline {0}, colon {0};
+      for (unsigned i=0; i<STOMP_SCAN_BLOCK; i++) {
+        newline |= static_cast<uint64_t>(block[i] == '\n') << i;
+        colon |= static_cast<uint64_t>(block[i] == ':') << i;
+      }
+      masks = {newline, colon};
+    }
+
+#ifdef STOMP_SCAN_X86
+    __attribute__((target("sse2"))) inline uint64_t sse2Match(const char* block, char c) {
+      __m128i wanted = _mm_set1_epi8(c);
+      uint64_t bits {0};
+      for (unsigned i=0; i<4; i++) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+        bits |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(data, wanted)))) << (16 * i);
+      }
+      return bits;
+    }
+    __attribute__((target("sse2"))) inline void sse2Masks(const char* block, Masks& masks) {
+      masks.newline = sse2Match(block, '\n');
+      masks.colon = sse2Match(block, ':');
+    }
+
+    __attribute__((target("avx2"))) inline uint64_t avx2Match(const char* block, char c) {
+      __m256i wanted = _mm256_set1_epi8(c);
+      __m256i low = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+      __m256i high = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+      uint32_t lowBits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, wanted)));
+      uint32_t highBits = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, wanted)));
+      return lowBits | (static_cast<uint64_t>(highBits) << 32);
+    }
+    __attribute__((target("avx2"))) inline void avx2Masks(const char* block, Masks& masks) {
+      masks.newline = avx2Match(block, '\n');
+      masks.colon = avx2Match(block, ':');
+    }
+#endif
+
+    constexpr Kernel scalarKernel {"scalar", scalarMatch, scalarMasks};
+#ifdef STOMP_SCAN_X86
+    constexpr Kernel sse2Kernel {"sse2", sse2Match, sse2Masks};
+    constexpr Kernel avx2Kernel {"avx2", avx2Match, avx2Masks};
+#endif
+
+    // The best kernel this CPU runs.
+    inline const Kernel* bestKernel() {
+#ifdef STOMP_SCAN_X86
+      __builtin_cpu_init();
+      if (__builtin_cpu_supports("avx2")) return &avx2Kernel;
+      if (__builtin_cpu_supports("sse2")) return &sse2Kernel;
+#endif
+      return &scalarKernel;
+    }
+    inline const Kernel* activeKernel {bestKernel()};
+    // Use another kernel, e.g. scalarKernel to compare against. Not thread-safe: call
+    // before any connection is started.
+    inline void setKernel(const Kernel& kernel) { activeKernel = &kernel; }
+    inline const Kernel& kernel() { return *activeKernel; }
+
+    // Bits of the bytes equal to c in the block at offset of the size bytes at base; bits
+    // past the end are clear. A short last block is read as the last 64 bytes and shifted
+    // down, so only a buffer smaller than a block is ever copied (padded with 0x01 bytes,
+    // so c must not be 0x01).
+    inline uint64_t match(const char* base, size_t offset, size_t size, char c) {
+      size_t len = size - offset;
+      if (len >= STOMP_SCAN_BLOCK) return activeKernel->match(base + offset, c);
+      if (size >= STOMP_SCAN_BLOCK) return activeKernel->match(base + size - STOMP_SCAN_BLOCK, c) >> (STOMP_SCAN_BLOCK - len);
+      char block[STOMP_SCAN_BLOCK];
+      std::memcpy(block, base + offset, len);
+      std::memset(block + len, 1, STOMP_SCAN_BLOCK - len);
+      return activeKernel->match(block, c);
+    }
+    // Masks of the block at offset of the size bytes at base, as for match().
+    inline void masks(const char* base, size_t offset, size_t size, Masks& masks) {
+      size_t len = size - offset;
+      if (len >= STOMP_SCAN_BLOCK) {
+        activeKernel->masks(base + offset, masks);
+      } else if (size >= STOMP_SCAN_BLOCK) {
+        activeKernel->masks(base + size - STOMP_SCAN_BLOCK, masks);
+        masks.newline >>= STOMP_SCAN_BLOCK - len;
+        masks.colon >>= STOMP_SCAN_BLOCK - len;
+      } else {
+        char block[STOMP_SCAN_BLOCK];
+        std::memcpy(block, base + offset, len);
+        std::memset(block + len, 1, STOMP_SCAN_BLOCK - len);
+        activeKernel->masks(block, masks);
+      }
+    }
+    // The first c in [p, end), or end.
+    inline const char* find(const char* p, const char* end, char c) {
+      const char* found = static_cast<const char*>(std::memchr(p, c, end - p));
+      return found? found: end;
+    }
+
+    // Call fn(key, value) for each header line of block, in order, up to the empty line that
+    // ends the headers. Returns the offset past that line (the body), or the size of block
+    // if there is none. Line breaks and the first colon of each line come from the block
+    // masks, so there is no per-byte loop; later colons in a value are never visited. A CR
+    // before the LF is dropped, and a line without a colon is a key with an empty value.
+    template <typename Fn>
+    size_t forEachHeader(std::string_view block, Fn&& fn) {
+      const char* base = block.data();
+      const size_t size = block.size();
+      const size_t none = size;
+      size_t lineStart {0};
+      size_t colon {none};
+      // false on the empty line
+      auto line = [&](size_t eol){
+        size_t end = (eol > lineStart && base[eol-1] == '\r')? eol - 1: eol;
+        if (end == lineStart) return false;
+        if (colon >= end) {
+          fn(std::string_view {base + lineStart, end - lineStart}, std::string_view {});
+        } else {
+          fn(std::string_view {base + lineStart, colon - lineStart}, std::string_view {base + colon + 1, end - colon - 1});
+        }
+        return true;
+      };
+      for (size_t offset=0; offset<size; offset+=STOMP_SCAN_BLOCK) {
+        Masks found;
+        masks(base, offset, size, found);
+        uint64_t newlines = found.newline;
+        // colons at or past the start of the current line
+        auto colonsFrom = [&](){
+          if (lineStart <= offset) return found.colon;
+          if (lineStart - offset >= STOMP_SCAN_BLOCK) return uint64_t {0};
+          return found.colon & (~uint64_t {0} << (lineStart - offset));
+        };
+        while (newlines != 0) {
+          unsigned bit = lowestBit(newlines);
+          newlines &= newlines - 1;
+          if (colon == none) {
+            uint64_t colons = colonsFrom() & ((uint64_t {1} << bit) - 1);
+            if (colons != 0) colon = offset + lowestBit(colons);
+          }
+          if (!line(offset + bit)) return offset + bit + 1;
+          lineStart = offset + bit + 1;
+          colon = none;
+        }
+        if (colon == none) {
+          uint64_t colons = colonsFrom();
+          if (colons != 0) colon = offset + lowestBit(colons);
+        }
+      }
+      if (lineStart < size) line(size);
+      return size;
+    }
+  }
+}
+
+#endif
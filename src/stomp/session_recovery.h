@@ -0,0 +1,139 @@
+#ifndef STOMP_SESSION_RECOVERY_H
+#define STOMP_SESSION_RECOVERY_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+#include "listener.h"
+#include "base_transport.h"
+
+namespace stomp {
+  class SessionRecovery : public ConnectionListener {
+    // Restores a session after the transport reconnects by itself. Watching the frames the
+    // connection sends, it keeps the CONNECT, the subscriptions still active and the frames
+    // sent with a receipt that has not arrived yet. When the transport is connected again
+    // it sends all of them as one batch, so the session is back after one round trip
+    // however many subscriptions there are. Sending DISCONNECT ends the session.
+  protected:
+    // ordered by when each frame was first sent, and indexed by key
+    struct Registry {
+      std::map<uint64_t,FramePtr> frames {};
+      std::unordered_map<std::string,uint64_t> keys {};
+      void add(const std::string& key, FramePtr frame, uint64_t seq) {
+        auto [found, added] = keys.emplace(key, seq);
+        frames[found->second] = std::move(frame);
+      }
+      void remove(const std::string& key) {
+        auto found = keys.find(key);
+        if (found == keys.end()) return;
+        frames.erase(found->second);
+        keys.erase(found);
+      }
+      void clear() {
+        frames.clear();
+        keys.clear();
+      }
+    };
+    std::weak_ptr<BaseTransport> transport_;
+    std::mutex mutex_ {};
+    FramePtr connect_ {};
+    Registry subscriptions_ {};
+    Registry unconfirmed_ {};
+    uint64_t seq_ {0};
+  public:
+    SessionRecovery(std::weak_ptr<BaseTransport> transport) : transport_ {std::move(transport)} {}
+    virtual void onSend(FramePtr frame) {
+      auto transport = transport_.lock();
+      bool replaying = transport && transport->isReconnecting();
+      std::lock_guard<std::mutex> lock {mutex_};
+      const Headers& headers = frame->getHeaders();
+      switch (frame->getType()) {
+        case FrameType::Connect:
+        case FrameType::Stomp:
+          // a new session, unless this is the replay of the old one
+          if (!replaying) this->clear();
+          connect_ = frame;
+          break;
+        case FrameType::Disconnect:
+          this->clear();
+          break;
+        case FrameType::Subscribe:
+          subscriptions_.add(this->subscriptionKey(headers), frame, seq_++);
+          break;
+        case FrameType::Unsubscribe:
+          if (headers.has(HeaderId::Id)) {
+            subscriptions_.remove(this->subscriptionKey(headers));
+          } else {
+            this->unsubscribeDestination(headers.get(HeaderId::Destination));
+          }
+          break;
+        case FrameType::Send:
+          if (headers.has(HeaderId::Receipt)) unconfirmed_.add(headers.get(HeaderId::Receipt), frame, seq_++);
+          break;
+        default:
+          break;
+      }
+    }
+    virtual void onReceipt(FramePtr frame) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      unconfirmed_.remove(frame->getReceiptIdHeader());
+    }
+    virtual void onError(FramePtr frame) {
+      if (!frame->getHeaders().has(HeaderId::ReceiptId)) return;
+      std::lock_guard<std::mutex> lock {mutex_};
+      unconfirmed_.remove(frame->getReceiptIdHeader());
+    }
+    // Called again once the transport has reconnected: replay the session.
+    virtual void onConnecting(HostAndPortPtr /*hostAndPort*/) {
+      auto transport = transport_.lock();
+      if (!transport || !transport->isReconnecting()) return;
+      std::vector<FramePtr> frames {};
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        if (!connect_) return;
+        frames.reserve(1 + subscriptions_.frames.size() + unconfirmed_.frames.size());
+        frames.push_back(connect_);
+        for (auto& [seq, frame] : subscriptions_.frames) frames.push_back(frame);
+        for (auto& [seq, frame] : unconfirmed_.frames) frames.push_back(frame);
+      }
+      transport->transmitBatch(frames);
+    }
+    size_t getSubscriptionCount() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      return subscriptions_.frames.size();
+    }
+    size_t getUnconfirmedCount() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      return unconfirmed_.frames.size();
+    }
+  protected:
+    void clear() {
+      connect_ = nullptr;
+      subscriptions_.clear();
+      unconfirmed_.clear();
+    }
+    // STOMP 1.0 subscriptions may have no id, and are then known by their destination.
+    std::string subscriptionKey(const Headers& headers) const {
+      if (headers.has(HeaderId::Id)) return "id:" + headers.get(HeaderId::Id);
+      return "destination:" + headers.get(HeaderId::Destination);
+    }
+    void unsubscribeDestination(const std::string& destination) {
+      for (auto it = subscriptions_.frames.begin(); it != subscriptions_.frames.end();) {
+        if (it->second->getHeaders().get(HeaderId::Destination) == destination) {
+          subscriptions_.keys.erase(this->subscriptionKey(it->second->getHeaders()));
+          it = subscriptions_.frames.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+  };
+  using SessionRecoveryPtr = std::shared_ptr<SessionRecovery>;
+}
+
+#endif
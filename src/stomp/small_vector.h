@@ -0,0 +1,137 @@
+#ifndef STOMP_SMALL_VECTOR_H
+#define STOMP_SMALL_VECTOR_H
+
+#include <cstddef>
+#include <new>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <initializer_list>
+
+namespace stomp {
+  template <typename T, size_t N>
+  class SmallVector {
+    // A vector which keeps its first N elements inline and only goes to the heap when it
+    // grows beyond that. Frames rarely carry more than a handful of headers, so the common
+    // case never allocates.
+  protected:
+    alignas(T) unsigned char inline_[N * sizeof(T)];
+    T* data_ {reinterpret_cast<T*>(inline_)};
+    size_t size_ {0};
+    size_t capacity_ {N};
+  public:
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    SmallVector() {}
+    SmallVector(std::initializer_list<T> values) {
+      this->reserve(values.size());
+      for (auto& value : values) this->push_back(value);
+    }
+    SmallVector(const SmallVector& other) {
+      this->reserve(other.size_);
+      for (auto& value : other) this->push_back(value);
+    }
+    SmallVector(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+      this->moveFrom(std::move(other));
+    }
+    ~SmallVector() {
+      this->clear();
+      this->releaseHeap();
+    }
+    SmallVector& operator=(const SmallVector& other) {
+      if (this != &other) {
+        this->clear();
+        this->reserve(other.size_);
+        for (auto& value : other) this->push_back(value);
+      }
+      return *this;
+    }
+    SmallVector& operator=(SmallVector&& other) noexcept(std::is_nothrow_move_constructible_v<T>) {
+      if (this != &other) {
+        this->clear();
+        this->releaseHeap();
+        this->moveFrom(std::move(other));
+      }
+      return *this;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+    T& operator[](size_t i) { return data_[i]; }
+    const T& operator[](size_t i) const { return data_[i]; }
+    T& back() { return data_[size_-1]; }
+    const T& back() const { return data_[size_-1]; }
+
+    void reserve(size_t capacity) {
+      if (capacity <= capacity_) return;
+      T* heap = static_cast<T*>(::operator new(capacity * sizeof(T)));
+      for (size_t i=0; i<size_; i++) {
+        new (heap + i) T(std::move(data_[i]));
+        data_[i].~T();
+      }
+      this->releaseHeap();
+      data_ = heap;
+      capacity_ = capacity;
+    }
+    template <typename... Args>
+    T& emplace_back(Args&&... args) {
+      if (size_ == capacity_) this->reserve(2 * capacity_);
+      T* value = new (data_ + size_) T(std::forward<Args>(args)...);
+      size_++;
+      return *value;
+    }
+    void push_back(const T& value) { this->emplace_back(value); }
+    void push_back(T&& value) { this->emplace_back(std::move(value)); }
+    void pop_back() {
+      data_[--size_].~T();
+    }
+    iterator erase(iterator pos) {
+      for (iterator it = pos; it + 1 != this->end(); ++it) {
+        *it = std::move(*(it + 1));
+      }
+      this->pop_back();
+      return pos;
+    }
+    void clear() {
+      for (size_t i=0; i<size_; i++) data_[i].~T();
+      size_ = 0;
+    }
+  protected:
+    bool isInline() const { return data_ == reinterpret_cast<const T*>(inline_); }
+    void releaseHeap() {
+      if (!this->isInline()) {
+        ::operator delete(data_);
+        data_ = reinterpret_cast<T*>(inline_);
+        capacity_ = N;
+      }
+    }
+    void moveFrom(SmallVector&& other) {
+      if (other.isInline()) {
+        for (size_t i=0; i<other.size_; i++) {
+          new (data_ + i) T(std::move(other.data_[i]));
+        }
+        size_ = other.size_;
+        other.clear();
+      } else {
+        // steal the heap block
+        data_ = other.data_;
+        size_ = other.size_;
+        capacity_ = other.capacity_;
+        other.data_ = reinterpret_cast<T*>(other.inline_);
+        other.size_ = 0;
+        other.capacity_ = N;
+      }
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef STOMP_SUBSCRIPTION_TABLE_H
+#define STOMP_SUBSCRIPTION_TABLE_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include "frame_view.h"
+
+namespace stomp {
+  // Called on the receiving thread with each MESSAGE for the subscription.
+  using MessageHandler = std::function<void(const FrameView& message)>;
+
+  class DeliveryTracker {
+    // Told of every MESSAGE as it is delivered, whether to the handler of its subscription
+    // or to the listeners, e.g. to keep track of what is yet to be acknowledged.
+  public:
+    virtual ~DeliveryTracker() = default;
+    virtual void onDelivered(const FrameView& message) = 0;
+  };
+
+  struct Subscription {
+    std::string id;
+    std::string destination;
+    MessageHandler handler;
+  };
+  using SubscriptionPtr = std::shared_ptr<const Subscription>;
+
+  class SubscriptionTable {
+    // Message handlers by subscription id, so a MESSAGE goes to its subscriber with one
+    // hash lookup instead of to every listener. Kept copy-on-write like ListenerRegistry:
+    // the receiver looks up in an immutable snapshot without locking, and subscribe and
+    // unsubscribe publish a new one. Keys are views of the ids held by the entries, so a
+    // lookup does not allocate.
+  public:
+    using Table = std::unordered_map<std::string_view,SubscriptionPtr>;
+    using TablePtr = std::shared_ptr<const Table>;
+  protected:
+    TablePtr table_ {std::make_shared<const Table>()};
+    std::mutex updateMutex_ {};
+  public:
+    // Route messages for the subscription id to handler, replacing any handler it had.
+    void add(std::string id, std::string destination, MessageHandler handler) {
+      auto subscription = std::make_shared<const Subscription>(Subscription {std::move(id), std::move(destination), std::move(handler)});
+      std::lock_guard<std::mutex> lock {updateMutex_};
+      auto next = std::make_shared<Table>(*table_);
+      next->erase(subscription->id);
+      next->emplace(subscription->id, subscription);
+      std::atomic_store(&table_, TablePtr {std::move(next)});
+    }
+    void remove(std::string_view id) {
+      std::lock_guard<std::mutex> lock {updateMutex_};
+      if (table_->count(id) == 0) return;
+      auto next = std::make_shared<Table>(*table_);
+      next->erase(id);
+      std::atomic_store(&table_, TablePtr {std::move(next)});
+    }
+    // Remove every subscription to destination.
+    void removeDestination(std::string_view destination) {
+      std::lock_guard<std::mutex> lock {updateMutex_};
+      auto next = std::make_shared<Table>(*table_);
+      for (auto it = next->begin(); it != next->end();) {
+        if (it->second->destination == destination) {
+          it = next->erase(it);
+        } else {
+          ++it;
+        }
+      }
+      if (next->size() == table_->size()) return;
+      std::atomic_store(&table_, TablePtr {std::move(next)});
+    }
+    // The subscription with the given id, or nullptr.
+    SubscriptionPtr find(std::string_view id) const {
+      TablePtr current {std::atomic_load(&table_)};
+      auto found = current->find(id);
+      return found != current->end()? found->second: nullptr;
+    }
+    bool empty() const { return std::atomic_load(&table_)->empty(); }
+    size_t size() const { return std::atomic_load(&table_)->size(); }
+  };
+}
+
+#endif
@@ -0,0 +1,197 @@
+#ifndef STOMP_TIMER_WHEEL_H
+#define STOMP_TIMER_WHEEL_H
+
+#include <vector>
+#include <unordered_set>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+
+// milliseconds per tick of the shared wheel
+#define STOMP_WHEEL_TICK_MS 10
+// slots per level, as a power of two, and levels: 4 levels of 64 ticks of 10ms reach 46 hours
+#define STOMP_WHEEL_SLOT_BITS 6
+#define STOMP_WHEEL_LEVELS 4
+
+namespace stomp {
+  class TimerWheel {
+    // One thread running the timers of every connection, e.g. for heart-beats. The timers
+    // sit in a hierarchical wheel: level 0 has a slot for each of the next 64 ticks, and
+    // each level above covers 64 times the span of the one below with slots as many times
+    // wider, whose timers move down a level when their slot comes round. Scheduling and
+    // cancelling take constant time however many timers there are, and the thread only
+    // wakes each tick while there are timers. Tasks run on the wheel thread, one at a
+    // time, so they must not block for long.
+  public:
+    using Task = std::function<void()>;
+    using Clock = std::chrono::steady_clock;
+  protected:
+    static constexpr unsigned SlotBits = STOMP_WHEEL_SLOT_BITS;
+    static constexpr uint64_t Slots = uint64_t {1} << SlotBits;
+    static constexpr unsigned Levels = STOMP_WHEEL_LEVELS;
+    struct Timer {
+      uint64_t id;
+      // the tick it is due at
+      uint64_t due;
+      Task task;
+    };
+    const Clock::duration resolution_;
+    const Clock::time_point start_ {Clock::now()};
+    std::mutex mutex_ {};
+    std::condition_variable condition_ {};
+    std::vector<Timer> slots_[Levels][Slots] {};
+    // scheduled and not cancelled; cancelled timers are dropped when they come round
+    std::unordered_set<uint64_t> pending_ {};
+    // ticks processed since start_
+    uint64_t tick_ {0};
+    uint64_t nextId_ {1};
+    bool running_ {false};
+    std::thread thread_ {};
+  public:
+    TimerWheel(std::chrono::milliseconds resolution = std::chrono::milliseconds(STOMP_WHEEL_TICK_MS)) :
+      resolution_ {std::max<Clock::duration>(resolution, std::chrono::milliseconds(1))} {}
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+    virtual ~TimerWheel() {
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        running_ = false;
+      }
+      condition_.notify_all();
+      if (thread_.joinable()) thread_.join();
+    }
+    // The wheel shared by every connection in the process.
+    static std::shared_ptr<TimerWheel> shared() {
+      static std::shared_ptr<TimerWheel> wheel {std::make_shared<TimerWheel>()};
+      return wheel;
+    }
+    Clock::duration getResolution() const { return resolution_; }
+    // Run task once, delay from now (rounded up to a whole tick). Returns an id for cancel().
+    uint64_t schedule(Clock::duration delay, Task task) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      if (!running_) {
+        running_ = true;
+        thread_ = std::thread([this](){ run(); });
+      }
+      auto elapsed = Clock::now() - start_;
+      uint64_t now = elapsed / resolution_;
+      if (pending_.empty() && now > tick_) {
+        // nothing was due while the thread slept: catch up without visiting every tick
+        for (auto& level : slots_) {
+          for (auto& slot : level) slot.clear();
+        }
+        tick_ = now;
+      }
+      // the first tick at or after the time it is due
+      auto when = elapsed + std::clamp<Clock::duration>(delay, Clock::duration::zero(), std::chrono::hours(24 * 365));
+      uint64_t due = when / resolution_ + (when % resolution_ != Clock::duration::zero());
+      uint64_t id = nextId_++;
+      pending_.insert(id);
+      this->place(Timer {id, std::max(due, tick_ + 1), std::move(task)});
+      condition_.notify_one();
+      return id;
+    }
+    // Cancel a timer. A task the wheel thread has already started may still run.
+    void cancel(uint64_t id) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      pending_.erase(id);
+    }
+    // Number of timers scheduled.
+    size_t size() {
+      std::lock_guard<std::mutex> lock {mutex_};
+      return pending_.size();
+    }
+  protected:
+    // Put a timer in the lowest level whose span reaches its tick, with mutex_ held.
+    void place(Timer timer) {
+      if (pending_.count(timer.id) == 0) return;
+      uint64_t due = std::clamp(timer.due, tick_, tick_ + (uint64_t {1} << (SlotBits * Levels)) - 1);
+      unsigned level {0};
+      while (level + 1 < Levels && due - tick_ >= (uint64_t {1} << (SlotBits * (level + 1)))) level++;
+      slots_[level][(due >> (SlotBits * level)) & (Slots - 1)].push_back(std::move(timer));
+    }
+    // Move on one tick, with mutex_ held: bring the timers of the slots that have come
+    // round down a level, highest level first, then take the tasks due now.
+    void advance(std::vector<Task>& due) {
+      tick_++;
+      unsigned top {0};
+      while (top + 1 < Levels && (tick_ & ((uint64_t {1} << (SlotBits * (top + 1))) - 1)) == 0) top++;
+      for (unsigned level=top; level>0; level--) {
+        std::vector<Timer> timers {};
+        timers.swap(slots_[level][(tick_ >> (SlotBits * level)) & (Slots - 1)]);
+        for (auto& timer : timers) this->place(std::move(timer));
+      }
+      auto& slot = slots_[0][tick_ & (Slots - 1)];
+      for (auto& timer : slot) {
+        if (pending_.erase(timer.id) > 0) due.push_back(std::move(timer.task));
+      }
+      slot.clear();
+    }
+    // Wheel thread: waits for each tick while there are timers, and runs the tasks due.
+    void run() {
+      std::vector<Task> due {};
+      std::unique_lock<std::mutex> lock {mutex_};
+      while (running_) {
+        if (pending_.empty()) {
+          condition_.wait(lock);
+          continue;
+        }
+        auto next = start_ + resolution_ * static_cast<Clock::rep>(tick_ + 1);
+        if (Clock::now() < next) {
+          condition_.wait_until(lock, next);
+          continue;
+        }
+        this->advance(due);
+        if (due.empty()) continue;
+        lock.unlock();
+        for (auto& task : due) task();
+        due.clear();
+        lock.lock();
+      }
+    }
+  };
+  using TimerWheelPtr = std::shared_ptr<TimerWheel>;
+
+  class WheelTimer {
+    // A timer on a TimerWheel that its owner arms and stops as its state changes, with a
+    // mutex of the owner's held. Stopping can't take back a task the wheel thread has
+    // already started, so each arming has a generation, which the task is given and
+    // checks with fire() under that mutex before doing anything.
+  protected:
+    TimerWheelPtr wheel_;
+    uint64_t id_ {0};
+    uint64_t generation_ {0};
+  public:
+    explicit WheelTimer(TimerWheelPtr wheel) : wheel_ {std::move(wheel)} {}
+    WheelTimer(const WheelTimer&) = delete;
+    WheelTimer& operator=(const WheelTimer&) = delete;
+    ~WheelTimer() { this->stop(); }
+    const TimerWheelPtr& getWheel() const { return wheel_; }
+    bool isArmed() const { return id_ != 0; }
+    // Run task with the generation armed, delay from now, in place of any armed before.
+    void arm(TimerWheel::Clock::duration delay, std::function<void(uint64_t)> task) {
+      this->stop();
+      id_ = wheel_->schedule(delay, [task = std::move(task), generation = generation_](){ task(generation); });
+    }
+    void stop() {
+      generation_++;
+      if (id_ != 0) wheel_->cancel(id_);
+      id_ = 0;
+    }
+    // From the task: whether generation is still the one armed, which then counts as fired.
+    bool fire(uint64_t generation) {
+      if (id_ == 0 || !this->isCurrent(generation)) return false;
+      id_ = 0;
+      return true;
+    }
+    // Whether neither stop() nor arm() has been called since the task for generation was armed.
+    bool isCurrent(uint64_t generation) const { return generation == generation_; }
+  };
+}
+
+#endif
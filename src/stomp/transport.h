@@ -6,10 +6,25 @@
 #include <memory>
 #include <algorithm>
 #include <cmath>
+#include <climits>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <cerrno>
+
+#include <sys/uio.h>
+#include <poll.h>
 
 #include "base_transport.h"
 #include "../socket/socket.h"
 
+// seconds before a connection attempt is given up
+#define STOMP_CONNECT_TIMEOUT 10.0
+// seconds before the next broker is tried alongside one that has not answered yet
+#define STOMP_CONNECT_STAGGER 0.25
+
 namespace stomp {
   using HostsAndPorts = std::vector<HostAndPortPtr>;
   using SocketPtr = std::shared_ptr<TCPSocket>;
@@ -24,12 +39,28 @@ namespace stomp {
     double reconnectSleepJitter_ {0.1};
     double reconnectSleepMax_ {60.0};
     int reconnectAttemptsMax_ {3};
+    double connectTimeout_ {STOMP_CONNECT_TIMEOUT};
+    double connectStagger_ {STOMP_CONNECT_STAGGER};
     SocketPtr socket {};
+    std::mutex sendMutex_ {};
+    OutboundBuffer outbound_ {};
+    bool corked_ {false};
+    // a limit flush told the kernel more would follow, so the end of it may be held back
+    bool held_ {false};
+    std::chrono::steady_clock::time_point heldSince_ {};
+    bool flusherRunning_ {false};
+    std::condition_variable flushCondition_ {};
+    std::thread flusher_ {};
   public:
     Transport(HostsAndPorts hostsAndPorts = {}, bool autoDecode = true, std::string encoding = "utf8") :
       BaseTransport {autoDecode, encoding}, hostsAndPorts_ {hostsAndPorts} {
         if (hostsAndPorts_.empty()) hostsAndPorts_.push_back(std::make_shared<HostAndPort>("localhost", 61613));
       }
+    virtual ~Transport() {
+      // the writer thread calls into this class, so stop it before the members go away
+      this->stopWriter();
+      this->stopFlusher();
+    }
     virtual bool isConnected() {
       return (socket != nullptr) && BaseTransport::isConnected();
     }
@@ -37,62 +68,357 @@ namespace stomp {
       running_ = false;
       // TODO maybe do socket shutdown
       currentHostAndPort_ = nullptr;
-      socket = nullptr;
-      this->notify(std::make_shared<Frame>(FRAME_DISCONNECTED, Headers {}, ""));
-    }
-    virtual void send(std::string content) {
-      if (socket) {
-        // TODO use socket semaphore
-        size_t numChars = content.size();
-        char buffer[numChars+1];
-        for (int i=0; i<numChars; i++) {
-          buffer[i] = content.c_str()[i];
-        }
-        buffer[numChars] = 0;
-        socket->send(buffer, numChars+1);
-      } else {
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        socket = nullptr;
+      }
+      if (!notifiedOnDisconnect_) {
+        notifiedOnDisconnect_ = true;
+        this->notify(FramePool::local()->make(FRAME_DISCONNECTED));
+      }
+    }
+    using BaseTransport::send;
+    virtual void send(std::string_view head, std::string_view body) {
+      std::lock_guard<std::mutex> lock {sendMutex_};
+      this->sendLocked(head, body);
+    }
+    // Send with sendMutex_ held.
+    void sendLocked(std::string_view head, std::string_view body) {
+      if (!socket) {
         throw SocketException {"Not connected!"};
       }
+      if (!flushPolicy_.coalesces() && !batching_) {
+        this->write(head, body, false);
+        return;
+      }
+      if (outbound_.size() + head.size() + body.size() + 1 > flushPolicy_.maxBytes) {
+        // too big to buffer: write it out behind whatever is pending, without copying it
+        this->write(head, body, this->mayHold());
+        return;
+      }
+      bool wasEmpty = outbound_.empty();
+      outbound_.append(head, body);
+      if ((flushPolicy_.coalesces() && outbound_.frames() >= flushPolicy_.maxFrames) || outbound_.size() >= flushPolicy_.maxBytes) {
+        this->write({}, {}, this->mayHold());
+      } else if (wasEmpty && flushPolicy_.maxDelay.count() > 0) {
+        this->armFlushDeadline();
+      }
+    }
+    virtual void setFlushPolicy(FlushPolicy policy) {
+      this->flush();
+      this->stopFlusher();
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        flushPolicy_ = policy;
+      }
+      if (policy.coalesces() && policy.maxDelay.count() > 0) {
+        flusherRunning_ = true;
+        flusher_ = std::thread([this](){ flusherLoop(); });
+      }
+    }
+    virtual void flush() {
+      std::lock_guard<std::mutex> lock {sendMutex_};
+      if (socket && (!outbound_.empty() || held_)) this->write({}, {}, false);
+    }
+    virtual void sendHeartbeat() {
+      std::unique_lock<std::mutex> lock {sendMutex_, std::try_to_lock};
+      // another thread is writing, which will do as well as an EOL
+      if (!lock || !socket) return;
+      // buffered frames do as well as an EOL
+      if (outbound_.empty()) outbound_.appendHeartbeat();
+      if (this->tryFlush()) this->markSent();
+    }
+    virtual void abortConnection() {
+      std::lock_guard<std::mutex> lock {sendMutex_};
+      if (socket) socket->shutdown();
     }
     virtual void receive() {
-      int bytesRead = socket->recv(receiveBuf+bufEnd, STOMP_BUF_SIZE);
-      bufEnd += bytesRead;
+      auto [buffer, size] = parser_.prepare(STOMP_BUF_SIZE);
+      int bytesRead;
+      try {
+        bytesRead = socket->recv(buffer, static_cast<int>(std::min<size_t>(size, INT_MAX)));
+      } catch (SocketException& e) {
+        bytesRead = 0;
+      }
+      if (bytesRead <= 0) {
+        // the server closed the connection, or it broke: stop the receiver loop rather than spin on it
+        this->connectionLost();
+        return;
+      }
+      parser_.commit(bytesRead);
+    }
+    // The receiving side found the connection closed or broken: connect again if set to,
+    // or else disconnect.
+    void connectionLost() {
+      if (running_ && autoReconnect_) {
+        this->reconnect();
+      } else if (running_) {
+        this->disconnectSocket();
+      }
+    }
+    // The connection was lost: tell the listeners, connect again and go on receiving on this
+    // thread. Listeners are told CONNECTING once it is back, which is when a SessionRecovery
+    // replays the session; transmits from other threads wait until they have been told.
+    // If no broker can be reached, this gives up as disconnectSocket() does.
+    virtual void reconnect() {
+      reconnecting_ = true;
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        socket = nullptr;
+        outbound_.clear();
+        corked_ = held_ = false;
+      }
+      currentHostAndPort_ = nullptr;
+      // whatever was half received belongs to the old connection
+      parser_.reset();
+      this->notify(FramePool::local()->make(FRAME_DISCONNECTED));
+      try {
+        this->attemptConnection();
+      } catch (SocketException& e) {
+        if (replayLock_) replayLock_.unlock();
+        reconnecting_ = false;
+        notifiedOnDisconnect_ = true;
+        running_ = false;
+        receipts_.failAll();
+        return;
+      }
+      this->notify(FramePool::local()->make(FRAME_CONNECTING));
+      if (replayLock_) replayLock_.unlock();
+      reconnecting_ = false;
     }
     virtual void cleanup() {
+      this->stopFlusher();
       socket = nullptr;
     }
+  protected:
+    // Write the buffered frames followed by the given frame (if any), with sendMutex_ held.
+    // more is set when flushing because a limit was reached rather than on an explicit
+    // flush() or deadline, and there is a flusher to push out what the kernel holds back.
+    virtual void write(std::string_view head, std::string_view body, bool more) {
+      static const char terminator {'\0'};
+      iovec buffers[4];
+      int count = 0;
+      if (!outbound_.empty()) {
+        buffers[count++] = {const_cast<char*>(outbound_.data().data()), outbound_.size()};
+      }
+      if (!head.empty()) {
+        buffers[count++] = {const_cast<char*>(head.data()), head.size()};
+        buffers[count++] = {const_cast<char*>(body.data()), body.size()};
+        buffers[count++] = {const_cast<char*>(&terminator), 1};
+      }
+      bool msgMore = more && flushPolicy_.cork == FlushPolicy::Cork::MsgMore;
+      try {
+        if (more && flushPolicy_.cork == FlushPolicy::Cork::TcpCork && !corked_) {
+          socket->setCork(true);
+          corked_ = true;
+        }
+        if (count > 0) socket->sendv(buffers, count, msgMore);
+      } catch (SocketException& e) {
+        // don't replay half-written frames on a later flush
+        outbound_.clear();
+        throw;
+      }
+      outbound_.clear();
+      if (more && flushPolicy_.cork != FlushPolicy::Cork::None) {
+        if (!held_) {
+          heldSince_ = std::chrono::steady_clock::now();
+          held_ = true;
+          flushCondition_.notify_all();
+        }
+      } else if (held_) {
+        // a write without MSG_MORE pushes out what it held; uncorking does otherwise
+        if (corked_ || count == 0) socket->setCork(false);
+        corked_ = held_ = false;
+      }
+    }
+    // Write as much of the buffered frames as the socket takes at once, with sendMutex_
+    // held; the rest stays buffered for the next write. Returns whether anything was written.
+    virtual bool tryFlush() {
+      iovec buffer {const_cast<char*>(outbound_.data().data()), outbound_.size()};
+      long written;
+      try {
+        written = socket->trySendv(&buffer, 1);
+      } catch (SocketException& e) {
+        outbound_.clear();
+        throw;
+      }
+      outbound_.consume(written);
+      if (written == 0) return false;
+      if (held_) {
+        // as a write without MSG_MORE would
+        if (corked_) socket->setCork(false);
+        corked_ = held_ = false;
+      }
+      return true;
+    }
+    // Whether a limit flush may tell the kernel more follows, with sendMutex_ held: only
+    // when the flusher will push out the end of it, should nothing follow.
+    bool mayHold() const {
+      return flushPolicy_.coalesces() && flushPolicy_.maxDelay.count() > 0;
+    }
+    // Called with sendMutex_ held when a frame is buffered into an empty buffer, to have it
+    // flushed flushPolicy_.maxDelay later.
+    virtual void armFlushDeadline() {
+      flushCondition_.notify_all();
+    }
+    // Flushes the buffer once the oldest buffered frame has waited flushPolicy_.maxDelay,
+    // and pushes out the end of a limit flush held back by the kernel as long.
+    void flusherLoop() {
+      std::unique_lock<std::mutex> lock {sendMutex_};
+      while (flusherRunning_) {
+        if (outbound_.empty() && !held_) {
+          flushCondition_.wait(lock);
+          continue;
+        }
+        // held back before anything now buffered was queued
+        auto deadline = (held_? heldSince_: outbound_.firstQueued()) + flushPolicy_.maxDelay;
+        if (std::chrono::steady_clock::now() < deadline) {
+          flushCondition_.wait_until(lock, deadline);
+          continue;
+        }
+        try {
+          if (socket) this->write({}, {}, false);
+        } catch (SocketException& e) {
+          // the receiver thread will see the broken connection
+        }
+      }
+    }
+    void stopFlusher() {
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        flusherRunning_ = false;
+      }
+      flushCondition_.notify_all();
+      if (flusher_.joinable()) flusher_.join();
+    }
+  public:
     double rand() {
       return 1.0 * std::rand() / RAND_MAX;
     }
-    // Try connecting to the (host, port) tuples specified at construction time.
+    // Try connecting to the (host, port) tuples specified at construction time. Each round
+    // races them (see raceConnections()); after a round in which none connected, wait with
+    // exponential backoff before the next.
     virtual void attemptConnection() {
       connectionError_ = false;
       int sleepExp {1};
       int connectCount {0};
-      while (running_ && socket == nullptr && (connectCount < reconnectAttemptsMax_ || reconnectAttemptsMax_ == -1)) {
-        for (auto hostAndPort : hostsAndPorts_) {
-          try {
-            socket = std::make_shared<TCPSocket>(hostAndPort->first, hostAndPort->second);
-            currentHostAndPort_ = hostAndPort;
-            break;
-          } catch (SocketException& e) {
-            socket = nullptr;
-            connectCount++;
-          }
+      auto attemptsLeft = [&](){ return connectCount < reconnectAttemptsMax_ || reconnectAttemptsMax_ == -1; };
+      while (running_ && socket == nullptr && attemptsLeft()) {
+        auto [connected, hostAndPort] = this->raceConnections();
+        if (connected) {
+          // released by reconnect() once the session has been replayed
+          if (reconnecting_) replayLock_ = std::unique_lock<std::recursive_mutex> {transmitMutex_};
+          std::lock_guard<std::mutex> lock {sendMutex_};
+          socket = connected;
+          currentHostAndPort_ = hostAndPort;
+          break;
         }
-        if (socket == nullptr) {
-          int sleepDuration = (std::min(reconnectSleepMax_,
-              ((reconnectSleepInitial_ / (1.0 + reconnectSleepIncrease_))
-               * std::pow(1.0 + reconnectSleepIncrease_, sleepExp)))
-          * (1.0 + rand() * reconnectSleepJitter_));
-          // TODO sleep for sleepDuration
-          if (sleepDuration < reconnectSleepMax_) sleepExp++;
+        connectCount += static_cast<int>(hostsAndPorts_.size());
+        if (running_ && attemptsLeft()) {
+          std::this_thread::sleep_for(std::chrono::duration<double>(this->reconnectDelay(sleepExp)));
         }
       }
       if (socket == nullptr) {
         throw SocketException {"Connection failed!"};
       }
     }
+    // Give up on a connection attempt after timeout seconds, and start the next broker's
+    // attempt if the previous one has not finished after stagger seconds.
+    void setConnectTimeout(double timeout, double stagger = STOMP_CONNECT_STAGGER) {
+      connectTimeout_ = timeout;
+      connectStagger_ = stagger;
+    }
+  protected:
+    using Candidates = std::vector<std::pair<SocketAddress,HostAndPortPtr>>;
+    // Seconds to wait after the sleepExp'th round of connection attempts failed, with
+    // exponential backoff and jitter; moves sleepExp on to the next round.
+    double reconnectDelay(int& sleepExp) {
+      double sleepDuration = (std::min(reconnectSleepMax_,
+          ((reconnectSleepInitial_ / (1.0 + reconnectSleepIncrease_))
+           * std::pow(1.0 + reconnectSleepIncrease_, sleepExp)))
+      * (1.0 + rand() * reconnectSleepJitter_));
+      if (sleepDuration < reconnectSleepMax_) sleepExp++;
+      return sleepDuration;
+    }
+    // Every address of every broker, in the order they are tried.
+    Candidates resolveCandidates() {
+      Candidates candidates {};
+      for (auto& hostAndPort : hostsAndPorts_) {
+        try {
+          for (auto& address : Resolver::resolve(hostAndPort->first, hostAndPort->second)) {
+            candidates.emplace_back(address, hostAndPort);
+          }
+        } catch (SocketException& e) {
+          // unknown name: try the other brokers
+        }
+      }
+      return candidates;
+    }
+    // One round of non-blocking connection attempts, happy eyeballs style: every address of
+    // every broker (IPv6 and IPv4) is tried in order, the next one starting when the previous
+    // has failed or connectStagger_ has passed, and the first to connect wins. Returns the
+    // connected socket, back in blocking mode, and its broker; or nullptrs if every attempt
+    // failed or timed out.
+    std::pair<SocketPtr,HostAndPortPtr> raceConnections() {
+      using Clock = std::chrono::steady_clock;
+      struct Attempt {
+        SocketPtr socket;
+        HostAndPortPtr hostAndPort;
+        Clock::time_point deadline;
+      };
+      auto timeout = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(connectTimeout_));
+      auto stagger = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(connectStagger_));
+      Candidates candidates {this->resolveCandidates()};
+      std::vector<Attempt> attempts {};
+      std::vector<pollfd> polls {};
+      size_t next {0};
+      Clock::time_point nextStart {Clock::now()};
+      while (running_ && (next < candidates.size() || !attempts.empty())) {
+        auto now = Clock::now();
+        if (next < candidates.size() && (attempts.empty() || now >= nextStart)) {
+          auto& [address, hostAndPort] = candidates[next++];
+          nextStart = now + stagger;
+          try {
+            auto candidate = std::make_shared<TCPSocket>(address);
+            if (candidate->startConnect(address)) {
+              candidate->setBlocking(true);
+              return {candidate, hostAndPort};
+            }
+            attempts.push_back({candidate, hostAndPort, now + timeout});
+          } catch (SocketException& e) {
+            // refused straight away: go on to the next address
+          }
+          continue;
+        }
+        auto wakeup = next < candidates.size()? nextStart: Clock::time_point::max();
+        polls.clear();
+        for (auto& attempt : attempts) {
+          wakeup = std::min(wakeup, attempt.deadline);
+          polls.push_back({attempt.socket->getDescriptor(), POLLOUT, 0});
+        }
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(wakeup - now).count();
+        int ready = ::poll(polls.data(), polls.size(), static_cast<int>(std::clamp<long long>(wait, 0, INT_MAX)));
+        if (ready < 0 && errno != EINTR) {
+          throw SocketException {"Wait for connection failed (poll())", true};
+        }
+        now = Clock::now();
+        std::vector<Attempt> pending {};
+        for (size_t i=0; i<attempts.size(); i++) {
+          if (ready > 0 && polls[i].revents != 0) {
+            try {
+              attempts[i].socket->finishConnect();
+              attempts[i].socket->setBlocking(true);
+              return {attempts[i].socket, attempts[i].hostAndPort};
+            } catch (SocketException& e) {
+              continue;
+            }
+          }
+          if (now < attempts[i].deadline) pending.push_back(std::move(attempts[i]));
+        }
+        attempts.swap(pending);
+      }
+      return {nullptr, nullptr};
+    }
   };
 }
 
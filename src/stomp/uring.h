@@ -0,0 +1,256 @@
+#ifndef STOMP_URING_H
+#define STOMP_URING_H
+
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <system_error>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "buffer.h"
+
+namespace stomp {
+  class Uring {
+    // A minimal io_uring, straight on the kernel interface: the submission and completion
+    // rings, plus registration of buffers and files. Not thread-safe; callers serialize
+    // access to the submission side, and completions are reaped by one thread.
+  protected:
+    int fd_ {-1};
+    io_uring_params params_ {};
+    void* sqRing_ {MAP_FAILED};
+    size_t sqRingSize_ {0};
+    void* cqRing_ {MAP_FAILED};
+    size_t cqRingSize_ {0};
+    io_uring_sqe* sqes_ {};
+    size_t sqesSize_ {0};
+    unsigned* sqHead_ {};
+    unsigned* sqTail_ {};
+    unsigned* sqArray_ {};
+    unsigned* sqFlags_ {};
+    unsigned sqMask_ {0};
+    unsigned* cqHead_ {};
+    unsigned* cqTail_ {};
+    unsigned cqMask_ {0};
+    io_uring_cqe* cqes_ {};
+    // entries handed out by getSqe() but not yet passed to the kernel
+    unsigned sqPending_ {0};
+  public:
+    Uring(unsigned entries, unsigned flags = 0) {
+      params_.flags = flags;
+      fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params_));
+      if (fd_ < 0) throw std::system_error {errno, std::generic_category(), "io_uring_setup"};
+      sqRingSize_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+      cqRingSize_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+      bool singleMap = params_.features & IORING_FEAT_SINGLE_MMAP;
+      if (singleMap) sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+      sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+      if (sqRing_ == MAP_FAILED) this->fail("mmap");
+      if (singleMap) {
+        cqRing_ = sqRing_;
+      } else {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) this->fail("mmap");
+      }
+      sqesSize_ = params_.sq_entries * sizeof(io_uring_sqe);
+      void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+      if (sqes == MAP_FAILED) this->fail("mmap");
+      sqes_ = static_cast<io_uring_sqe*>(sqes);
+      char* sq = static_cast<char*>(sqRing_);
+      sqHead_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.head);
+      sqTail_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.tail);
+      sqArray_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.array);
+      sqFlags_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.flags);
+      sqMask_ = *reinterpret_cast<unsigned*>(sq + params_.sq_off.ring_mask);
+      char* cq = static_cast<char*>(cqRing_);
+      cqHead_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.head);
+      cqTail_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.tail);
+      cqMask_ = *reinterpret_cast<unsigned*>(cq + params_.cq_off.ring_mask);
+      cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params_.cq_off.cqes);
+    }
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+    ~Uring() {
+      this->release();
+    }
+    int getDescriptor() const { return fd_; }
+    // The next free submission entry, zeroed. If the queue is full, the entries already
+    // in it are submitted first.
+    io_uring_sqe* getSqe() {
+      unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+      unsigned tail = *sqTail_ + sqPending_;
+      while (tail - head >= params_.sq_entries) {
+        this->submit();
+        head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+        tail = *sqTail_ + sqPending_;
+      }
+      io_uring_sqe* sqe = &sqes_[tail & sqMask_];
+      memset(sqe, 0, sizeof(*sqe));
+      sqArray_[tail & sqMask_] = tail & sqMask_;
+      sqPending_++;
+      return sqe;
+    }
+    // Pass the prepared entries to the kernel and, with waitFor, wait for that many
+    // completions in the same system call. With IORING_SETUP_SQPOLL the kernel thread
+    // picks entries up by itself, so there is only a system call to wait or to wake it.
+    // Returns false if interrupted.
+    bool submit(unsigned waitFor = 0) {
+      unsigned count = sqPending_;
+      if (count == 0 && waitFor == 0) return true;
+      __atomic_store_n(sqTail_, *sqTail_ + count, __ATOMIC_RELEASE);
+      sqPending_ = 0;
+      unsigned flags = waitFor > 0? IORING_ENTER_GETEVENTS: 0;
+      if (params_.flags & IORING_SETUP_SQPOLL) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (__atomic_load_n(sqFlags_, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) {
+          flags |= IORING_ENTER_SQ_WAKEUP;
+        } else if (waitFor == 0) {
+          return true;
+        }
+      }
+      if (syscall(__NR_io_uring_enter, fd_, count, waitFor, flags, nullptr, 0) < 0) {
+        if (errno == EINTR) return false;
+        throw std::system_error {errno, std::generic_category(), "io_uring_enter"};
+      }
+      return true;
+    }
+    // Call handler with each completion that is ready. Returns how many there were.
+    template <typename Handler>
+    unsigned complete(Handler&& handler) {
+      unsigned head = *cqHead_;
+      unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+      unsigned count = tail - head;
+      for (; head != tail; head++) {
+        handler(cqes_[head & cqMask_]);
+      }
+      __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+      return count;
+    }
+    // Whether the kernel knows the given IORING_OP_*.
+    bool supports(unsigned opcode) {
+      const unsigned count {256};
+      std::unique_ptr<char[]> memory {new char[sizeof(io_uring_probe) + count * sizeof(io_uring_probe_op)]()};
+      io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(memory.get());
+      if (syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, count) < 0) return false;
+      return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+    }
+    void registerBuffers(const iovec* buffers, unsigned count) {
+      this->enroll(IORING_REGISTER_BUFFERS, buffers, count, "register buffers");
+    }
+    void registerFiles(const int* descriptors, unsigned count) {
+      this->enroll(IORING_REGISTER_FILES, descriptors, count, "register files");
+    }
+    void enroll(unsigned opcode, const void* arg, unsigned count, const char* what) {
+      if (syscall(__NR_io_uring_register, fd_, opcode, arg, count) < 0) {
+        throw std::system_error {errno, std::generic_category(), what};
+      }
+    }
+  protected:
+    [[noreturn]] void fail(const char* what) {
+      int error = errno;
+      this->release();
+      throw std::system_error {error, std::generic_category(), what};
+    }
+    void release() {
+      if (sqes_ != nullptr) munmap(sqes_, sqesSize_);
+      if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+      if (sqRing_ != MAP_FAILED) munmap(sqRing_, sqRingSize_);
+      if (fd_ >= 0) close(fd_);
+      sqes_ = nullptr;
+      sqRing_ = cqRing_ = MAP_FAILED;
+      fd_ = -1;
+    }
+  };
+
+  class ProvidedBuffers : public std::enable_shared_from_this<ProvidedBuffers> {
+    // A group of equally sized receive buffers for the kernel to pick from (buffer
+    // select), provided with IORING_OP_PROVIDE_BUFFERS entries that go out with the next
+    // submit(). Each receive completion reports the id of the buffer it filled, and take()
+    // hands that buffer out as a Slab for the frame parser to go on in. It comes back when
+    // its last reference is dropped, on any thread, and provideReleased() gives it to the
+    // kernel again. The kernel fills each slab after headroom bytes, leaving room to move
+    // the start of a frame in front of the data. Registered buffer rings
+    // (IORING_REGISTER_PBUF_RING) would need no entries to recycle buffers, but on the
+    // kernels tried every receive selecting from one failed with ENOBUFS.
+  protected:
+    Uring& uring_;
+    uint16_t group_;
+    size_t headroom_;
+    size_t bufferSize_;
+    // by id; empty while handed out
+    std::vector<std::unique_ptr<Slab>> buffers_ {};
+    std::mutex mutex_ {};
+    // ids of buffers handed out and released since
+    std::vector<uint16_t> released_ {};
+    // buffers the kernel may fill; receiver thread only
+    size_t available_ {0};
+  public:
+    ProvidedBuffers(Uring& uring, uint16_t group, unsigned entries, size_t bufferSize, size_t headroom = 0) :
+      uring_ {uring}, group_ {group}, headroom_ {headroom}, bufferSize_ {bufferSize} {
+        for (unsigned id=0; id<entries; id++) {
+          buffers_.push_back(std::make_unique<Slab>(headroom_ + bufferSize_));
+          this->provide(static_cast<uint16_t>(id));
+        }
+      }
+    ProvidedBuffers(const ProvidedBuffers&) = delete;
+    ProvidedBuffers& operator=(const ProvidedBuffers&) = delete;
+    uint16_t group() const { return group_; }
+    size_t headroom() const { return headroom_; }
+    size_t bufferSize() const { return bufferSize_; }
+    size_t available() const { return available_; }
+    // The buffer a receive completion reports it filled, its data at headroom().
+    SlabPtr take(uint16_t id) {
+      std::unique_ptr<Slab> slab {};
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        slab = std::move(buffers_[id]);
+      }
+      available_--;
+      std::weak_ptr<ProvidedBuffers> group {this->shared_from_this()};
+      return SlabPtr {slab.release(), [group, id](Slab* released) {
+        if (auto owner = group.lock()) {
+          owner->release(id, released);
+        } else {
+          delete released;
+        }
+      }};
+    }
+    // Give the buffers released since the last call back to the kernel.
+    void provideReleased() {
+      std::vector<uint16_t> released {};
+      {
+        std::lock_guard<std::mutex> lock {mutex_};
+        if (released_.empty()) return;
+        released.swap(released_);
+      }
+      for (uint16_t id : released) this->provide(id);
+    }
+  protected:
+    void release(uint16_t id, Slab* slab) {
+      std::lock_guard<std::mutex> lock {mutex_};
+      buffers_[id].reset(slab);
+      released_.push_back(id);
+    }
+    void provide(uint16_t id) {
+      io_uring_sqe* sqe = uring_.getSqe();
+      sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+      sqe->fd = 1;
+      sqe->addr = reinterpret_cast<uint64_t>(buffers_[id]->data() + headroom_);
+      sqe->len = static_cast<uint32_t>(bufferSize_);
+      sqe->buf_group = group_;
+      sqe->off = id;
+      available_++;
+    }
+  };
+}
+
+#endif
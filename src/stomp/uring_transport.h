@@ -0,0 +1,353 @@
+#ifndef STOMP_URING_TRANSPORT_H
+#define STOMP_URING_TRANSPORT_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <linux/io_uring.h>
+
+#include "transport.h"
+#include "uring.h"
+
+#define STOMP_URING_ENTRIES 64
+#define STOMP_URING_RECV_BUFFERS 64
+#define STOMP_URING_RECV_SIZE 16384
+// room in front of each receive buffer for the start of a frame that ran into it
+#define STOMP_URING_RECV_HEADROOM 4096
+#define STOMP_URING_SEND_BUFFERS 8
+#define STOMP_URING_SEND_SIZE 65536
+// smallest send worth doing zero-copy; pinning pages and the extra notification cost more
+// than copying below this
+#define STOMP_URING_ZC_MIN 16384
+
+namespace stomp {
+  struct UringOptions {
+    // Ring and buffer sizes for UringTransport.
+    unsigned entries {STOMP_URING_ENTRIES};
+    // receive buffers provided to the kernel and their size
+    unsigned recvBuffers {STOMP_URING_RECV_BUFFERS};
+    size_t recvBufferSize {STOMP_URING_RECV_SIZE};
+    // bytes in front of each receive buffer for the start of a frame, which is moved there
+    // so the frame parser can go on in the buffer; a longer one is copied out of it instead
+    size_t recvHeadroom {STOMP_URING_RECV_HEADROOM};
+    // registered send buffers (at most entries) and their size
+    unsigned sendBuffers {STOMP_URING_SEND_BUFFERS};
+    size_t sendBufferSize {STOMP_URING_SEND_SIZE};
+    // have a kernel thread poll the send ring, so submitting sends needs no system call
+    // while it is busy
+    bool sqPoll {false};
+  };
+
+  class UringTransport : public Transport {
+    // A transport doing its socket I/O through io_uring. Receiving uses one multishot recv
+    // that keeps completing into provided buffers, so the receiver thread makes one system
+    // call per batch of completions rather than one recv() per read. Each buffer becomes
+    // the frame parser's slab, going back to the kernel once the frames in it are dropped;
+    // while frames hold every buffer, the transport reads into the parser's own slabs.
+    // Sending copies frames into registered buffers and submits them as one linked chain
+    // per write without waiting for it; completions are collected on later writes, or
+    // when the buffers run out. Large sends go out zero-copy straight from the registered
+    // buffers (IORING_OP_SEND_ZC) where the kernel supports it. Each side has its own
+    // ring, so neither waits on the other.
+  protected:
+    enum : uint64_t { ReceiveTag = 1ull << 32, CancelTag = 2ull << 32 };
+    UringOptions options_ {};
+    // receive side, only used from the receiver thread
+    std::unique_ptr<Uring> recvRing_ {};
+    std::shared_ptr<ProvidedBuffers> recvBuffers_ {};
+    bool recvArmed_ {false};
+    // a receive completed with the connection closed or broken; dealt with once the
+    // completions have been gone through, as reconnecting replaces the ring
+    bool lost_ {false};
+    // send side, guarded by sendMutex_. Buffers are used round-robin: sendBusy_ buffers
+    // from sendHead_ are in flight, then sendStaged_ are filled but not yet submitted.
+    std::unique_ptr<Uring> sendRing_ {};
+    std::unique_ptr<char[]> sendMemory_ {};
+    std::vector<size_t> sendUsed_ {};
+    // set once a buffer's send has completed and the kernel no longer needs the buffer
+    std::vector<char> sendDone_ {};
+    bool zeroCopy_ {false};
+    unsigned sendHead_ {0};
+    unsigned sendBusy_ {0};
+    unsigned sendStaged_ {0};
+    // sends submitted whose result hasn't come back yet
+    unsigned sendResults_ {0};
+    int sendError_ {0};
+  public:
+    UringTransport(HostsAndPorts hostsAndPorts = {}, UringOptions options = {}, bool autoDecode = true, std::string encoding = "utf8") :
+      Transport {hostsAndPorts, autoDecode, encoding}, options_ {options} {
+        if (options_.sendBuffers > options_.entries) options_.sendBuffers = options_.entries;
+      }
+    virtual ~UringTransport() {
+      this->stopWriter();
+      std::lock_guard<std::mutex> lock {sendMutex_};
+      this->releaseSend();
+    }
+    virtual void attemptConnection() {
+      Transport::attemptConnection();
+      this->setupRings();
+    }
+    virtual void disconnectSocket() {
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        this->releaseSend();
+      }
+      Transport::disconnectSocket();
+    }
+    // Wait for the receiver thread, then let go of the receive ring.
+    virtual void stop() {
+      Transport::stop();
+      this->releaseReceive();
+    }
+    // Wait for the next receive completions and hand their buffers to the parser, which
+    // parses each as it comes (see onReceived()).
+    virtual void receive() {
+      if (!recvRing_) {
+        running_ = false;
+        return;
+      }
+      recvBuffers_->provideReleased();
+      if (!recvArmed_) {
+        if (recvBuffers_->available() == 0) {
+          // frames not let go of yet hold every buffer
+          Transport::receive();
+          return;
+        }
+        this->armReceive();
+      }
+      if (recvRing_->submit(1)) {
+        recvRing_->complete([this](const io_uring_cqe& cqe){ this->onReceived(cqe); });
+      }
+      if (lost_) {
+        lost_ = false;
+        this->connectionLost();
+      }
+      if (!running_) this->releaseReceive();
+    }
+    virtual void cleanup() {
+      {
+        std::lock_guard<std::mutex> lock {sendMutex_};
+        this->releaseSend();
+      }
+      Transport::cleanup();
+    }
+    // As BaseTransport::read(), except that the frames in each buffer were parsed as it came.
+    virtual std::vector<FrameView>& read() {
+      received_.clear();
+      if (running_) {
+        this->receive();
+        this->markReceived();
+        if (!parser_.parse(received_)) frameRefused_ = true;
+      }
+      return received_;
+    }
+  protected:
+    // Set up both rings for the new socket. On a reconnect, the rings of the lost connection
+    // are let go of first, once the receive and the sends still in flight on them are done.
+    void setupRings() {
+      this->releaseReceive();
+      int descriptor = socket->getDescriptor();
+      recvRing_ = std::make_unique<Uring>(options_.entries);
+      recvRing_->registerFiles(&descriptor, 1);
+      recvBuffers_ = std::make_shared<ProvidedBuffers>(*recvRing_, 0, options_.recvBuffers, options_.recvBufferSize, options_.recvHeadroom);
+      recvArmed_ = false;
+      std::lock_guard<std::mutex> lock {sendMutex_};
+      this->releaseSend();
+      sendRing_ = std::make_unique<Uring>(options_.entries, options_.sqPoll? IORING_SETUP_SQPOLL: 0);
+      sendRing_->registerFiles(&descriptor, 1);
+      sendMemory_.reset(new char[options_.sendBuffers * options_.sendBufferSize]);
+      std::vector<iovec> buffers {};
+      for (unsigned i=0; i<options_.sendBuffers; i++) {
+        buffers.push_back({sendMemory_.get() + i * options_.sendBufferSize, options_.sendBufferSize});
+      }
+      sendRing_->registerBuffers(buffers.data(), options_.sendBuffers);
+      sendUsed_.assign(options_.sendBuffers, 0);
+      sendDone_.assign(options_.sendBuffers, 0);
+      zeroCopy_ = sendRing_->supports(IORING_OP_SEND_ZC);
+      sendHead_ = sendBusy_ = sendStaged_ = sendResults_ = 0;
+      sendError_ = 0;
+    }
+    void armReceive() {
+      io_uring_sqe* sqe = recvRing_->getSqe();
+      sqe->opcode = IORING_OP_RECV;
+      sqe->fd = 0;
+      sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+      sqe->ioprio = IORING_RECV_MULTISHOT;
+      sqe->buf_group = recvBuffers_->group();
+      sqe->user_data = ReceiveTag;
+      recvArmed_ = true;
+    }
+    void onReceived(const io_uring_cqe& cqe) {
+      if (cqe.user_data != ReceiveTag) return;
+      if (!(cqe.flags & IORING_CQE_F_MORE)) recvArmed_ = false;
+      if (cqe.res > 0) {
+        size_t received = static_cast<size_t>(cqe.res);
+        size_t headroom = recvBuffers_->headroom();
+        SlabPtr slab {recvBuffers_->take(cqe.flags >> IORING_CQE_BUFFER_SHIFT)};
+        if (parser_.getPartial() <= headroom) {
+          parser_.adopt(std::move(slab), headroom, received);
+        } else {
+          // a long frame is under way in a slab sized for it, so add to that instead
+          auto [buffer, size] = parser_.prepare(received);
+          std::memcpy(buffer, slab->data() + headroom, received);
+          parser_.commit(received);
+        }
+        // what is left unparsed has to fit in front of the next buffer
+        if (!parser_.parse(received_)) frameRefused_ = true;
+      } else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED && running_) {
+        // the connection was closed, or failed
+        lost_ = true;
+      }
+    }
+    // Cancel the receive and wait for it to finish, since the kernel may still be filling
+    // a provided buffer, then release the ring. Receiver thread only.
+    void releaseReceive() {
+      if (!recvRing_) return;
+      if (recvArmed_) {
+        io_uring_sqe* sqe = recvRing_->getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = ReceiveTag;
+        sqe->user_data = CancelTag;
+        while (recvArmed_) {
+          recvRing_->submit(1);
+          recvRing_->complete([this](const io_uring_cqe& cqe){
+            if (cqe.user_data == ReceiveTag && !(cqe.flags & IORING_CQE_F_MORE)) recvArmed_ = false;
+            if (cqe.user_data == ReceiveTag && cqe.res > 0) recvBuffers_->take(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+          });
+        }
+      }
+      recvBuffers_ = nullptr;
+      recvRing_ = nullptr;
+    }
+    // Copy the buffered frames and the given frame into send buffers and submit them,
+    // with sendMutex_ held. The cork settings of the flush policy don't apply here: the
+    // kernel is only told more follows between the chains of one write.
+    virtual void write(std::string_view head, std::string_view body, bool /*more*/) {
+      static const char terminator {'\0'};
+      if (!sendRing_) {
+        outbound_.clear();
+        throw SocketException {"Not connected!"};
+      }
+      try {
+        this->reapSends(false);
+        this->stage(outbound_.data());
+        if (!head.empty()) {
+          this->stage(head);
+          this->stage(body);
+          this->stage({&terminator, 1});
+        }
+        outbound_.clear();
+        this->submitStaged(false);
+      } catch (SocketException& e) {
+        outbound_.clear();
+        throw;
+      }
+    }
+    // Submit the buffered frames only if that needs no waiting: not while a chain is still
+    // in flight, nor if they don't fit in the free send buffers.
+    virtual bool tryFlush() {
+      if (!sendRing_) return false;
+      this->reapSends(false);
+      if (sendResults_ > 0 || outbound_.size() > (options_.sendBuffers - sendBusy_) * options_.sendBufferSize) return false;
+      this->write({}, {}, false);
+      return true;
+    }
+    // Copy data into send buffers, submitting full ones and waiting for free ones as needed.
+    void stage(std::string_view data) {
+      const unsigned count = options_.sendBuffers;
+      while (!data.empty()) {
+        unsigned last = (sendHead_ + sendBusy_ + sendStaged_ + count - 1) % count;
+        if (sendStaged_ == 0 || sendUsed_[last] == options_.sendBufferSize) {
+          if (sendBusy_ + sendStaged_ == count) {
+            if (sendStaged_ > 0) this->submitStaged(true);
+            this->reapSends(true);
+            continue;
+          }
+          last = (sendHead_ + sendBusy_ + sendStaged_) % count;
+          sendUsed_[last] = 0;
+          sendDone_[last] = 0;
+          sendStaged_++;
+        }
+        size_t n = std::min(data.size(), options_.sendBufferSize - sendUsed_[last]);
+        std::memcpy(sendMemory_.get() + last * options_.sendBufferSize + sendUsed_[last], data.data(), n);
+        sendUsed_[last] += n;
+        data.remove_prefix(n);
+      }
+    }
+    // Submit the staged buffers as one chain of linked sends. Sends from separate
+    // submissions could overtake each other on the socket, so this first waits for the
+    // previous chain, which under no backpressure has completed already.
+    void submitStaged(bool more) {
+      if (sendStaged_ == 0) return;
+      while (sendResults_ > 0) this->reapSends(true);
+      const unsigned count = options_.sendBuffers;
+      for (unsigned i=0; i<sendStaged_; i++) {
+        unsigned index = (sendHead_ + sendBusy_ + i) % count;
+        io_uring_sqe* sqe = sendRing_->getSqe();
+        sqe->opcode = IORING_OP_SEND;
+        if (zeroCopy_ && sendUsed_[index] >= STOMP_URING_ZC_MIN) {
+          sqe->opcode = IORING_OP_SEND_ZC;
+          sqe->ioprio = IORING_RECVSEND_FIXED_BUF;
+          sqe->buf_index = static_cast<uint16_t>(index);
+        }
+        sqe->fd = 0;
+        sqe->flags = IOSQE_FIXED_FILE;
+        if (i + 1 < sendStaged_) sqe->flags |= IOSQE_IO_LINK;
+        sqe->addr = reinterpret_cast<uint64_t>(sendMemory_.get() + index * options_.sendBufferSize);
+        sqe->len = static_cast<uint32_t>(sendUsed_[index]);
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;
+        if (more && i + 1 == sendStaged_) sqe->msg_flags |= MSG_MORE;
+        sqe->user_data = index;
+      }
+      sendBusy_ += sendStaged_;
+      sendResults_ += sendStaged_;
+      sendStaged_ = 0;
+      while (!sendRing_->submit()) {}
+    }
+    // Collect finished sends, waiting for at least one if wait is set. A zero-copy send
+    // completes twice: with its result, then with a notification once the kernel is done
+    // with the buffer.
+    void reapSends(bool wait) {
+      if (wait && sendBusy_ > 0) sendRing_->submit(1);
+      sendRing_->complete([this](const io_uring_cqe& cqe){
+        if (!(cqe.flags & IORING_CQE_F_NOTIF)) {
+          sendResults_--;
+          if (cqe.res < 0 && sendError_ == 0) sendError_ = -cqe.res;
+          // MSG_WAITALL retries short sends, so a short one means the connection broke
+          else if (cqe.res >= 0 && static_cast<size_t>(cqe.res) < sendUsed_[cqe.user_data] && sendError_ == 0) sendError_ = EPIPE;
+          if (cqe.flags & IORING_CQE_F_MORE) return;
+        }
+        sendDone_[cqe.user_data] = 1;
+      });
+      while (sendBusy_ > 0 && sendDone_[sendHead_]) {
+        sendHead_ = (sendHead_ + 1) % options_.sendBuffers;
+        sendBusy_--;
+      }
+      if (sendError_ != 0) {
+        errno = sendError_;
+        throw SocketException {"Send failed (io_uring)", true};
+      }
+    }
+    // Wait for the sends in flight, then release the send ring. With sendMutex_ held.
+    void releaseSend() {
+      if (!sendRing_) return;
+      while (sendBusy_ > 0) {
+        try {
+          this->reapSends(true);
+        } catch (SocketException& e) {
+          // the connection is going away anyway
+          sendError_ = 0;
+        }
+      }
+      sendRing_ = nullptr;
+      sendMemory_ = nullptr;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef STOMP_TEST_PEER_H
+#define STOMP_TEST_PEER_H
+
+#undef NDEBUG
+#include <cassert>
+#include <string>
+#include <memory>
+#include <chrono>
+
+#include "socket/socket.h"
+#include "stomp/transport.h"
+
+namespace stomp {
+  struct Peer {
+    // The other end of a Transport's connection, for tests: a server on a free port
+    // that accepts one connection and reads or writes raw bytes on it.
+    using Clock = std::chrono::steady_clock;
+    TCPServerSocket server {0};
+    std::unique_ptr<TCPSocket> socket {};
+    HostsAndPorts address() {
+      return HostsAndPorts {std::make_shared<HostAndPort>("localhost", server.getLocalPort())};
+    }
+    void accept() { socket.reset(server.accept()); }
+    // Read until frames frames (NULs) have arrived, and return how long that took.
+    Clock::duration receive(int frames) {
+      auto start = Clock::now();
+      char buffer[4096];
+      while (frames > 0) {
+        int n = socket->recv(buffer, sizeof(buffer));
+        assert(n > 0);
+        for (int i=0; i<n; i++) frames -= buffer[i] == '\0';
+      }
+      return Clock::now() - start;
+    }
+    // Read until frames frames (NULs) have arrived, and return what was read.
+    std::string take(int frames) {
+      std::string data {};
+      char buffer[4096];
+      while (frames > 0) {
+        int n = socket->recv(buffer, sizeof(buffer));
+        assert(n > 0);
+        for (int i=0; i<n; i++) frames -= buffer[i] == '\0';
+        data.append(buffer, n);
+      }
+      return data;
+    }
+    void send(const std::string& data) { socket->send(data.data(), static_cast<int>(data.size())); }
+  };
+}
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef STOMP_TEST_RECORDING_TRANSPORT_H
+#define STOMP_TEST_RECORDING_TRANSPORT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+
+#include "socket/socket.h"
+#include "stomp/base_transport.h"
+#include "stomp/frame_parser.h"
+
+namespace stomp {
+  class RecordingTransport : public BaseTransport {
+    // A transport without a socket, for tests. What is transmitted is kept, to be read
+    // back with getSent(), and frames from the server are handed in with processFrame().
+    // Frames transmitted together count as one write, made on the flush after them.
+  protected:
+    std::mutex sentMutex_ {};
+    std::string sent_ {};
+    size_t writes_ {0};
+    bool unflushed_ {false};
+    size_t heartbeats_ {0};
+    size_t aborts_ {0};
+    bool failing_ {false};
+  public:
+    virtual void send(std::string_view head, std::string_view body) {
+      std::lock_guard<std::mutex> lock {sentMutex_};
+      if (failing_) throw SocketException("connection lost");
+      sent_.append(head);
+      sent_.append(body);
+      sent_.push_back('\0');
+      if (batching_) {
+        unflushed_ = true;
+      } else {
+        writes_++;
+      }
+    }
+    virtual void flush() {
+      std::lock_guard<std::mutex> lock {sentMutex_};
+      if (unflushed_) writes_++;
+      unflushed_ = false;
+    }
+    virtual void sendHeartbeat() {
+      std::lock_guard<std::mutex> lock {sentMutex_};
+      heartbeats_++;
+      this->markSent();
+    }
+    virtual void abortConnection() {
+      std::lock_guard<std::mutex> lock {sentMutex_};
+      aborts_++;
+    }
+    virtual void receive() {}
+    virtual void cleanup() {}
+    virtual void attemptConnection() {}
+    virtual void disconnectSocket() {}
+    // The frames transmitted so far, parsed back.
+    std::vector<FrameView> getSent() {
+      FrameParser parser {};
+      std::vector<FrameView> frames {};
+      std::lock_guard<std::mutex> lock {sentMutex_};
+      parser.feed(sent_.data(), sent_.size(), frames);
+      return frames;
+    }
+    size_t getWrites() {
+      std::lock_guard<std::mutex> lock {sentMutex_};
+      return writes_;
+    }
+    size_t getHeartbeats() {
+      std::lock_guard<std::mutex> lock {sentMutex_};
+      return heartbeats_;
+    }
+    size_t getAborts() {
+      std::lock_guard<std::mutex> lock {sentMutex_};
+      return aborts_;
+    }
+    // Note data from the server, as a heart-beat from it would.
+    void receiveHeartbeat() {
+      this->markReceived();
+    }
+    // Make send() throw, as on a broken connection.
+    void setFailing(bool failing) {
+      std::lock_guard<std::mutex> lock {sentMutex_};
+      failing_ = failing;
+    }
+    // Lose the connection and make it again, as a transport set to reconnect does.
+    void reconnect() {
+      reconnecting_ = true;
+      this->notify(FramePool::local()->make(FRAME_DISCONNECTED));
+      this->notify(FramePool::local()->make(FRAME_CONNECTING));
+      reconnecting_ = false;
+    }
+    void clearSent() {
+      std::lock_guard<std::mutex> lock {sentMutex_};
+      sent_.clear();
+      writes_ = 0;
+    }
+  };
+  using RecordingTransportPtr = std::shared_ptr<RecordingTransport>;
+
+  // Poll done for up to a second, for what another thread or a timer does. Returns done().
+  inline bool waitUntil(const std::function<bool()>& done) {
+    for (int i=0; i<200 && !done(); i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return done();
+  }
+
+  struct RecordingSession {
+    // A connected RecordingTransport for the listeners under test, for tests to build on.
+    RecordingTransportPtr transport {std::make_shared<RecordingTransport>()};
+    RecordingSession() { transport->setConnected(true); }
+    // The value of header in each frame of type sent so far, "<none>" where it has none.
+    std::vector<std::string> sent(FrameType type, std::string_view header) {
+      std::vector<std::string> values {};
+      for (auto& frame : transport->getSent()) {
+        if (frame.getType() == type) values.emplace_back(frame.getHeader(header).value_or("<none>"));
+      }
+      return values;
+    }
+    // Wait for what another thread or a timer sends: whether count frames of type, and no
+    // more, have been sent.
+    bool waitForSent(FrameType type, size_t count) {
+      waitUntil([this, type, count](){ return this->sent(type, {}).size() >= count; });
+      return this->sent(type, {}).size() == count;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,159 @@
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "recording_transport.h"
+#include "stomp/ack_manager.h"
+
+using namespace stomp;
+
+struct AckSession : RecordingSession {
+  AckManagerPtr acks {};
+  AckSession(std::string version, AckPolicy policy = {64, std::chrono::seconds(10)}) {
+    acks = std::make_shared<AckManager>(transport, policy);
+    transport->setListener("acks", acks);
+    transport->setDeliveryTracker(acks);
+    acks->onConnected(FramePool::local()->make(FRAME_CONNECTED, Headers {{HEADER_VERSION, version}}));
+  }
+  void subscribe(std::string id, std::string mode) {
+    transport->transmit(FramePool::local()->make(FRAME_SUBSCRIBE, Headers {{HEADER_ID, id}, {HEADER_DESTINATION, "/queue/" + id}, {HEADER_ACK, mode}}));
+  }
+  FramePtr deliver(std::string subscription, int n) {
+    std::string id {subscription + "-" + std::to_string(n)};
+    FramePtr message = FramePool::local()->make(FRAME_MESSAGE, Headers {
+      {HEADER_SUBSCRIPTION, subscription}, {HEADER_MESSAGE_ID, "m-" + id}, {HEADER_ACK, "a-" + id}});
+    transport->processFrame(message);
+    return message;
+  }
+  // The ACK frames sent, as their acknowledged ids.
+  std::vector<std::string> sentAcks(std::string_view idHeader) {
+    return this->sent(FrameType::Ack, idHeader);
+  }
+};
+
+// On a client subscription one ACK covers every message before it.
+static void testCumulative() {
+  AckSession session {"1.2"};
+  session.subscribe("c", "client");
+  std::vector<FramePtr> messages {};
+  for (int i=0; i<5; i++) messages.push_back(session.deliver("c", i));
+  assert(session.acks->getUnacknowledged() == 5);
+  session.acks->ack(messages[1]);
+  session.acks->ack(messages[3]);
+  // covered already
+  session.acks->ack(messages[2]);
+  assert(session.acks->getUnflushed() == 4);
+  assert(session.acks->getUnacknowledged() == 1);
+  session.acks->flush();
+  assert(session.sentAcks(HEADER_ID) == std::vector<std::string> {"a-c-3"});
+  assert(session.acks->getUnflushed() == 0);
+}
+
+// On a client-individual subscription each message gets an ACK of its own.
+static void testIndividual() {
+  AckSession session {"1.2"};
+  session.subscribe("i", "client-individual");
+  std::vector<FramePtr> messages {};
+  for (int i=0; i<6; i++) messages.push_back(session.deliver("i", i));
+  session.acks->ack(messages[4]);
+  session.acks->ack(messages[0]);
+  session.acks->ack(messages[4]);
+  session.acks->ackUpTo("i", "a-i-2");
+  assert(session.acks->getUnacknowledged() == 2);
+  session.acks->flush();
+  assert((session.sentAcks(HEADER_ID) == std::vector<std::string> {"a-i-4", "a-i-0", "a-i-1", "a-i-2"}));
+}
+
+// The ids and headers each protocol version acknowledges by.
+static void testVersions() {
+  AckSession stomp11 {"1.1"};
+  stomp11.subscribe("s", "client-individual");
+  stomp11.acks->ack(stomp11.deliver("s", 0));
+  stomp11.acks->flush();
+  auto sent = stomp11.transport->getSent();
+  assert(sent.back().getType() == FrameType::Ack);
+  assert(sent.back().getHeader(HEADER_MESSAGE_ID) == "m-s-0");
+  assert(sent.back().getHeader(HEADER_SUBSCRIPTION) == "s");
+  assert(!sent.back().hasHeader(HEADER_ID));
+  AckSession stomp10 {"1.0"};
+  stomp10.subscribe("s", "client");
+  stomp10.acks->ack(stomp10.deliver("s", 0));
+  stomp10.acks->flush();
+  sent = stomp10.transport->getSent();
+  assert(sent.back().getHeader(HEADER_MESSAGE_ID) == "m-s-0");
+  assert(!sent.back().hasHeader(HEADER_SUBSCRIPTION));
+}
+
+// A batch goes out when maxAcks messages are acknowledged, or after maxDelay.
+static void testPolicy() {
+  AckSession session {"1.2", AckPolicy {3, std::chrono::milliseconds(20)}};
+  session.subscribe("i", "client-individual");
+  std::vector<FramePtr> messages {};
+  for (int i=0; i<4; i++) messages.push_back(session.deliver("i", i));
+  session.acks->ack(messages[0]);
+  session.acks->ack(messages[1]);
+  assert(session.sentAcks(HEADER_ID).empty());
+  session.acks->ack(messages[2]);
+  assert(session.sentAcks(HEADER_ID).size() == 3);
+  session.acks->ack(messages[3]);
+  assert(session.waitForSent(FrameType::Ack, 4));
+}
+
+// Messages on auto subscriptions are not tracked, UNSUBSCRIBE drops what was, and a
+// message on a subscription not seen being made is acknowledged as given.
+static void testTracking() {
+  AckSession session {"1.2"};
+  session.subscribe("auto", "auto");
+  session.subscribe("c", "client");
+  session.deliver("auto", 0);
+  session.deliver("c", 0);
+  session.deliver("c", 1);
+  assert(session.acks->getUnacknowledged() == 2);
+  session.transport->transmit(FramePool::local()->make(FRAME_UNSUBSCRIBE, Headers {{HEADER_ID, "c"}}));
+  assert(session.acks->getUnacknowledged() == 0);
+  session.acks->ack(session.deliver("unknown", 0));
+  session.acks->flush();
+  assert(session.sentAcks(HEADER_ID) == std::vector<std::string> {"a-unknown-0"});
+}
+
+// STOMP 1.0 subscriptions without an id are known by their destination, which their
+// messages come with instead of a subscription header.
+static void testWithoutIds() {
+  AckSession session {"1.0"};
+  for (std::string queue : {"a", "b"}) {
+    session.transport->transmit(FramePool::local()->make(FRAME_SUBSCRIBE, Headers {{HEADER_DESTINATION, "/queue/" + queue}, {HEADER_ACK, "client"}}));
+  }
+  auto deliver = [&session](std::string queue, int n){
+    FramePtr message = FramePool::local()->make(FRAME_MESSAGE, Headers {{HEADER_DESTINATION, "/queue/" + queue}, {HEADER_MESSAGE_ID, queue + "-" + std::to_string(n)}});
+    session.transport->processFrame(message);
+    return message;
+  };
+  std::vector<FramePtr> messages {deliver("a", 0), deliver("a", 1), deliver("b", 0)};
+  // the second subscription kept the first's messages
+  assert(session.acks->getUnacknowledged() == 3);
+  session.acks->ack(messages[1]);
+  assert(session.acks->getUnacknowledged() == 1);
+  session.acks->ack(messages[2]);
+  session.acks->flush();
+  auto acked = session.sentAcks(HEADER_MESSAGE_ID);
+  std::sort(acked.begin(), acked.end());
+  assert((acked == std::vector<std::string> {"a-1", "b-0"}));
+  deliver("b", 1);
+  session.transport->transmit(FramePool::local()->make(FRAME_UNSUBSCRIBE, Headers {{HEADER_DESTINATION, "/queue/b"}}));
+  assert(session.acks->getUnacknowledged() == 0);
+}
+
+int main() {
+  testCumulative();
+  testIndividual();
+  testVersions();
+  testPolicy();
+  testTracking();
+  testWithoutIds();
+  std::printf("test_ack_manager: ok\n");
+  return 0;
+}
@@ -0,0 +1,127 @@
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+
+#include "recording_transport.h"
+#include "stomp/batching_publisher.h"
+#include "stomp/heartbeat_listener.h"
+#include "stomp/connection10.h"
+
+using namespace stomp;
+
+struct PublisherSession : RecordingSession {
+  BatchingPublisherPtr publisher {};
+  PublisherSession(BatchPolicy policy) {
+    publisher = std::make_shared<BatchingPublisher>(transport, policy);
+    transport->setListener("publisher", publisher);
+  }
+  // The receipts asked for with the COMMITs sent.
+  std::vector<std::string> commits() {
+    return this->sent(FrameType::Commit, HEADER_RECEIPT);
+  }
+  void confirm(const std::string& receipt) {
+    transport->processFrame(FramePool::local()->make(FRAME_RECEIPT, Headers {{HEADER_RECEIPT_ID, receipt}}));
+  }
+};
+
+static BatchPolicy policy(size_t maxMessages, std::chrono::microseconds maxDelay) {
+  BatchPolicy policy {};
+  policy.maxMessages = maxMessages;
+  policy.maxDelay = maxDelay;
+  return policy;
+}
+
+// A full batch goes out at once as BEGIN, its SENDs and COMMIT; one that isn't goes out
+// after maxDelay. Messages count as committed on the receipt.
+static void testCommit() {
+  PublisherSession session {policy(3, std::chrono::milliseconds(20))};
+  for (int i=0; i<3; i++) session.publisher->send("/queue/a", "message " + std::to_string(i));
+  auto sent = session.transport->getSent();
+  assert(sent.size() == 5);
+  assert(sent.front().getType() == FrameType::Begin);
+  assert(sent[1].getType() == FrameType::Send && sent[1].getHeader(HEADER_TRANSACTION) == sent.front().getHeader(HEADER_TRANSACTION));
+  assert(sent.back().getType() == FrameType::Commit);
+  assert(session.publisher->getPending() == 3);
+  session.confirm(session.commits().front());
+  assert(session.publisher->getCommitted() == 3);
+  session.publisher->send("/queue/a", "message 3");
+  assert(session.waitForSent(FrameType::Commit, 2));
+  session.confirm(session.commits().back());
+  assert(session.publisher->getCommitted() == 4);
+  assert(session.publisher->getPending() == 0);
+}
+
+// A commit waiting for room in the receipt window holds up its publisher only, and not
+// the shared timer wheel that heart-beats every other connection.
+static void testFullWindowDoesNotDelayHeartbeats() {
+  PublisherSession session {policy(100, std::chrono::milliseconds(1))};
+  session.transport->setReceiptWindow(1);
+  auto other = std::make_shared<RecordingTransport>();
+  other->setConnected(true);
+  auto heartbeat = std::make_shared<HeartbeatListener>(other, std::chrono::milliseconds(20), std::chrono::milliseconds(0));
+  heartbeat->onConnected(FramePool::local()->make(FRAME_CONNECTED, Headers {{HEADER_HEARTBEAT, "0,20"}}));
+  // the first commit takes the window, and the second waits for its receipt
+  session.publisher->send("/queue/a", "first");
+  assert(session.waitForSent(FrameType::Commit, 1));
+  session.publisher->send("/queue/a", "second");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  size_t before = other->getHeartbeats();
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  assert(other->getHeartbeats() - before >= 5);
+  assert(session.commits().size() == 1);
+  session.confirm(session.commits().front());
+  assert(session.waitForSent(FrameType::Commit, 2));
+  heartbeat->onDisconnected();
+}
+
+// A publisher let go of with its batch still open is not kept alive by its timer, which
+// then comes due without sending anything.
+static void testDroppedWithOpenBatch() {
+  PublisherSession session {policy(100, std::chrono::milliseconds(10))};
+  std::weak_ptr<BatchingPublisher> dropped {session.publisher};
+  session.publisher->send("/queue/a", "message");
+  session.transport->removeListener("publisher");
+  session.publisher = nullptr;
+  assert(dropped.expired());
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  assert(session.commits().empty());
+}
+
+// Setting the batch policy again commits the messages the old publisher holds before
+// replacing it, and refuses to while they can't be sent.
+static void testReplacePolicy() {
+  auto transport = std::make_shared<RecordingTransport>();
+  auto connection = std::make_shared<Connection10>(transport);
+  transport->setConnected(true);
+  auto first = connection->setBatchPolicy(policy(100, std::chrono::seconds(10)));
+  first->send("/queue/a", "first");
+  first->send("/queue/a", "second");
+  auto second = connection->setBatchPolicy(policy(100, std::chrono::seconds(10)));
+  assert(connection->getBatchingPublisher() == second);
+  auto sent = transport->getSent();
+  assert(sent.size() == 4 && sent.back().getType() == FrameType::Commit);
+  transport->setConnected(false);
+  second->send("/queue/a", "third");
+  bool refused {false};
+  try {
+    connection->setBatchPolicy();
+  } catch (std::logic_error& e) {
+    refused = true;
+  }
+  assert(refused && connection->getBatchingPublisher() == second);
+}
+
+int main() {
+  testCommit();
+  testFullWindowDoesNotDelayHeartbeats();
+  testDroppedWithOpenBatch();
+  testReplacePolicy();
+  std::printf("test_batching_publisher: ok\n");
+  return 0;
+}
@@ -0,0 +1,132 @@
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include "stomp/base_transport.h"
+#include "stomp/flow_control.h"
+
+using namespace stomp;
+
+static FlowControlPtr flowControl(FlowPolicy policy, std::atomic<int>& resumes) {
+  auto flow = std::make_shared<FlowControl>(std::move(policy));
+  flow->setOnResume([&resumes](){ resumes++; });
+  return flow;
+}
+
+// Reading pauses once maxUnacked messages are unacknowledged, and resumes, once, when
+// they are down to STOMP_FLOW_RESUME of it.
+static void testMaxUnacked() {
+  FlowPolicy policy {};
+  policy.maxUnacked = 8;
+  std::atomic<int> resumes {0};
+  auto flow = flowControl(policy, resumes);
+  flow->setUnacked(7);
+  assert(flow->mayRead(0));
+  flow->setUnacked(8);
+  assert(!flow->mayRead(0) && flow->isPaused());
+  flow->setUnacked(7);
+  assert(flow->isPaused() && resumes == 0);
+  flow->setUnacked(6);
+  assert(!flow->isPaused() && resumes == 1);
+  assert(flow->mayRead(0));
+  flow->setUnacked(5);
+  assert(resumes == 1);
+}
+
+// Reading pauses once the slabs held reach maxBufferedBytes, not counting the one about
+// to be read into, and resumes when enough of them are let go.
+static void testMaxBufferedBytes() {
+  auto pool = std::make_shared<BufferPool>(1024);
+  FlowPolicy policy {};
+  policy.maxBufferedBytes = 4096;
+  std::atomic<int> resumes {0};
+  auto flow = flowControl(policy, resumes);
+  flow->watch(pool);
+  std::vector<SlabPtr> held {};
+  for (int i=0; i<4; i++) held.push_back(pool->acquire());
+  assert(flow->mayRead(1024));
+  held.push_back(pool->acquire());
+  assert(flow->getBuffered() == 4096);
+  assert(!flow->mayRead(1024));
+  held.push_back(pool->acquire());
+  held.pop_back();
+  assert(flow->isPaused() && resumes == 0);
+  held.pop_back();
+  assert(!flow->isPaused() && resumes == 1);
+  assert(flow->mayRead(1024));
+}
+
+// A receiver waiting to read goes on once the budget is freed on another thread.
+static void testWaitToRead() {
+  FlowPolicy policy {};
+  policy.maxUnacked = 4;
+  std::atomic<int> resumes {0};
+  auto flow = flowControl(policy, resumes);
+  flow->setUnacked(4);
+  std::atomic<bool> running {true};
+  std::atomic<bool> read {false};
+  std::thread receiver {[&](){
+    flow->waitToRead(0, running);
+    read = true;
+  }};
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  assert(!read && flow->isPaused());
+  flow->setUnacked(3);
+  receiver.join();
+  assert(read && resumes == 1);
+}
+
+// SUBSCRIBE asks for the prefetch under the policy's header, unless it sets that itself.
+static void testPrefetch() {
+  FlowPolicy policy {};
+  policy.prefetch = 10;
+  auto flow = std::make_shared<FlowControl>(policy);
+  FramePtr subscribe {FramePool::local()->make(FRAME_SUBSCRIBE, Headers {{HEADER_DESTINATION, "/queue/a"}})};
+  flow->onSend(subscribe);
+  assert(subscribe->getHeaders().get(STOMP_PREFETCH_HEADER) == "10");
+  FramePtr own {FramePool::local()->make(FRAME_SUBSCRIBE, Headers {{HEADER_DESTINATION, "/queue/a"}, {STOMP_PREFETCH_HEADER, "1"}})};
+  flow->onSend(own);
+  assert(own->getHeaders().get(STOMP_PREFETCH_HEADER) == "1");
+  policy.prefetchHeader = "prefetch-count";
+  auto renamed = std::make_shared<FlowControl>(policy);
+  FramePtr other {FramePool::local()->make(FRAME_SUBSCRIBE, Headers {{HEADER_DESTINATION, "/queue/a"}})};
+  renamed->onSend(other);
+  assert(other->getHeaders().get("prefetch-count") == "10");
+  assert(other->getHeaders().count(STOMP_PREFETCH_HEADER) == 0);
+  auto unset = std::make_shared<FlowControl>();
+  FramePtr plain {FramePool::local()->make(FRAME_SUBSCRIBE, Headers {{HEADER_DESTINATION, "/queue/a"}})};
+  unset->onSend(plain);
+  assert(plain->getHeaders().count(STOMP_PREFETCH_HEADER) == 0);
+}
+
+// Once DISCONNECT has been sent, reading goes on whatever is held, for its receipt; the
+// limits apply again from the next CONNECT.
+static void testDisconnect() {
+  FlowPolicy policy {};
+  policy.maxUnacked = 4;
+  std::atomic<int> resumes {0};
+  auto flow = flowControl(policy, resumes);
+  flow->setUnacked(10);
+  assert(!flow->mayRead(0));
+  flow->onSend(FramePool::local()->make(FRAME_DISCONNECT));
+  assert(!flow->isPaused() && resumes == 1);
+  assert(flow->mayRead(0));
+  flow->onSend(FramePool::local()->make(FRAME_CONNECT));
+  assert(!flow->mayRead(0));
+}
+
+int main() {
+  testMaxUnacked();
+  testMaxBufferedBytes();
+  testWaitToRead();
+  testPrefetch();
+  testDisconnect();
+  std::printf("test_flow_control: ok\n");
+  return 0;
+}
@@ -0,0 +1,174 @@
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "stomp/frame_parser.h"
+
+using namespace stomp;
+
+static std::string header(const FrameView& frame, std::string_view key) {
+  return std::string {frame.getHeader(key).value_or("<none>")};
+}
+
+// Parse input fed in pieces of chunk bytes.
+static std::vector<FrameView> parse(const std::string& input, size_t chunk, BufferPoolPtr pool = std::make_shared<BufferPool>()) {
+  FrameParser parser {pool};
+  std::vector<FrameView> frames {};
+  for (size_t i=0; i<input.size(); i+=chunk) {
+    parser.feed(input.data() + i, std::min(chunk, input.size() - i), frames);
+  }
+  return frames;
+}
+
+static void testSimpleFrame() {
+  std::string input {std::string {"MESSAGE\ndestination:/queue/a\nmessage-id:1\n\nhello"} + '\0'};
+  auto frames = parse(input, input.size());
+  assert(frames.size() == 1);
+  assert(frames[0].getType() == FrameType::Message);
+  assert(frames[0].getCmd() == "MESSAGE");
+  assert(header(frames[0], "destination") == "/queue/a");
+  assert(header(frames[0], "message-id") == "1");
+  assert(frames[0].getBody() == "hello");
+}
+
+static void testResumesAcrossReads() {
+  std::string input {};
+  for (int i=0; i<20; i++) {
+    input += "MESSAGE\r\nid:" + std::to_string(i) + "\r\nvalue:a:b\r\n\r\nbody " + std::to_string(i) + '\0';
+    // heart-beats between frames
+    input += "\n\r\n";
+  }
+  for (size_t chunk : {1, 2, 3, 7, 64, 65, 1000}) {
+    auto frames = parse(input, chunk);
+    assert(frames.size() == 20);
+    for (int i=0; i<20; i++) {
+      assert(header(frames[i], "id") == std::to_string(i));
+      // the first colon splits a header, CRs before LFs are dropped
+      assert(header(frames[i], "value") == "a:b");
+      assert(frames[i].getBody() == "body " + std::to_string(i));
+    }
+  }
+}
+
+static void testContentLength() {
+  std::string body {"a\0b\0c", 5};
+  std::string input {"SEND\ncontent-length:5\ndestination:/q\n\n" + body + '\0'};
+  input += std::string {"SEND\ncontent-length:0\n\n"} + '\0';
+  for (size_t chunk : {size_t {1}, size_t {5}, input.size()}) {
+    auto frames = parse(input, chunk);
+    assert(frames.size() == 2);
+    assert(frames[0].getBody() == body);
+    assert(header(frames[0], "destination") == "/q");
+    assert(frames[1].getBody().empty());
+  }
+}
+
+static void testFramesSpanSlabs() {
+  // slabs much smaller than the frames, so every frame is carried over to a new slab
+  auto pool = std::make_shared<BufferPool>(64, 4);
+  std::string big (1000, 'x');
+  std::string input {};
+  for (int i=0; i<10; i++) {
+    input += "MESSAGE\nn:" + std::to_string(i) + "\n\n" + big + std::to_string(i) + '\0';
+    input += "SEND\ncontent-length:" + std::to_string(big.size()) + "\n\n" + big + '\0';
+  }
+  for (size_t chunk : {1, 13, 64, 4096}) {
+    auto frames = parse(input, chunk, pool);
+    assert(frames.size() == 20);
+    // views hold their slabs, so the earliest ones are still intact after the rest are parsed
+    for (int i=0; i<10; i++) {
+      assert(header(frames[2*i], "n") == std::to_string(i));
+      assert(frames[2*i].getBody() == big + std::to_string(i));
+      assert(frames[2*i+1].getBody() == big);
+    }
+  }
+}
+
+static void testMaxFrameSize() {
+  FrameParser parser {};
+  parser.setMaxFrameSize(100);
+  std::vector<FrameView> frames {};
+  std::string small {std::string {"SEND\n\nok"} + '\0'};
+  parser.feed(small.data(), small.size(), frames);
+  assert(frames.size() == 1);
+  // refused by its content-length before the body is buffered
+  std::string declared {"SEND\ncontent-length:1000\n\n"};
+  auto [buffer, size] = parser.prepare(declared.size());
+  std::memcpy(buffer, declared.data(), declared.size());
+  parser.commit(declared.size());
+  assert(!parser.parse(frames));
+  assert(parser.getState() == FrameParser::State::TooLarge);
+  // input is discarded until reset()
+  parser.feed(small.data(), small.size(), frames);
+  assert(frames.size() == 1);
+  parser.reset();
+  parser.feed(small.data(), small.size(), frames);
+  assert(frames.size() == 2);
+  // refused by its size when it has no content-length
+  FrameParser unbounded {};
+  unbounded.setMaxFrameSize(100);
+  std::string endless {"SEND\n\n" + std::string(200, 'y')};
+  auto [region, room] = unbounded.prepare(endless.size());
+  std::memcpy(region, endless.data(), endless.size());
+  unbounded.commit(endless.size());
+  assert(!unbounded.parse(frames));
+}
+
+// Slabs read into elsewhere and handed over, with the start of a split frame moved in
+// front of each; the slabs of frames already emitted are left alone.
+static void testAdopt() {
+  std::string input {};
+  for (int i=0; i<30; i++) {
+    input += "MESSAGE\nmessage-id:" + std::to_string(i) + "\ncontent-length:3\n\n" + std::string {"a\0", 2} + std::to_string(i % 10) + '\0';
+  }
+  const size_t headroom {64};
+  FrameParser parser {};
+  std::vector<FrameView> frames {};
+  for (size_t at=0, size=1; at<input.size(); at+=size, size=size%23+1) {
+    size = std::min(size, input.size() - at);
+    assert(parser.getPartial() <= headroom);
+    SlabPtr slab {std::make_shared<Slab>(headroom + size)};
+    std::memcpy(slab->data() + headroom, input.data() + at, size);
+    parser.adopt(slab, headroom, size);
+    assert(parser.parse(frames));
+  }
+  assert(frames.size() == 30);
+  for (int i=0; i<30; i++) {
+    assert(header(frames[i], "message-id") == std::to_string(i));
+    assert(frames[i].getBody() == (std::string {"a\0", 2} + std::to_string(i % 10)));
+  }
+}
+
+static std::vector<FrameView> parseEscaped(const std::string& input, HeaderEscaping escaping) {
+  FrameParser parser {};
+  parser.setEscaping(escaping);
+  std::vector<FrameView> frames {};
+  parser.feed(input.data(), input.size(), frames);
+  return frames;
+}
+
+static void testUnescaping() {
+  std::string input {std::string {"MESSAGE\nkey\\cname:a\\cb\\nc\\\\d\\re\n\n"} + '\0'};
+  assert(header(parseEscaped(input, HeaderEscaping::None)[0], "key\\cname") == "a\\cb\\nc\\\\d\\re");
+  // 1.1 has no \r, so it is kept as it is
+  assert(header(parseEscaped(input, HeaderEscaping::Stomp11)[0], "key:name") == "a:b\nc\\d\\re");
+  assert(header(parseEscaped(input, HeaderEscaping::Stomp12)[0], "key:name") == "a:b\nc\\d\re");
+  // CONNECTED headers are never escaped
+  std::string connected {std::string {"CONNECTED\nserver:a\\cb\n\n"} + '\0'};
+  assert(header(parseEscaped(connected, HeaderEscaping::Stomp12)[0], "server") == "a\\cb");
+}
+
+int main() {
+  testSimpleFrame();
+  testResumesAcrossReads();
+  testContentLength();
+  testFramesSpanSlabs();
+  testAdopt();
+  testMaxFrameSize();
+  testUnescaping();
+  std::printf("test_frame_parser: ok\n");
+  return 0;
+}
@@ -0,0 +1,62 @@
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <string>
+
+#include "stomp/header_codec.h"
+
+using namespace stomp;
+
+static std::string escape(std::string_view value, HeaderEscaping escaping) {
+  std::string out {};
+  appendEscaped(out, value, escaping);
+  return out;
+}
+
+static std::string unescape(std::string_view value, HeaderEscaping escaping) {
+  std::string out {};
+  appendUnescaped(out, value, escaping);
+  return out;
+}
+
+static void testEscaping() {
+  std::string value {"a:b\nc\\d\re"};
+  assert(escape(value, HeaderEscaping::None) == value);
+  // 1.1 does not escape CR
+  assert(escape(value, HeaderEscaping::Stomp11) == "a\\cb\\nc\\\\d\re");
+  assert(escape(value, HeaderEscaping::Stomp12) == "a\\cb\\nc\\\\d\\re");
+  assert(!needsEscaping("plain value", HeaderEscaping::Stomp12));
+  assert(!needsEscaping(value, HeaderEscaping::None));
+  assert(!needsEscaping("cr\r", HeaderEscaping::Stomp11));
+  assert(needsEscaping("cr\r", HeaderEscaping::Stomp12));
+  // specials on either side of the 8-byte words the scan goes by
+  for (size_t at=0; at<20; at++) {
+    std::string padded (20, 'x');
+    padded[at] = ':';
+    assert(needsEscaping(padded, HeaderEscaping::Stomp11));
+    std::string expected {padded.substr(0, at) + "\\c" + padded.substr(at + 1)};
+    assert(escape(padded, HeaderEscaping::Stomp11) == expected);
+  }
+}
+
+static void testUnescaping() {
+  for (auto escaping : {HeaderEscaping::Stomp11, HeaderEscaping::Stomp12}) {
+    std::string value {"a:b\nc\\d"};
+    assert(unescape(escape(value, escaping), escaping) == value);
+  }
+  assert(unescape("a\\re", HeaderEscaping::Stomp11) == "a\\re");
+  assert(unescape("a\\re", HeaderEscaping::Stomp12) == "a\re");
+  // undefined sequences and a trailing backslash are kept
+  assert(unescape("a\\tb\\", HeaderEscaping::Stomp12) == "a\\tb\\");
+  assert(unescape("a\\cb", HeaderEscaping::None) == "a\\cb");
+  assert(!needsUnescaping("a\\cb", HeaderEscaping::None));
+  assert(needsUnescaping("a\\cb", HeaderEscaping::Stomp11));
+  assert(!needsUnescaping("a:b", HeaderEscaping::Stomp12));
+}
+
+int main() {
+  testEscaping();
+  testUnescaping();
+  std::printf("test_header_codec: ok\n");
+  return 0;
+}
@@ -0,0 +1,96 @@
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <atomic>
+
+#include "recording_transport.h"
+#include "stomp/heartbeat_listener.h"
+
+using namespace stomp;
+
+struct TimeoutCounter : ConnectionListener {
+  std::atomic<int> timeouts {0};
+  virtual void onHeartbeatTimeout() { timeouts++; }
+};
+
+static FramePtr connected(const std::string& heartbeat) {
+  if (heartbeat.empty()) return FramePool::local()->make(FRAME_CONNECTED);
+  return FramePool::local()->make(FRAME_CONNECTED, Headers {{HEADER_HEARTBEAT, heartbeat}});
+}
+
+// CONNECT offers what we can send and want to receive; each side then beats at the slower
+// of what one offers and the other wants, and not at all where either says 0.
+static void testNegotiation() {
+  auto transport = std::make_shared<RecordingTransport>();
+  auto heartbeat = std::make_shared<HeartbeatListener>(transport, std::chrono::milliseconds(100), std::chrono::milliseconds(200));
+  FramePtr connect {FramePool::local()->make(FRAME_CONNECT)};
+  heartbeat->onSend(connect);
+  assert(connect->getHeaders().get(HEADER_HEARTBEAT) == "100,200");
+  heartbeat->onConnected(connected("300,50"));
+  assert(heartbeat->getSendInterval() == std::chrono::milliseconds(100));
+  assert(heartbeat->getReceiveInterval() == std::chrono::milliseconds(300));
+  heartbeat->onConnected(connected("100,400"));
+  assert(heartbeat->getSendInterval() == std::chrono::milliseconds(400));
+  assert(heartbeat->getReceiveInterval() == std::chrono::milliseconds(200));
+  heartbeat->onConnected(connected("0,0"));
+  assert(heartbeat->getSendInterval() == std::chrono::milliseconds(0));
+  assert(heartbeat->getReceiveInterval() == std::chrono::milliseconds(0));
+  heartbeat->onConnected(connected(""));
+  assert(heartbeat->getSendInterval() == std::chrono::milliseconds(0));
+  auto silent = std::make_shared<HeartbeatListener>(transport, std::chrono::milliseconds(0), std::chrono::milliseconds(0));
+  silent->onConnected(connected("100,100"));
+  assert(silent->getSendInterval() == std::chrono::milliseconds(0));
+  assert(silent->getReceiveInterval() == std::chrono::milliseconds(0));
+  heartbeat->onDisconnected();
+}
+
+// An idle connection gets an EOL every send interval, and none once disconnected.
+static void testBeatsWhenIdle() {
+  auto wheel = std::make_shared<TimerWheel>(std::chrono::milliseconds(1));
+  auto transport = std::make_shared<RecordingTransport>();
+  auto heartbeat = std::make_shared<HeartbeatListener>(transport, std::chrono::milliseconds(20), std::chrono::milliseconds(0), wheel);
+  heartbeat->onConnected(connected("0,20"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  size_t beats = transport->getHeartbeats();
+  assert(beats >= 5 && beats <= 11);
+  heartbeat->onDisconnected();
+  beats = transport->getHeartbeats();
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  assert(transport->getHeartbeats() == beats);
+}
+
+// While data keeps coming in, the server is alive; once it has been silent for the grace
+// period, the listeners are told HEARTBEAT_TIMEOUT and the connection is aborted, once.
+static void testTimeout() {
+  auto wheel = std::make_shared<TimerWheel>(std::chrono::milliseconds(1));
+  auto transport = std::make_shared<RecordingTransport>();
+  auto counter = std::make_shared<TimeoutCounter>();
+  transport->setListener("counter", counter);
+  auto heartbeat = std::make_shared<HeartbeatListener>(transport, std::chrono::milliseconds(0), std::chrono::milliseconds(20), wheel);
+  heartbeat->setGrace(2);
+  transport->receiveHeartbeat();
+  heartbeat->onConnected(connected("20,0"));
+  for (int i=0; i<10; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    transport->receiveHeartbeat();
+  }
+  assert(counter->timeouts == 0 && transport->getAborts() == 0);
+  auto silent = std::chrono::steady_clock::now();
+  assert(waitUntil([&transport](){ return transport->getAborts() > 0; }));
+  assert(std::chrono::steady_clock::now() - silent >= std::chrono::milliseconds(35));
+  assert(counter->timeouts == 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  assert(counter->timeouts == 1 && transport->getAborts() == 1);
+}
+
+int main() {
+  testNegotiation();
+  testBeatsWhenIdle();
+  testTimeout();
+  std::printf("test_heartbeat_listener: ok\n");
+  return 0;
+}
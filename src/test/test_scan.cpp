@@ -0,0 +1,99 @@
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <random>
+
+#include "stomp/scan.h"
+
+using namespace stomp;
+
+static std::vector<const scan::Kernel*> kernels() {
+  std::vector<const scan::Kernel*> kernels {&scan::scalarKernel};
+#ifdef STOMP_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) kernels.push_back(&scan::sse2Kernel);
+  if (__builtin_cpu_supports("avx2")) kernels.push_back(&scan::avx2Kernel);
+#endif
+  return kernels;
+}
+
+static uint64_t expectedMatch(const std::string& data, size_t offset, char c) {
+  uint64_t bits {0};
+  for (size_t i=0; i<STOMP_SCAN_BLOCK && offset + i < data.size(); i++) {
+    if (data[offset + i] == c) bits |= uint64_t {1} << i;
+  }
+  return bits;
+}
+
+// Every block of every size, including the short tail blocks read from the end of the
+// buffer and the buffers shorter than a block, against a byte loop.
+static void testBlocks() {
+  std::mt19937 random {42};
+  for (auto kernel : kernels()) {
+    scan::setKernel(*kernel);
+    for (size_t size=0; size<=200; size++) {
+      std::string data (size, 'a');
+      for (auto& c : data) {
+        unsigned r = random() % 8;
+        c = r == 0? '\n': r == 1? ':': r == 2? '\0': 'a' + r;
+      }
+      for (size_t offset=0; offset<size; offset++) {
+        assert(scan::match(data.data(), offset, size, '\n') == expectedMatch(data, offset, '\n'));
+        assert(scan::match(data.data(), offset, size, '\0') == expectedMatch(data, offset, '\0'));
+        scan::Masks masks;
+        scan::masks(data.data(), offset, size, masks);
+        assert(masks.newline == expectedMatch(data, offset, '\n'));
+        assert(masks.colon == expectedMatch(data, offset, ':'));
+      }
+      const char* nul = scan::find(data.data(), data.data() + size, '\0');
+      assert(static_cast<size_t>(nul - data.data()) == std::min(data.find('\0'), size));
+    }
+  }
+  scan::setKernel(*scan::bestKernel());
+}
+
+static std::vector<std::pair<std::string,std::string>> headers(const std::string& block, size_t* end = nullptr) {
+  std::vector<std::pair<std::string,std::string>> found {};
+  size_t bodyStart = scan::forEachHeader(block, [&](std::string_view key, std::string_view value){
+    found.emplace_back(key, value);
+  });
+  if (end) *end = bodyStart;
+  return found;
+}
+
+static void testForEachHeader() {
+  for (auto kernel : kernels()) {
+    scan::setKernel(*kernel);
+    size_t end {0};
+    auto found = headers("a:1\r\nbb:x:y\nnocolon\n:empty\n\nbody", &end);
+    assert(found.size() == 4);
+    assert(found[0].first == "a" && found[0].second == "1");
+    assert(found[1].first == "bb" && found[1].second == "x:y");
+    assert(found[2].first == "nocolon" && found[2].second.empty());
+    assert(found[3].first.empty() && found[3].second == "empty");
+    assert(end == std::string {"a:1\r\nbb:x:y\nnocolon\n:empty\n\n"}.size());
+    // lines and colons on either side of block boundaries
+    std::string block {};
+    std::vector<std::pair<std::string,std::string>> expected {};
+    for (int i=0; i<40; i++) {
+      std::string key (i % 70 + 1, 'k');
+      std::string value (i * 7 % 130, 'v');
+      if (i % 3 == 0) value += ":tail";
+      block += key + ":" + value + "\n";
+      expected.emplace_back(key, value);
+    }
+    assert(headers(block) == expected);
+    // the last line need not end in a newline
+    assert(headers(block + "last:1").back() == std::make_pair(std::string {"last"}, std::string {"1"}));
+  }
+  scan::setKernel(*scan::bestKernel());
+}
+
+int main() {
+  testBlocks();
+  testForEachHeader();
+  std::printf("test_scan: ok\n");
+  return 0;
+}
@@ -0,0 +1,99 @@
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "recording_transport.h"
+#include "stomp/session_recovery.h"
+
+using namespace stomp;
+
+struct Session {
+  RecordingTransportPtr transport {std::make_shared<RecordingTransport>()};
+  SessionRecoveryPtr recovery {std::make_shared<SessionRecovery>(transport)};
+  Session() {
+    transport->setListener("recovery", recovery);
+    this->send(FRAME_CONNECT, {{HEADER_ACCEPT_VERSION, "1.2"}});
+  }
+  void send(const char* command, Headers headers, std::string body = "") {
+    transport->transmit(FramePool::local()->make(command, std::move(headers), std::move(body)));
+  }
+  void receipt(const std::string& id) {
+    transport->processFrame(FramePool::local()->make(FRAME_RECEIPT, Headers {{HEADER_RECEIPT_ID, id}}));
+  }
+  // The frames sent, each as its command and the value of header.
+  std::vector<std::string> sent(std::string_view header) {
+    std::vector<std::string> frames {};
+    for (auto& frame : transport->getSent()) {
+      frames.push_back(std::string {frame.getCmd()} + " " + std::string {frame.getHeader(header).value_or("")});
+    }
+    return frames;
+  }
+};
+
+// After a reconnect the CONNECT, then the subscriptions still active, then the SENDs whose
+// receipt has not come go out again in one write, each in the order first sent.
+static void testReplay() {
+  Session session {};
+  session.send(FRAME_SUBSCRIBE, {{HEADER_ID, "1"}, {HEADER_DESTINATION, "/queue/a"}});
+  session.send(FRAME_SEND, {{HEADER_DESTINATION, "/queue/b"}, {HEADER_RECEIPT, "r-1"}}, "confirmed");
+  session.send(FRAME_SUBSCRIBE, {{HEADER_ID, "2"}, {HEADER_DESTINATION, "/queue/b"}});
+  session.send(FRAME_SEND, {{HEADER_DESTINATION, "/queue/b"}, {HEADER_RECEIPT, "r-2"}}, "unconfirmed");
+  session.send(FRAME_SEND, {{HEADER_DESTINATION, "/queue/b"}}, "not asked for");
+  session.send(FRAME_SUBSCRIBE, {{HEADER_ID, "3"}, {HEADER_DESTINATION, "/queue/c"}});
+  session.send(FRAME_UNSUBSCRIBE, {{HEADER_ID, "1"}});
+  session.receipt("r-1");
+  assert(session.recovery->getSubscriptionCount() == 2);
+  assert(session.recovery->getUnconfirmedCount() == 1);
+  session.transport->clearSent();
+  session.transport->reconnect();
+  assert((session.sent(HEADER_ID) == std::vector<std::string> {"CONNECT ", "SUBSCRIBE 2", "SUBSCRIBE 3", "SEND "}));
+  assert(session.sent(HEADER_RECEIPT)[3] == "SEND r-2");
+  assert(session.transport->getWrites() == 1);
+  // the replayed CONNECT carries on the session rather than start a new one
+  assert(session.recovery->getSubscriptionCount() == 2);
+  assert(session.recovery->getUnconfirmedCount() == 1);
+  // a CONNECT of the application's own starts afresh
+  session.send(FRAME_CONNECT, {{HEADER_ACCEPT_VERSION, "1.2"}});
+  assert(session.recovery->getSubscriptionCount() == 0);
+  assert(session.recovery->getUnconfirmedCount() == 0);
+}
+
+// STOMP 1.0 subscriptions without an id are known by their destination, and an
+// UNSUBSCRIBE by destination ends every subscription to it.
+static void testUnsubscribeDestination() {
+  Session session {};
+  session.send(FRAME_SUBSCRIBE, {{HEADER_DESTINATION, "/queue/a"}});
+  session.send(FRAME_SUBSCRIBE, {{HEADER_DESTINATION, "/queue/b"}});
+  session.send(FRAME_SUBSCRIBE, {{HEADER_ID, "1"}, {HEADER_DESTINATION, "/queue/a"}});
+  // the same subscription again
+  session.send(FRAME_SUBSCRIBE, {{HEADER_DESTINATION, "/queue/b"}});
+  assert(session.recovery->getSubscriptionCount() == 3);
+  session.send(FRAME_UNSUBSCRIBE, {{HEADER_DESTINATION, "/queue/a"}});
+  assert(session.recovery->getSubscriptionCount() == 1);
+  session.transport->clearSent();
+  session.transport->reconnect();
+  assert((session.sent(HEADER_DESTINATION) == std::vector<std::string> {"CONNECT ", "SUBSCRIBE /queue/b"}));
+}
+
+// DISCONNECT ends the session: there is nothing to replay after it.
+static void testDisconnect() {
+  Session session {};
+  session.send(FRAME_SUBSCRIBE, {{HEADER_ID, "1"}, {HEADER_DESTINATION, "/queue/a"}});
+  session.send(FRAME_SEND, {{HEADER_DESTINATION, "/queue/a"}, {HEADER_RECEIPT, "r-1"}}, "unconfirmed");
+  session.send(FRAME_DISCONNECT, {{HEADER_RECEIPT, "r-2"}});
+  assert(session.recovery->getSubscriptionCount() == 0);
+  assert(session.recovery->getUnconfirmedCount() == 0);
+  session.transport->clearSent();
+  session.transport->reconnect();
+  assert(session.transport->getSent().empty());
+}
+
+int main() {
+  testReplay();
+  testUnsubscribeDestination();
+  testDisconnect();
+  std::printf("test_session_recovery: ok\n");
+  return 0;
+}
@@ -0,0 +1,109 @@
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <atomic>
+
+#include "stomp/timer_wheel.h"
+
+using namespace stomp;
+using Clock = TimerWheel::Clock;
+
+struct Fired {
+  std::mutex mutex {};
+  std::vector<std::pair<int,Clock::duration>> order {};
+};
+
+// Timers on every level of a 1 ms wheel (level 0 spans 64 ticks, level 1 4096) come due
+// in order and never early, after cascading down.
+static void testCascading() {
+  TimerWheel wheel {std::chrono::milliseconds(1)};
+  Fired fired {};
+  auto start = Clock::now();
+  std::vector<int> delays {300, 3, 70, 63, 64, 1, 150, 4100};
+  for (int delay : delays) {
+    wheel.schedule(std::chrono::milliseconds(delay), [&fired, delay, start](){
+      std::lock_guard<std::mutex> lock {fired.mutex};
+      fired.order.emplace_back(delay, Clock::now() - start);
+    });
+  }
+  assert(wheel.size() == delays.size());
+  std::this_thread::sleep_for(std::chrono::milliseconds(4400));
+  std::lock_guard<std::mutex> lock {fired.mutex};
+  assert(fired.order.size() == delays.size());
+  for (size_t i=0; i<fired.order.size(); i++) {
+    auto [delay, at] = fired.order[i];
+    assert(at >= std::chrono::milliseconds(delay));
+    if (i > 0) assert(delay > fired.order[i-1].first);
+  }
+  assert(wheel.size() == 0);
+}
+
+static void testCancel() {
+  TimerWheel wheel {std::chrono::milliseconds(1)};
+  std::atomic<int> runs {0};
+  uint64_t near = wheel.schedule(std::chrono::milliseconds(5), [&runs](){ runs += 1; });
+  uint64_t far = wheel.schedule(std::chrono::milliseconds(100), [&runs](){ runs += 10; });
+  wheel.schedule(std::chrono::milliseconds(20), [&runs](){ runs += 100; });
+  wheel.cancel(near);
+  wheel.cancel(far);
+  assert(wheel.size() == 1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  assert(runs == 100);
+}
+
+// After the wheel has been idle, a timer is due from now, not from when it last ticked.
+static void testIdle() {
+  TimerWheel wheel {std::chrono::milliseconds(1)};
+  std::atomic<int> runs {0};
+  wheel.schedule(std::chrono::milliseconds(1), [&runs](){ runs++; });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  assert(runs == 1);
+  auto start = Clock::now();
+  std::atomic<int64_t> after {0};
+  wheel.schedule(std::chrono::milliseconds(30), [&after, start](){
+    after = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  assert(after >= 30);
+}
+
+// Arming a WheelTimer again replaces what was armed, and a task that was already under
+// way when its timer was stopped finds it no longer current.
+static void testWheelTimer() {
+  auto wheel = std::make_shared<TimerWheel>(std::chrono::milliseconds(1));
+  std::mutex mutex {};
+  WheelTimer timer {wheel};
+  std::vector<uint64_t> generations {};
+  std::atomic<int> fired {0};
+  auto task = [&](uint64_t generation){
+    std::lock_guard<std::mutex> lock {mutex};
+    generations.push_back(generation);
+    if (timer.fire(generation)) fired++;
+  };
+  {
+    std::lock_guard<std::mutex> lock {mutex};
+    timer.arm(std::chrono::milliseconds(5), task);
+    timer.arm(std::chrono::milliseconds(10), task);
+    assert(timer.isArmed());
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  std::lock_guard<std::mutex> lock {mutex};
+  assert(generations.size() == 1 && fired == 1);
+  assert(!timer.isArmed() && timer.isCurrent(generations.front()));
+  timer.stop();
+  assert(!timer.fire(generations.front()));
+  assert(wheel->size() == 0);
+}
+
+int main() {
+  testCascading();
+  testCancel();
+  testIdle();
+  testWheelTimer();
+  std::printf("test_timer_wheel: ok\n");
+  return 0;
+}
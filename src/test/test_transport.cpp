@@ -0,0 +1,248 @@
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <atomic>
+
+#include "peer.h"
+#include "recording_transport.h"
+#include "stomp/transport.h"
+#include "stomp/epoll_transport.h"
+#include "stomp/session_recovery.h"
+
+using namespace stomp;
+
+static FramePtr sendFrame(int i) {
+  return FramePool::local()->make(FRAME_SEND, Headers {{HEADER_DESTINATION, "/queue/a"}}, "message " + std::to_string(i));
+}
+
+// A batch flushed because it reached the frame limit arrives whole without a further send,
+// however the kernel was told more would follow.
+static void testLimitFlushArrives(FlushPolicy::Cork cork, std::chrono::microseconds maxDelay) {
+  Peer peer {};
+  auto transport = std::make_shared<Transport>(peer.address());
+  std::thread accepting {[&peer](){ peer.accept(); }};
+  transport->start();
+  accepting.join();
+  FlushPolicy policy {};
+  policy.maxFrames = 4;
+  policy.maxDelay = maxDelay;
+  policy.cork = cork;
+  transport->setFlushPolicy(policy);
+  // a first batch, then the one whose tail could be held back
+  for (int i=0; i<8; i++) transport->transmit(sendFrame(i));
+  auto took = peer.receive(8);
+  // without a release the tail would wait for the kernel's 200 ms cork timeout
+  assert(took < std::chrono::milliseconds(100));
+  peer.socket.reset();
+  transport->stop();
+}
+
+// Frames queued by transmitAsync() that can't be sent are counted, fail their receipts
+// and are handed to the send failure callback.
+static void testAsyncFailure() {
+  auto transport = std::make_shared<RecordingTransport>();
+  std::mutex mutex {};
+  std::vector<FramePtr> failed {};
+  transport->setSendFailureCallback([&](FramePtr frame, std::exception_ptr error){
+    assert(error);
+    std::lock_guard<std::mutex> lock {mutex};
+    failed.push_back(frame);
+  });
+  std::atomic<int> receipts {0};
+  assert(transport->transmitAsync(sendFrame(0)));
+  transport->drain();
+  transport->setFailing(true);
+  FramePtr confirmed = FramePool::local()->make(FRAME_SEND, Headers {{HEADER_DESTINATION, "/queue/a"}, {HEADER_RECEIPT, "r-1"}}, "message 1");
+  transport->expectReceipt("r-1", [&receipts](FramePtr receipt){ if (!receipt) receipts++; });
+  assert(transport->transmitAsync(confirmed));
+  assert(transport->transmitAsync(sendFrame(2)));
+  transport->drain();
+  assert(transport->getSent().size() == 1);
+  assert(transport->getFailedFrames() == 2);
+  assert(receipts == 1);
+  std::lock_guard<std::mutex> lock {mutex};
+  assert(failed.size() == 2 && failed[0] == confirmed);
+}
+
+// Once the transport is stopped, transmitAsync() refuses frames whatever the backpressure,
+// as nothing would write them; started again, it sends them.
+static void testAsyncRestart() {
+  Peer peer {};
+  auto transport = std::make_shared<Transport>(peer.address());
+  std::thread accepting {[&peer](){ peer.accept(); }};
+  transport->start();
+  accepting.join();
+  assert(transport->transmitAsync(sendFrame(0)));
+  peer.receive(1);
+  peer.socket.reset();
+  transport->stop();
+  for (auto backpressure : {AsyncPolicy::Backpressure::Block, AsyncPolicy::Backpressure::DropOldest, AsyncPolicy::Backpressure::FailFast}) {
+    AsyncPolicy policy {};
+    policy.backpressure = backpressure;
+    transport->setAsyncPolicy(policy);
+    assert(!transport->transmitAsync(sendFrame(1)));
+  }
+  accepting = std::thread {[&peer](){ peer.accept(); }};
+  transport->start();
+  accepting.join();
+  assert(transport->transmitAsync(sendFrame(2)));
+  peer.receive(1);
+  peer.socket.reset();
+  transport->stop();
+}
+
+// A heart-beat never waits, as it is sent from the shared timer thread: not while another
+// thread is stuck writing to a server that has stopped reading, and it goes out once the
+// server reads again.
+static void testHeartbeatNeverWaits() {
+  Peer peer {};
+  auto transport = std::make_shared<Transport>(peer.address());
+  std::thread accepting {[&peer](){ peer.accept(); }};
+  transport->start();
+  accepting.join();
+  const int count {16};
+  std::string big (1 << 20, 'x');
+  std::thread sending {[&transport, &big](){
+    for (int i=0; i<count; i++) transport->transmit(FramePool::local()->make(FRAME_SEND, Headers {{HEADER_DESTINATION, "/queue/a"}}, big));
+  }};
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  auto start = std::chrono::steady_clock::now();
+  auto lastSent = transport->getLastSent();
+  transport->sendHeartbeat();
+  assert(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50));
+  assert(transport->getLastSent() == lastSent);
+  peer.receive(count);
+  sending.join();
+  transport->sendHeartbeat();
+  char eol {};
+  assert(peer.socket->recv(&eol, 1) == 1 && eol == '\n');
+  peer.socket.reset();
+  transport->stop();
+}
+
+// An EpollTransport connects on its loop: what is sent before the connection is made goes
+// out once it is, and when no broker can be reached the listeners are told DISCONNECTED.
+static void testEpollConnect() {
+  auto loop = std::make_shared<EventLoop>();
+  loop->start();
+  Peer peer {};
+  auto transport = std::make_shared<EpollTransport>(loop, peer.address());
+  std::thread accepting {[&peer](){ peer.accept(); }};
+  transport->start();
+  transport->transmit(sendFrame(0));
+  accepting.join();
+  peer.receive(1);
+  peer.socket.reset();
+  transport->stop();
+  unsigned short closed {0};
+  {
+    TCPServerSocket server {0};
+    closed = server.getLocalPort();
+  }
+  auto refused = std::make_shared<EpollTransport>(loop, HostsAndPorts {std::make_shared<HostAndPort>("127.0.0.1", closed)});
+  refused->start();
+  assert(!refused->waitForConnection(5));
+  refused->stop();
+}
+
+struct Counter : ConnectionListener {
+  std::atomic<int> connecting {0};
+  std::atomic<int> messages {0};
+  virtual void onConnecting(HostAndPortPtr /*hostAndPort*/) { connecting++; }
+  virtual void onMessage(const FrameView& /*view*/) { messages++; }
+};
+
+static std::string message(int i) {
+  return "MESSAGE\ndestination:/queue/a\nmessage-id:" + std::to_string(i) + "\n\n" + '\0';
+}
+
+// Set to reconnect, a transport that loses its connection makes a new one and goes on
+// receiving on it.
+template <typename Make>
+static void testReconnect(Make make) {
+  Peer peer {};
+  auto transport = make(peer.address());
+  transport->setAutoReconnect(true);
+  auto counter = std::make_shared<Counter>();
+  transport->setListener("counter", counter);
+  std::thread accepting {[&peer](){ peer.accept(); }};
+  transport->start();
+  accepting.join();
+  peer.send(message(0));
+  assert(waitUntil([&counter](){ return counter->messages == 1; }));
+  accepting = std::thread {[&peer](){ peer.accept(); }};
+  peer.socket.reset();
+  accepting.join();
+  assert(waitUntil([&counter](){ return counter->connecting == 2; }));
+  peer.send(message(1));
+  assert(waitUntil([&counter](){ return counter->messages == 2; }));
+  transport->setAutoReconnect(false);
+  peer.socket.reset();
+  transport->stop();
+}
+
+// Sends from another thread while the session is replayed after a reconnect wait for the
+// replay, rather than go out on the new connection ahead of its CONNECT.
+struct Racer : ConnectionListener {
+  TransportPtr transport {};
+  std::thread sender {};
+  virtual void onConnecting(HostAndPortPtr /*hostAndPort*/) {
+    if (!transport->isReconnecting()) return;
+    sender = std::thread {[this](){ transport->transmit(sendFrame(1)); }};
+    // give the sender every chance to go first
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+};
+
+static void testReplayGoesFirst() {
+  Peer peer {};
+  auto transport = std::make_shared<Transport>(peer.address());
+  transport->setAutoReconnect(true);
+  auto racer = std::make_shared<Racer>();
+  racer->transport = transport;
+  // listeners are called in name order, so the racer is told CONNECTING before the recovery
+  transport->setListener("racer", racer);
+  transport->setListener("recovery", std::make_shared<SessionRecovery>(transport));
+  std::thread accepting {[&peer](){ peer.accept(); }};
+  transport->start();
+  accepting.join();
+  transport->transmit(FramePool::local()->make(FRAME_CONNECT, Headers {{HEADER_ACCEPT_VERSION, "1.2"}}));
+  transport->transmit(FramePool::local()->make(FRAME_SUBSCRIBE, Headers {{HEADER_ID, "1"}, {HEADER_DESTINATION, "/queue/a"}}));
+  peer.receive(2);
+  accepting = std::thread {[&peer](){ peer.accept(); }};
+  peer.socket.reset();
+  accepting.join();
+  std::string replayed {peer.take(3)};
+  racer->sender.join();
+  assert(replayed.rfind("CONNECT\n", 0) == 0);
+  size_t subscribe = replayed.find("SUBSCRIBE\n");
+  size_t send = replayed.find("SEND\n");
+  assert(subscribe != std::string::npos && send != std::string::npos && subscribe < send);
+  transport->setAutoReconnect(false);
+  peer.socket.reset();
+  transport->stop();
+}
+
+int main() {
+  testAsyncFailure();
+  testAsyncRestart();
+  testHeartbeatNeverWaits();
+  testEpollConnect();
+  testReconnect([](HostsAndPorts address){ return std::make_shared<Transport>(address); });
+  auto loop = std::make_shared<EventLoop>();
+  loop->start();
+  testReconnect([&loop](HostsAndPorts address){ return std::make_shared<EpollTransport>(loop, address); });
+  testReplayGoesFirst();
+  for (auto cork : {FlushPolicy::Cork::None, FlushPolicy::Cork::MsgMore, FlushPolicy::Cork::TcpCork}) {
+    testLimitFlushArrives(cork, std::chrono::microseconds(0));
+    testLimitFlushArrives(cork, std::chrono::microseconds(5000));
+  }
+  std::printf("test_transport: ok\n");
+  return 0;
+}
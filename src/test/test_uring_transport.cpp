@@ -0,0 +1,130 @@
+#undef NDEBUG
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <system_error>
+
+#include "peer.h"
+#include "recording_transport.h"
+#include "stomp/uring_transport.h"
+
+using namespace stomp;
+
+// Keeps every MESSAGE it is given, as the view itself so its buffer stays held.
+struct Keeper : ConnectionListener {
+  std::mutex mutex {};
+  std::vector<FrameView> messages {};
+  virtual void onMessage(const FrameView& view) {
+    std::lock_guard<std::mutex> lock {mutex};
+    messages.push_back(view);
+  }
+  size_t count() {
+    std::lock_guard<std::mutex> lock {mutex};
+    return messages.size();
+  }
+};
+
+static std::string body(int i) {
+  return std::string(i * 37 % 3000, static_cast<char>('a' + i % 26));
+}
+
+// MESSAGEs of every size around the buffers', some with NULs in a content-length body.
+static std::string messages(int count) {
+  std::string data {};
+  for (int i=0; i<count; i++) {
+    data += "MESSAGE\ndestination:/queue/a\nmessage-id:" + std::to_string(i) + "\n";
+    std::string content {body(i)};
+    if (i % 3 == 0) {
+      if (!content.empty()) content[content.size() / 2] = '\0';
+      data += "content-length:" + std::to_string(content.size()) + "\n";
+    }
+    data += "\n" + content + '\0' + "\n";
+  }
+  return data;
+}
+
+static bool received(const FrameView& message, int i) {
+  std::string content {body(i)};
+  if (i % 3 == 0 && !content.empty()) content[content.size() / 2] = '\0';
+  return message.getHeader(HEADER_MESSAGE_ID) == std::to_string(i) && message.getBody() == content;
+}
+
+// Frames arrive whole across buffers smaller than some of them, both when the start of a
+// frame is moved in front of the next buffer and when a longer one is copied out of it.
+// With few buffers, every one of them is soon held by a kept frame, so reading goes on
+// without them; a kept frame is never overwritten by a later read.
+static void testReceive(unsigned buffers) {
+  Peer peer {};
+  UringOptions options {};
+  options.recvBuffers = buffers;
+  options.recvBufferSize = 1024;
+  options.recvHeadroom = 256;
+  auto transport = std::make_shared<UringTransport>(peer.address(), options);
+  auto keeper = std::make_shared<Keeper>();
+  transport->setListener("keeper", keeper);
+  std::thread accepting {[&peer](){ peer.accept(); }};
+  transport->start();
+  accepting.join();
+  const int count {300};
+  std::string data {messages(count)};
+  // in uneven pieces, so frames are split everywhere
+  for (size_t at=0, piece=1; at<data.size(); at+=piece, piece=piece*7%5003+1) {
+    peer.send(data.substr(at, piece));
+  }
+  for (int i=0; i<2000 && keeper->count() < count; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  {
+    std::lock_guard<std::mutex> lock {keeper->mutex};
+    assert(keeper->messages.size() == count);
+    for (int i=0; i<count; i++) assert(received(keeper->messages[i], i));
+  }
+  peer.socket.reset();
+  transport->stop();
+}
+
+// Set to reconnect, the transport sets up new rings for the new connection, after letting
+// go of the old ones, and goes on receiving.
+static void testReconnect() {
+  Peer peer {};
+  auto transport = std::make_shared<UringTransport>(peer.address());
+  transport->setAutoReconnect(true);
+  auto keeper = std::make_shared<Keeper>();
+  transport->setListener("keeper", keeper);
+  std::thread accepting {[&peer](){ peer.accept(); }};
+  transport->start();
+  accepting.join();
+  peer.send(messages(1));
+  assert(waitUntil([&keeper](){ return keeper->count() == 1; }));
+  accepting = std::thread {[&peer](){ peer.accept(); }};
+  peer.socket.reset();
+  accepting.join();
+  peer.send(messages(2));
+  assert(waitUntil([&keeper](){ return keeper->count() == 3; }));
+  {
+    std::lock_guard<std::mutex> lock {keeper->mutex};
+    assert(received(keeper->messages[2], 1));
+  }
+  transport->setAutoReconnect(false);
+  peer.socket.reset();
+  transport->stop();
+}
+
+int main() {
+  try {
+    Uring probe {2};
+  } catch (std::system_error& e) {
+    std::printf("test_uring_transport: skipped, no io_uring (%s)\n", e.what());
+    return 0;
+  }
+  testReceive(64);
+  testReceive(4);
+  testReconnect();
+  std::printf("test_uring_transport: ok\n");
+  return 0;
+}